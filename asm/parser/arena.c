@@ -0,0 +1,151 @@
+/*
+ * arena.c -- bump allocator freed in one go
+ *
+ * An arena hands out memory in order from 64K blocks and frees every block
+ * at once, so the many small strings of an assembly cost no malloc or free
+ * each. Every thread has two:
+ *
+ *     keep      lists and strings kept until the run ends (arena_done)
+ *     scratch   strings of the statement being assembled, emptied when
+ *               the next statement starts (scratch_reset)
+ *
+ * strfunc.c returns its strings in the scratch arena, so they neither
+ * overwrite each other within a statement nor have a length limit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "arena.h"
+#include "common.h"
+
+#define BLOCKSIZE   65536   // bytes of a block, larger requests get their own
+#define ALIGN       8       // every allocation starts on this boundary
+
+/* Helper function declarations */
+void* emalloc(size_t n);                            // defined in linkedlist.c
+
+/* block of an arena */
+struct block {
+    struct block* next;
+    size_t        size;
+    size_t        used;
+    char          buf[];
+};
+
+/* file scope variables, one of each per thread */
+static __thread struct arena keep;      /* until the run ends */
+static __thread struct arena scratch;   /* until the next statement */
+
+
+/**
+* Shared functions (arena.h)
+*/
+
+/* return n bytes of a */
+void* arena_alloc(struct arena* a, size_t n)
+{
+    n = (n + ALIGN - 1) / ALIGN * ALIGN;
+    if (a->head == NULL || a->head->used + n > a->head->size) {
+        size_t size = n > BLOCKSIZE ? n : BLOCKSIZE;
+        struct block* b = emalloc(sizeof(struct block) + size);
+        b->size = size;
+        b->used = 0;
+        b->next = a->head;
+        a->head = b;
+    }
+    void* p = a->head->buf + a->head->used;
+    a->head->used += n;
+    return p;
+}
+
+/* copy str into a */
+char* arena_strdup(struct arena* a, char* str)
+{
+    size_t len = strlen(str) + 1;
+    return memcpy(arena_alloc(a, len), str, len);
+}
+
+/* printf into a string of a, as long as it needs. written in place when
+   it fits the rest of the block, so it is formatted only once */
+char* arena_printf(struct arena* a, char* fmt, ...)
+{
+    va_list ap;
+    size_t room = a->head ? a->head->size - a->head->used : 0;
+    char* str = a->head ? a->head->buf + a->head->used : NULL;
+    va_start(ap, fmt);
+    int n = vsnprintf(str, room, fmt, ap);
+    va_end(ap);
+    if ((size_t) n < room) {
+        a->head->used += (n + ALIGN) / ALIGN * ALIGN;  // n chars and the '\0'
+        return str;
+    }
+    str = arena_alloc(a, n + 1);
+    va_start(ap, fmt);
+    vsnprintf(str, n + 1, fmt, ap);
+    va_end(ap);
+    return str;
+}
+
+/* move the blocks of src into dst, so they are freed with it */
+void arena_merge(struct arena* dst, struct arena* src)
+{
+    struct block* tail = src->head;
+    if (tail == NULL) return;
+    while (tail->next) tail = tail->next;
+    if (dst->head == NULL) {
+        dst->head = src->head;
+    }
+    else {
+        tail->next = dst->head->next;  // dst keeps allocating from its head
+        dst->head->next = src->head;
+    }
+    src->head = NULL;
+}
+
+/* free every block but the newest, which is reused from the start */
+void arena_reset(struct arena* a)
+{
+    if (a->head == NULL) return;
+    struct block* b = a->head->next;
+    while (b) {
+        struct block* next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head->next = NULL;
+    a->head->used = 0;
+}
+
+void arena_free(struct arena* a)
+{
+    arena_reset(a);
+    free(a->head);
+    a->head = NULL;
+}
+
+/* arena of this thread kept until arena_done */
+struct arena* keep_arena()
+{
+    return &keep;
+}
+
+/* arena of this thread for the current statement */
+struct arena* scratch_arena()
+{
+    return &scratch;
+}
+
+/* a new statement starts: strings of the last one are no longer used */
+void scratch_reset()
+{
+    arena_reset(&scratch);
+}
+
+/* free both arenas of this thread */
+void arena_done()
+{
+    arena_free(&keep);
+    arena_free(&scratch);
+}
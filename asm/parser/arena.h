@@ -0,0 +1,34 @@
+/*
+ * arena.h -- bump allocator freed in one go
+ */
+
+#ifndef ARENA_INCL
+#define ARENA_INCL
+
+#include <stddef.h>
+
+struct block;  // arena.c
+
+/*
+    name:       arena
+    purpose:    memory handed out in order from large blocks, freed all at once
+    field:      head  - block allocated from, the older ones behind it
+*/
+struct arena {
+    struct block* head;
+};
+
+void*  arena_alloc(struct arena* a, size_t n);
+char*  arena_strdup(struct arena* a, char* str);
+char*  arena_printf(struct arena* a, char* fmt, ...);
+void   arena_merge(struct arena* dst, struct arena* src);
+void   arena_reset(struct arena* a);
+void   arena_free(struct arena* a);
+
+/* arenas of the calling thread */
+struct arena* keep_arena();
+struct arena* scratch_arena();
+void   scratch_reset();
+void   arena_done();
+
+#endif /* ARENA_INCL */
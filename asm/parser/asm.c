@@ -0,0 +1,747 @@
+/*
+ * asm.c -- two passes over the statement list into a mif file
+ *
+ * The 1st path defines labels and records label dependent instructions
+ * (relax.c), addr_resolution sizes them, and the 2nd path encodes every
+ * statement into the mif file. parser runs it over a lexed source file,
+ * min16-ld over the statements of the object files it links (obj.c).
+ *
+ * The annotated mif is written line by line as the 2nd path encodes, with
+ * the source and binary of every word. The other formats (out.c) only
+ * store the words in the memory image and write it when the path ends, so
+ * no annotation is ever formatted for them.
+ *
+ * Bytes of data pack two to a word (directives.c). Labels, instructions,
+ * .word and .half start on a word, so a byte left over pads the next one.
+ * Instruction words are 2 bytes and relaxation grows code by words, so
+ * the padding found on the 1st path never changes. An annotated mif line
+ * is written once both bytes of its word are known (write_byte).
+ *
+ * Once addr_resolution has fixed every address, the statements encode
+ * independently, so a large source is cut into chunks and the 2nd path
+ * runs on a pool of threads (-j). A chunk starts at the address and site
+ * relax.c computed for its first statement, and keeps its words, mif text
+ * and error lines aside; they are merged in chunk order afterwards, so the
+ * output and the reports are the same as with one thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "asm.h"
+#include "lexer.h"
+#include "ir.h"
+#include "linkedlist.h"
+#include "symtab.h"
+#include "relax.h"
+#include "encoder.h"
+#include "synth.h"
+#include "directives.h"
+#include "strfunc.h"
+#include "out.h"
+#include "strip.h"
+#include "layout.h"
+#include "arena.h"
+#include "common.h"
+
+#define CHUNK_LINES 4096    // fewest statements worth a thread
+#define CHUNKS      4       // chunks per thread, evens out slow ones
+#define CHUNK_BYTE  0x10000 // words entry of a single byte
+#define PHASES      10      // phases -t times
+
+/*
+  name:    chunk
+  purpose: statements the 2nd path encodes on one thread
+  field:   first, end - statements first .. end-1
+           addr       - address of first, 1st path until relaxed
+           item       - relax.c items in front of first
+           next       - address after end-1, set by the thread
+           errors     - error lines of the chunk
+           peeps      - peephole lines of the chunk
+           words      - address and value of every word written, 2 ints each.
+                        CHUNK_BYTE marks a byte
+           split      - annotated, a byte joined a word of the chunk before
+           nwords     - ints used in words
+           text, len  - annotated mif of the chunk
+*/
+struct chunk {
+    int    first, end;
+    int    addr;
+    int    item;
+    int    next;
+    struct list errors;
+    struct list peeps;
+    int*   words;
+    int    nwords, maxwords;
+    int    split;
+    char*  text;
+    size_t len;
+};
+
+/* chunks shared by the threads, taken in order */
+struct pool {
+    struct chunk*   chunks;
+    int             n;
+    int             taken;
+    FILE*           fp;
+    struct arena*   keep;                 /* takes the lists the threads built */
+    int             sites, bytes, saved;  /* autogen statistics of all threads */
+    pthread_mutex_t lock;
+};
+
+/* file scope variables, the 2nd path ones per thread */
+static __thread FILE*        fp_w = NULL;     /* file pointer for writing */
+static __thread int          address = 0;     /* location counter */
+static __thread struct stmt* cur = NULL;      /* statement on 2nd path */
+static __thread int          lineno = 0;      /* line number on 2nd path */
+static __thread struct list* peeps = NULL;    /* where peep_message adds */
+static __thread struct chunk* chunk = NULL;   /* chunk being encoded, NULL on one thread */
+static __thread int          held = -1;      /* annotated, even address of a byte waiting for the odd one */
+static __thread int          held_value;
+static __thread char         held_text[STRLEN];
+static int          optimize = 1;    /* peephole level, -O0 or -O1 */
+static struct list  peep_list;       /* instructions removed by the peephole */
+static int          format = OUT_AMIF;  /* output format (out.h) */
+static int          jobs = 0;        /* encoding threads, 0 for one per cpu */
+static int          timing = 0;      /* -t, time the phases of the run */
+static int          nphases = 0;
+static char*        phase_name[PHASES];
+static double       phase_ms[PHASES];
+static double       phase_start;     /* end of the phase before, ms */
+
+/* Helper function declarations */
+void* emalloc(size_t n);                            // defined in linkedlist.c
+
+/* API functions*/
+FILE*        get_fp()         { return fp_w; }
+int          get_address()    { return address; }
+void         update_address(int new_address) { address = new_address; }
+int          get_optimize()   { return optimize; }
+void         set_optimize(int level) { optimize = level; }
+void         set_format(int fmt)      { format = fmt; }
+int          annotating()     { return format == OUT_AMIF; }
+void         set_jobs(int n)          { jobs = n; }
+
+/* mif related function declarations */
+char*        mif_header();
+static char* line_string();
+char*        gen_mifstr(int, char*);
+void         write_mif(int, int, char*, FILE*);
+void         write_byte(int, int, char*, char*, FILE*);
+static void  flush_byte();
+void         mif_asm_gen_message(int, int);    
+void         mif_pseudo_message();
+void         mif_blank_message();
+void         mif_label_message(int);
+void         peep_message(int, int);
+
+
+/* helper to tell if st starts on a word: a label, an instruction, .word or .half.
+   .byte, .ascii and .asciiz pack after the byte before them */
+static int word_aligned(struct stmt* st)
+{
+    if (st->kind == ST_DIRECTIVE)
+        return (st->label && st->dir != DIR_EQU) || st->dir == DIR_WORD || st->dir == DIR_HALF;
+    return st->label || st->kind == ST_INSTR || st->kind == ST_WORD;
+}
+
+/* helper to run the directive of st (directives.c) */
+static int directive(struct stmt* st, FILE* fp)
+{
+    if (st->kind != ST_DIRECTIVE) return -1;
+    return run_directive(st, address, fp);
+}
+
+/*
+  name:    build_labels
+  purpose: relax one statement, nothing is written to mif file
+  field:   st       - one lexed line of assembly code (ir.c)
+
+  program flow:
+      1) counts number of label used, and define labels in the symbol table (symtab.c)
+      2) if it's directive (directives.c), call the handler function
+      3) if it's instruction, call the encode function
+      4) encoded instruction is returned but don't write to mif file
+ */
+void build_labels(struct stmt* st)
+{
+    relax_line();               // reset every line read
+    scratch_reset();            // strings of the last line (arena.c)
+    if (address & 1 && word_aligned(st))
+        address++;              // pad after an odd count of bytes
+
+    if (st->label) {
+        int label_address = label_value(st, address);
+        // .equ with a constant never moves with autogen, .equ $ + 4 does
+        int reloc = st->dir != DIR_EQU || relax_deps();
+        sym_define(sym_get(st->sym)->str, label_address, reloc);
+        relax_line();
+        at_forget();            // a label starts a basic block
+    }
+    int new_addr = directive(st, NULL);
+    if (new_addr != -1) {
+        address = new_addr;     // update address
+        at_forget();
+    }
+    if (st->kind == ST_INSTR) {
+        int instr = encode(&st->ops);  // encoder.c
+        if (instr != EXPANDED) {  // an expansion moved the address already
+            address += 2;       // 1 instruction word is 2 byte
+            at_track(instr);
+        }
+    }
+    if (st->kind == ST_WORD) {  // encoded by parser -c
+        at_word(st->word);      // a branch is recorded at its address
+        address += 2;
+    }
+}
+
+/*
+  name:    endoce_line
+  purpose: encode one statement, then writes to mif file
+  field:   st       - one lexed line of assembly code (ir.c)
+           elp      - pointer to error_list
+           fp_write - file pointer to write
+
+  flow:
+      1) if directive (directives.c), call the handler function
+      2) if instruction, call the encode function
+      3) encoded instruction is returned and writes to mif file
+      4) syntax error, or no label, no directive, no instruction means wrong format
+ */
+void encode_line(struct stmt* st, struct list* elp, FILE* fp_write)
+{
+    char* line = strip(st->text);
+    relax_line();               // reset every line read
+    scratch_reset();            // strings of the last line (arena.c)
+    lineno = st->line;
+    cur = st;
+    if (word_aligned(st))
+        flush_byte();           // its word is not shared
+    if (address & 1 && word_aligned(st))
+        address++;              // as on the 1st path
+    int new_addr = directive(st, fp_write);
+    if (new_addr != -1) {    
+        address = new_addr;     // update address
+    }    
+    if (st->kind == ST_INSTR) {
+        int instr = encode(&st->ops);  // encoder.c
+        if (instr != EXPANDED) {  // an expansion is written already
+            write_mif(address, instr, annotating() ? line_string() : NULL, fp_write);
+            address += 2;       // 1 instruction word
+        }
+    }
+    if (st->kind == ST_WORD) {
+        write_mif(address, st->word, annotating() ? line_string() : NULL, fp_write);
+        address += 2;
+    }
+    if (st->kind == ST_ERROR) {
+        build_error_list(elp, concat2(st->error, line), st->line);
+    }
+    else if (!st->label && new_addr == -1 && st->kind != ST_INSTR && st->kind != ST_BLANK &&
+             st->kind != ST_WORD) {
+        build_error_list(elp, concat2("Wrong Format", line), st->line);
+    }
+
+    // DEBUG marking on mif file
+    if (st->label && new_addr == -1 && (st->kind == ST_LABEL || st->kind == ST_DIRECTIVE ||
+        st->kind == ST_UNKNOWN) &&
+        sym_at(address) != NULL) {
+        mif_label_message(address);
+    }
+}
+
+/* helper to report assemble result */
+void asm_report(int lines, struct list* elp)
+{
+    printf("%-4s\t: %d\n\n", "LINES READ", lines);
+
+    // autogen report
+    int sites, bytes, saved;
+    autogen_stats(&sites, &bytes, &saved);
+    if (sites > 0)
+        printf("%-4s\t: %d sites, %d bytes, %d bytes saved\n\n", "AUTOGEN", sites, bytes, saved);
+    strip_report();  // strip.c, if it ran
+    layout_report(); // layout.c, if it ran
+
+    // peephole report
+    if (peep_list.next != NULL) {
+        printf("[-- PEEPHOLE REPORT --]\n");
+        dumplist(&peep_list, "line", 'd');  // decimal
+        freelist(&peep_list);
+    }
+    // labels report 
+    if (sym_count() > 0) {
+        printf("[-- LABEL LIST REPORT --]\n");
+        dump_symtab("address");         // hex
+    }
+    // error report 
+    if (elp->next != NULL) {
+        printf("[-- ERROR LIST REPORT --]\n");
+        dumplist(elp, "line", 'd');    // decimal
+        freelist(elp);
+    }    
+}
+
+/* helper to encode one statement, or mark a DEBUG line */
+static void encode_stmt(struct stmt* st, struct list* elp, FILE* fp)
+{
+    // DEBUG marking on mif file
+    if (strstr(st->text, "DEBUG")) {
+        if (annotating()) fprintf(fp, "%s%s\n\n", "\n\t-- ", st->text);
+        return;
+    }
+    encode_line(st, elp, fp);
+}
+
+/* helper to cut lines into chunks for the threads. return the count, 0 for one thread */
+static int plan_chunks(int lines, struct chunk** chunks)
+{
+    int threads = jobs > 0 ? jobs : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int i, n = lines / CHUNK_LINES;
+    if (n > threads * CHUNKS) n = threads * CHUNKS;
+    if (threads < 2 || n < 2)
+        return 0;
+    *chunks = emalloc(n * sizeof(struct chunk));
+    memset(*chunks, 0, n * sizeof(struct chunk));
+    for (i = 0; i < n; i++) {
+        (*chunks)[i].first = (long) lines * i / n;
+        (*chunks)[i].end = (long) lines * (i + 1) / n;
+    }
+    return n;
+}
+
+/* helper to keep a word of the chunk for the merge */
+static void chunk_word(int addr, int value)
+{
+    if (chunk->nwords == chunk->maxwords) {
+        chunk->maxwords = chunk->maxwords ? chunk->maxwords * 2 : 1024;
+        if ((chunk->words = realloc(chunk->words, chunk->maxwords * sizeof(int))) == NULL)
+            oops("realloc");
+    }
+    chunk->words[chunk->nwords++] = addr;
+    chunk->words[chunk->nwords++] = value;
+}
+
+/* helper to encode the statements of c on this thread */
+static void encode_chunk(struct chunk* c, FILE* fp_write)
+{
+    int i;
+    init_list(&c->errors, NULL);
+    init_list(&c->peeps, NULL);
+    fp_w = annotating() ? open_memstream(&c->text, &c->len) : fp_write;
+    if (!fp_w) oops("open_memstream")
+    address = c->addr;
+    relax_seek(c->item);  // relax.c
+    peeps = &c->peeps;
+    chunk = c;
+    for (i = c->first; i < c->end; i++)
+        encode_stmt(ir_get(i), &c->errors, fp_w);
+    c->next = address;
+    flush_byte();
+    if (annotating()) fclose(fp_w);
+    fp_w = NULL;
+    chunk = NULL;
+}
+
+/* thread: encode chunks until none is left, then add the statistics */
+static void* encode_chunks(void* arg)
+{
+    struct pool* p = arg;
+    int sites, bytes, saved;
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        int k = p->taken++;
+        pthread_mutex_unlock(&p->lock);
+        if (k >= p->n) break;
+        encode_chunk(&p->chunks[k], p->fp);
+    }
+    autogen_stats(&sites, &bytes, &saved);  // encoder.c, of this thread
+    pthread_mutex_lock(&p->lock);
+    p->sites += sites;
+    p->bytes += bytes;
+    p->saved += saved;
+    arena_merge(p->keep, keep_arena());  // chunk lists outlive the thread
+    pthread_mutex_unlock(&p->lock);
+    arena_free(scratch_arena());
+    return NULL;
+}
+
+/* helper to move the lines of src to the end of dst */
+static void append_list(struct list* dst, struct list* src)
+{
+    while (dst->next != NULL) dst = dst->next;
+    dst->next = src->next;
+    src->next = NULL;
+}
+
+/* helper to free what the chunks kept */
+static void free_chunks(struct chunk* chunks, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        freelist(&chunks[i].errors);
+        freelist(&chunks[i].peeps);
+        free(chunks[i].words);
+        free(chunks[i].text);
+    }
+    free(chunks);
+}
+
+/*
+  name:    encode_parallel
+  purpose: 2nd path on threads, one chunk of statements at a time
+  field:   chunks, n - chunks planned before the 1st path
+           end       - 1st path address after the last statement
+           elp       - error list to merge the chunk errors into
+           fp_write  - output file
+  return:  1 if encoded, 0 if a chunk did not end where the next one starts,
+           an annotated word has bytes of two chunks or the source stops on an error. nothing is written then and the
+           caller encodes on one thread, which reports the error of the first line
+
+  flow:
+    1) move every chunk start by the shift relax.c put in front of it
+    2) threads encode the chunks, keeping words, text and errors aside
+    3) merge them in chunk order, as one thread would have written them
+ */
+static int encode_parallel(struct chunk* chunks, int n, int end, struct list* elp, FILE* fp_write)
+{
+    struct pool p = { chunks, n, 0, fp_write, keep_arena(), 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+    int threads = jobs > 0 ? jobs : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int i, j, ok = 1;
+    if (threads > n) threads = n;
+
+    for (i = 0; i < n; i++) {
+        chunks[i].addr += relax_shift(chunks[i].item);  // relax.c
+        if (!out_inside(chunks[i].addr)) ok = 0;        // code past the end of memory
+    }
+    end += relax_shift(relax_items());
+    if (end > 0 && !out_inside(end - 2)) ok = 0;
+    if (sym_undefined() > 0) ok = 0;                    // undefined label
+    if (!ok) {
+        free_chunks(chunks, n);
+        return 0;
+    }
+    synth_len(0);  // synth.c tables are built before the threads read them
+    pthread_t* tid = emalloc(threads * sizeof(pthread_t));
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&tid[i], NULL, encode_chunks, &p) != 0)
+            oops("pthread_create");
+    }
+    for (i = 0; i < threads; i++)
+        pthread_join(tid[i], NULL);
+    free(tid);
+
+    for (i = 0; i < n; i++) {
+        if (chunks[i].split || (i + 1 < n && chunks[i].next != chunks[i + 1].addr)) ok = 0;
+    }
+    if (!ok) {
+        free_chunks(chunks, n);
+        return 0;
+    }
+    for (i = 0; i < n; i++) {
+        struct chunk* c = &chunks[i];
+        if (c->len) fwrite(c->text, 1, c->len, fp_write);
+        for (j = 0; j < c->nwords; j += 2) {
+            if (c->words[j + 1] & CHUNK_BYTE)
+                out_byte(c->words[j], c->words[j + 1] & 0xff);  // out.c
+            else
+                out_word(c->words[j], c->words[j + 1] & 0xffff);
+        }
+        append_list(elp, &c->errors);
+        append_list(&peep_list, &c->peeps);
+    }
+    address = chunks[n - 1].next;
+    autogen_merge(p.sites, p.bytes, p.saved);  // encoder.c
+    free_chunks(chunks, n);
+    return 1;
+}
+
+/* 
+  name:    assemble
+  purpose: walk the statements (ir.c) two times to assemble mif file.
+           labels of the statements are already in the symbol table
+  field:   mif         - mif file to write
+
+  flow:
+    1st path:  build_labels - define symbols if label found
+    2nd path:  encode_line  - add error_list if format error found,
+               on threads when the source is large (encode_parallel)
+    reports:   label list and error list    
+*/
+void assemble(char* mif)
+{
+    // init lists
+    struct list error_list;
+    relax_init();                    // label dependent instructions
+    init_list(&error_list, NULL);    // no sorted, keep everything
+    init_list(&peep_list, NULL);     // in line order
+    at_forget();                     // $at is unknown at the start
+    address = 0;
+    held = -1;
+    fp_w = NULL;
+    peeps = &peep_list;
+
+    struct chunk* chunks = NULL;
+    int i, c = 0, lines = ir_count();
+    int nchunks = plan_chunks(lines, &chunks);
+    FILE* fp_write = fopen(mif, format == OUT_BIN ? "wb" : "w");
+    if (!fp_write) oops("fopen failed..")
+    setvbuf(fp_write, NULL, _IOFBF, 1 << 16);
+    if (timing) {
+        synth_len(0);  // synth.c searches once on first use, timed on its own
+        time_phase("synth");
+    }
+
+    // 1st path to generate simbol table
+    for (i = 0; i < lines; i++) {
+        if (c < nchunks && chunks[c].first == i) {
+            chunks[c].addr = address;         // where the chunk starts
+            chunks[c++].item = relax_items();
+        }
+        build_labels(ir_get(i));
+    }
+
+    time_phase("1st path");
+
+    // prepare for 2nd path
+    int end = address;
+    address = 0;       // location counter reset 
+    fp_w = fp_write;   // static fp set. fp_w is null while 1st path
+    addr_resolution();  // relax.c
+    time_phase("relax");
+    out_clear();
+
+    // 2nd path to encode and make error list
+    if (annotating())
+        fprintf(fp_write, "%s\n", mif_header());
+    if (nchunks == 0 || !encode_parallel(chunks, nchunks, end, &error_list, fp_write)) {
+        for (i = 0; i < lines; i++)
+            encode_stmt(ir_get(i), &error_list, fp_write);
+        flush_byte();
+    }
+    if (annotating())
+        fprintf(fp_write, "%s\n", "END;");
+    else
+        out_write(fp_write, format, mif_header());  // out.c
+    time_phase("2nd path");
+
+    asm_report(lines, &error_list);
+    fclose(fp_write);        
+    time_phase("report");
+    fp_w = NULL;
+    cur = NULL;
+    relax_free();
+}
+
+/*
+  name:    place_statements
+  purpose: 1st path and addr_resolution only, nothing written, to find
+           where every statement lands (layout.c)
+  field:   addr - address of every statement, ir_count() + 1 slots with the
+                  end last. a statement that pads starts one byte later
+*/
+void place_statements(int* addr)
+{
+    int i, lines = ir_count();
+    int* item = emalloc((lines + 1) * sizeof(int));
+    relax_init();
+    at_forget();
+    address = 0;
+    fp_w = NULL;
+    for (i = 0; i < lines; i++) {
+        addr[i] = address;
+        item[i] = relax_items();
+        build_labels(ir_get(i));
+    }
+    addr[lines] = address;
+    item[lines] = relax_items();
+    addr_resolution();  // relax.c
+    for (i = 0; i <= lines; i++)
+        addr[i] += relax_shift(item[i]);
+    free(item);
+    relax_free();
+}
+
+
+/* helper to read the monotonic clock in ms */
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*
+  name:    set_timing
+  purpose: -t, start timing the phases of the run from now
+  field:   on - 1 to time, 0 for none
+*/
+void set_timing(int on)
+{
+    timing = on;
+    nphases = 0;
+    phase_start = now_ms();
+}
+
+/*
+  name:    time_phase
+  purpose: end the phase running since the last call, or set_timing
+  field:   name - phase that ended
+*/
+void time_phase(char* name)
+{
+    if (!timing || nphases == PHASES) return;
+    double t = now_ms();
+    phase_name[nphases] = name;
+    phase_ms[nphases++] = t - phase_start;
+    phase_start = t;
+}
+
+/* report the phases timed, one line bench.c reads */
+void time_report()
+{
+    int i;
+    if (!timing) return;
+    printf("%-4s\t:", "TIME");
+    for (i = 0; i < nphases; i++)
+        printf(" %s %.3f ms%s", phase_name[i], phase_ms[i], i < nphases - 1 ? "," : "");
+    printf("\n\n");
+}
+
+
+/**
+ * Memory Initialization File related functions
+ * http://sites.fas.harvard.edu/~cscie287/fall2017/def_mif.htm
+ */
+
+/* return mif header */
+char* mif_header()
+{
+    char* header = "DEPTH = 32768;\nWIDTH = 16;\n\
+ADDRESS_RADIX = HEX;\nDATA_RADIX = HEX;\nCONTENT\nBEGIN";
+    return header;
+}
+
+/* generate output filename, filename with its extension replaced by ext */
+char* outname(char* filename, char* ext)
+{
+    char* p = strrchr(filename, '.');
+    int len = p ? p - filename : (int) strlen(filename);
+    return arena_printf(keep_arena(), "%.*s.%s", len, filename, ext);
+}
+
+/* helper to return the line on 2nd path with its line number, made when asked */
+static char* line_string()
+{
+    if (cur == NULL) return "";
+    return arena_printf(scratch_arena(), "%d: %s", cur->line, strip(cur->text));
+}
+
+/* helper to generate string for mif file from instruction value and original string */
+char* gen_mifstr(int value, char* str)
+{
+    return arena_printf(scratch_arena(), "%04x;    --   [%s] -> [%s]", value, int_to_bin(value), trimmed(str, '\n'));
+}
+
+/* helper to write the annotated mif line of the word at address */
+static void mif_line(int address, int value, char* str, FILE* fp)
+{
+    char* instruction = gen_mifstr(value, str); 
+    fprintf(fp, "\t%04x : %s\n", address/2, instruction); // convert byte address to mif word address
+    if (DEBUG) printf("\t%04x : %s\n", address/2, instruction);
+}
+
+/* helper to write the line of a held byte alone, its odd byte never came */
+static void flush_byte()
+{
+    if (held < 0) return;
+    mif_line(held, chunk ? held_value : out_read(held), held_text, fp_w);  // out.c
+    held = -1;
+}
+
+/* API to store a word in the image, and write it with str when annotating */
+void write_mif(int address, int value, char* str, FILE* fp)
+{
+    if (!out_inside(address))  // out.c
+        oops2("address outside memory", int_to_str(address))
+    if (chunk)
+        chunk_word(address, value);  // stored in chunk order
+    else
+        out_word(address, value & 0xffff);
+    if (!annotating()) return;
+    flush_byte();
+    mif_line(address, value, str, fp);
+}
+
+/*
+  name:    write_byte
+  purpose: store a byte of data in the image. when annotating, the line of
+           its word is written with the bytes of both halves, once the odd
+           one comes or something else is written
+  field:   address    - byte address, the low byte of a word if even
+           value      - byte, the low 8 bits
+           head, item - the line is "head: item item"
+           fp         - mif file
+*/
+void write_byte(int address, int value, char* head, char* item, FILE* fp)
+{
+    if (!out_inside(address))  // out.c
+        oops2("address outside memory", int_to_str(address))
+    if (chunk)
+        chunk_word(address, (value & 0xff) | CHUNK_BYTE);
+    else
+        out_byte(address, value);
+    if (!annotating()) return;
+    if (held >= 0 && held != address - 1)
+        flush_byte();
+    if (address % 2 == 0) {
+        held = address;
+        held_value = value & 0xff;
+        snprintf(held_text, sizeof held_text, "%s: %s", head, item);
+    }
+    else if (held >= 0) {
+        mif_line(held, held_value | (value & 0xff) << 8,
+                 arena_printf(scratch_arena(), "%s %s", held_text, item), fp);
+        held = -1;
+    }
+    else {
+        if (chunk) chunk->split = 1;  // the low byte is in the chunk before, one thread redoes it
+        mif_line(address - 1, out_read(address), arena_printf(scratch_arena(), "%s: %s", head, item), fp);
+    }
+}
+
+/* API to write assembler message for automatic generation */
+void mif_asm_gen_message(int bitlen, int num)
+{
+    if (fp_w && annotating()) fprintf(fp_w, "%20s--   auto-gen (0x%x > %dbits) <- [%s]\n", "", num, bitlen, trimmed(line_string(), '\n'));
+}
+
+/* API to write assembler message for a pseudo-instruction */
+void mif_pseudo_message()
+{
+    if (fp_w && annotating()) fprintf(fp_w, "%20s--   pseudo <- [%s]\n", "", trimmed(line_string(), '\n'));
+}
+
+/* API to write assembler message for label */
+void mif_label_message(int addr)
+{
+    if (fp_w && annotating()) fprintf(fp_w, "%20s--   %s: %04x <- [%s]\n", "", "label", addr/2, trimmed(line_string(), '\n'));
+}
+
+/* API to record and write the instructions removed by the peephole */
+void peep_message(int removed, int num)
+{
+    char* str = arena_printf(scratch_arena(), "$at is 0x%04x, %d removed <- [%s]", num & 0xffff, removed, trimmed(line_string(), '\n'));
+    build_error_list(peeps, str, lineno);
+    if (fp_w && annotating()) fprintf(fp_w, "%20s--   peephole: %s\n", "", str);
+}
+
+/* API to write blank line */
+void mif_blank_message()
+{
+    if (fp_w && annotating()) fprintf(fp_w, "\n");
+}
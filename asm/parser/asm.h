@@ -0,0 +1,18 @@
+/*
+ * asm.h -- two passes over the statement list into a mif file
+ */
+
+#ifndef ASM_INCL
+#define ASM_INCL
+
+void  assemble(char* mif);
+void  place_statements(int* addr);
+char* outname(char* filename, char* ext);
+void  set_optimize(int level);
+void  set_format(int format);
+void  set_jobs(int n);
+void  set_timing(int on);
+void  time_phase(char* name);
+void  time_report();
+
+#endif /* ASM_INCL */
@@ -0,0 +1,336 @@
+/*
+ * bench.c -- synthetic sources and how the assembler scales with them, make bench-asm
+ *
+ * Usage: ./bench -g [-n labels] [-r refs] [-f far%] [-w words] [-s seed]
+ *        ./bench [-f far%] [-x slope] [-k runs] [-e parser] [labels ...]
+ *
+ *    -g   write a synthetic source to stdout: n labels of code (1000), r forward
+ *         references to them (n), f percent of the references far enough
+ *         to autogen (10), and a .word table of w words (n), cut so the
+ *         program fits the 32768 words of memory even if every far
+ *         reference takes the longest autogen encoder.c has
+ *    -x   fail when a phase grows faster than lines^x (1.3)
+ *    -k   runs of every size, the fastest is kept (5)
+ *    -e   assembler to time (./parser)
+ *
+ * Without -g, a source is written for every size (500 1000 2000 4000 8000
+ * labels by default, as many references and table words as labels),
+ * assembled by parser -t -j 1 and the time of every phase read from its
+ * TIME line (asm.c). The runs go over the sizes in turn, so a slow spell
+ * of the machine does not land on one size alone. The first size is the
+ * baseline: its time, the fixed cost of a phase such as the synth.c
+ * search, is taken off the others, and the slope of log time over log
+ * lines is fitted to what is left by least squares. 1 is linear, 2 is quadratic. bench exits 1 when a slope
+ * is above -x, or a source does not assemble cleanly. Phases that grow by
+ * less than MIN_MS, or by less than their own baseline over all the sizes,
+ * are too short to fit and only reported: what is left of a fixed cost
+ * such as the synth.c search is jitter.
+ *
+ * A near reference is a BNE over the words up to the next label, which fits
+ * while a label has fewer than 8 of them; a far one alternates J and ORI to
+ * a label further on. Every table line takes a label back, so the
+ * .word operands resolve through the symbol table as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "decoder.h"
+#include "common.h"
+
+#define WORDS    32768   // memory depth in 16 bit words (out.c)
+#define PER_LINE 8       // .word values on a table line
+#define PHASES   10      // phases the TIME line holds (asm.c)
+#define SIZES    16
+#define MIN_MS   2.0     // shortest phase worth a slope
+
+/*
+  name:    phase
+  purpose: fastest time of one phase at every size
+  field:   name - as the TIME line has it
+           ms   - fastest of the runs, one per size
+*/
+struct phase {
+    char   name[32];
+    double ms[SIZES];
+};
+
+extern int opfunc_to_increase(int opfunc);         // defined in encoder.c
+
+/* file scope variables */
+static unsigned int seed = 1;    /* generator state, the same source for the same options */
+static struct phase phases[PHASES];
+static int          nphases = 0;
+
+
+/**
+* Helper Functions
+*/
+
+/* next pseudo random number, xorshift so every platform writes the same source */
+static unsigned int next()
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/* most words J or ORI can take, the instruction and its autogen (encoder.c) */
+static int far_words()
+{
+    int j = opfunc_to_increase(opstr_to_opfunc("J"));
+    int ori = opfunc_to_increase(opstr_to_opfunc("ORI"));
+    return (j > ori ? j : ori) / 2 + 1;
+}
+
+/*
+  name:    generate
+  purpose: write a synthetic source
+  field:   fp    - where to write
+           n     - labels of code, L0 .. Ln-1
+           r     - forward references, spread over the labels
+           far   - percent of them that autogen
+           words - .word table after the code
+*/
+static void generate(FILE* fp, int n, int r, int far, int words)
+{
+    int i, k, code, far_max = far_words();
+    if (n < 1) n = 1;
+    code = 4 + n;
+
+    // far references autogen, near ones are one word
+    fprintf(fp, "# bench.c: %d labels, %d forward references, %d%% far, %d table words\n\n", n, r, far, words);
+    fprintf(fp, "main:\n    ANDI  $rb, 0\n    ANDI  $rc, 0\n");
+    for (i = 0; i < n; i++) {
+        int first = (int) ((long) i * r / n), end = (int) ((long) (i + 1) * r / n);
+        int near = 0;
+        fprintf(fp, "L%d:\n    ADDI  $rb, 1\n", i);
+        for (k = first; k < end; k++) {
+            if ((int) (next() % 100) >= far) {
+                near++;      // after the far ones, so BNE reaches the next label
+                continue;
+            }
+            int to = i + 1 + (int) (next() % (n - i));
+            fprintf(fp, "    %s L%d\n", k & 1 ? "ORI   $rc," : "J    ", to);
+            code += far_max;
+        }
+        for (k = 0; k < near; k++)
+            fprintf(fp, "    BNE   $rb, $rc, (L%d - $) / 2\n", i + 1);
+        code += near;
+    }
+    fprintf(fp, "L%d:\n    ANDI  $rb, 0\n    SYS   $rb, 0\n", n);
+
+    // the table takes what memory is left
+    if (code > WORDS)
+        fprintf(stderr, "bench: the code may take %d words, more than memory\n", code);
+    else if (words > WORDS - code)
+        fprintf(stderr, "bench: table cut to %d words, the code may take %d\n", WORDS - code, code);
+    if (words > WORDS - code)
+        words = code > WORDS ? 0 : WORDS - code;
+    fprintf(fp, "\ntable:\n");
+    for (i = 0; i < words; i += PER_LINE) {
+        fprintf(fp, "    .word L%d", (int) (next() % n));
+        for (k = 1; k < PER_LINE && i + k < words; k++)
+            fprintf(fp, ", %d", (int) (next() & 0xffff));
+        fprintf(fp, "\n");
+    }
+}
+
+/* index of phase name, added when first seen. -1 when full */
+static int phase_of(char* name)
+{
+    int i;
+    for (i = 0; i < nphases; i++)
+        if (strcmp(phases[i].name, name) == 0)
+            return i;
+    if (nphases == PHASES)
+        return -1;
+    snprintf(phases[nphases].name, sizeof phases[nphases].name, "%s", name);
+    for (i = 0; i < SIZES; i++)
+        phases[nphases].ms[i] = -1;
+    return nphases++;
+}
+
+/* read the phases of a TIME line: " lex 1.234 ms, 1st path 5.678 ms" */
+static void read_times(char* line, int size)
+{
+    char* item;
+    for (item = strtok(line, ","); item != NULL; item = strtok(NULL, ",")) {
+        char* ms = strstr(item, " ms");
+        if (ms == NULL) continue;
+        *ms = '\0';
+        char* num = strrchr(item, ' ');  // name and time split at the last space
+        if (num == NULL) continue;
+        *num++ = '\0';
+        while (*item == ' ') item++;
+        int p = phase_of(item);
+        double t = atof(num);
+        if (p >= 0 && (phases[p].ms[size] < 0 || t < phases[p].ms[size]))
+            phases[p].ms[size] = t;
+    }
+}
+
+/*
+  name:    assemble_once
+  purpose: run the assembler over a source, keep the fastest phase times
+  field:   parser - assembler to run
+           src    - source file
+           size   - index of the size
+  return:  lines the assembler read, -1 if it failed
+*/
+static int assemble_once(char* parser, char* src, int size)
+{
+    char cmd[STRLEN * 2], line[STRLEN * 4];
+    int lines = -1, errors = 0;
+    snprintf(cmd, sizeof cmd, "%s -t -j 1 %s", parser, src);
+    FILE* pp = popen(cmd, "r");
+    if (!pp) oops("popen failed..")
+    while (fgets(line, sizeof line, pp)) {
+        if (strncmp(line, "LINES READ\t:", 12) == 0)
+            lines = atoi(line + 12);
+        else if (strncmp(line, "TIME\t:", 6) == 0)
+            read_times(line + 6, size);
+        else if (strstr(line, "ERROR LIST REPORT"))
+            errors = 1;
+    }
+    if (pclose(pp) != 0 || errors)
+        return -1;
+    return lines;
+}
+
+/* least squares slope of log ms over log lines above the baseline, size 0.
+   the phase grows as lines^slope */
+static double slope(double* ms, int* lines, int n)
+{
+    int i;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (i = 1; i < n; i++) {
+        double d = ms[i] - ms[0];
+        double x = log(lines[i] - lines[0]), y = log(d > 0.001 ? d : 0.001);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    n--;
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+/*
+  name:    bench
+  purpose: time the assembler over every size and fit the phases
+  field:   parser - assembler to run
+           sizes  - labels of every source, n of them, the baseline first
+           far    - percent of far references
+           runs   - runs of every size
+           limit  - largest slope that passes
+  return:  0 if every phase scales, 1 if not
+*/
+static int bench(char* parser, int* sizes, int n, int far, int runs, double limit)
+{
+    int i, k, p, lines[SIZES], failed = 0;
+    unsigned int first = seed;
+    char src[STRLEN], out[STRLEN];
+
+    printf("%-4s\t: %s -t -j 1, %d sizes, fastest of %d runs\n\n", "BENCH", parser, n, runs);
+    for (i = 0; i < n; i++) {
+        snprintf(src, sizeof src, "bench_%d.txt", sizes[i]);
+        FILE* fp = fopen(src, "w");
+        if (!fp) oops("fopen failed..")
+        seed = first;
+        generate(fp, sizes[i], sizes[i], far, sizes[i]);
+        fclose(fp);
+    }
+    for (k = 0; k < runs; k++) {  // every size in turn
+        for (i = 0; i < n; i++) {
+            snprintf(src, sizeof src, "bench_%d.txt", sizes[i]);
+            if ((lines[i] = assemble_once(parser, src, i)) < 0)
+                oops2("does not assemble cleanly", src)
+        }
+    }
+    for (i = 0; i < n; i++) {
+        snprintf(src, sizeof src, "bench_%d.txt", sizes[i]);
+        snprintf(out, sizeof out, "bench_%d.mif", sizes[i]);
+        remove(src);
+        remove(out);
+    }
+
+    // one row for every size, one column for every phase
+    printf("%-8s%-8s", "labels", "lines");
+    for (p = 0; p < nphases; p++)
+        printf("%12s", phases[p].name);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+        printf("%-8d%-8d", sizes[i], lines[i]);
+        for (p = 0; p < nphases; p++)
+            printf("%12.3f", phases[p].ms[i]);
+        printf("\n");
+    }
+
+    printf("\n%-4s\t: lines^x above %d labels, above %.2f fails\n", "SLOPE", sizes[0], limit);
+    for (p = 0; p < nphases; p++) {
+        double x = slope(phases[p].ms, lines, n);
+        double grew = phases[p].ms[n - 1] - phases[p].ms[0];
+        if (grew < MIN_MS || grew < phases[p].ms[0])
+            printf("%-12s%6.2f  too short to fit, %.3f ms more\n", phases[p].name, x, grew);
+        else if (x > limit) {
+            printf("%-12s%6.2f  SUPER-LINEAR\n", phases[p].name, x);
+            failed = 1;
+        }
+        else
+            printf("%-12s%6.2f\n", phases[p].name, x);
+    }
+    printf("\n%s\n", failed ? "FAILED" : "PASSED");
+    return failed;
+}
+
+
+/**
+* Start function
+*/
+int main(int ac, char* av[])
+{
+    int i, k, gen = 0, n = 1000, r = -1, far = 10, words = -1, runs = 5;
+    int sizes[SIZES] = { 500, 1000, 2000, 4000, 8000 }, nsizes = 5;
+    double limit = 1.3;
+    char* parser = "./parser";
+    for (i = 1; i < ac && av[i][0] == '-'; i++) {
+        if (strcmp(av[i], "-g") == 0)
+            gen = 1;
+        else if (strcmp(av[i], "-n") == 0 && i + 1 < ac)
+            n = atoi(av[++i]);
+        else if (strcmp(av[i], "-r") == 0 && i + 1 < ac)
+            r = atoi(av[++i]);
+        else if (strcmp(av[i], "-f") == 0 && i + 1 < ac)
+            far = atoi(av[++i]);
+        else if (strcmp(av[i], "-w") == 0 && i + 1 < ac)
+            words = atoi(av[++i]);
+        else if (strcmp(av[i], "-s") == 0 && i + 1 < ac)
+            seed = (unsigned int) atoi(av[++i]) | 1;
+        else if (strcmp(av[i], "-x") == 0 && i + 1 < ac)
+            limit = atof(av[++i]);
+        else if (strcmp(av[i], "-k") == 0 && i + 1 < ac)
+            runs = atoi(av[++i]);
+        else if (strcmp(av[i], "-e") == 0 && i + 1 < ac)
+            parser = av[++i];
+        else
+            break;
+    }
+    if (gen && i < ac)
+        oops("Usage: ./bench -g [-n labels] [-r refs] [-f far%] [-w words] [-s seed] > file.txt\t")
+    if (gen) {
+        generate(stdout, n, r < 0 ? n : r, far, words < 0 ? n : words);
+        return 0;
+    }
+
+    if (i < ac)
+        for (nsizes = 0; i < ac && nsizes < SIZES; i++)
+            sizes[nsizes++] = atoi(av[i]);
+    for (k = 1; k < nsizes; k++)
+        if (sizes[k] <= sizes[k - 1]) nsizes = 0;
+    if (nsizes < 3 || runs < 1)
+        oops("Usage: ./bench [-f far%] [-x slope] [-k runs] [-e parser] labels labels labels ... (growing)\t")
+    return bench(parser, sizes, nsizes, far, runs, limit);
+}
@@ -0,0 +1,323 @@
+/*
+ * cache.c -- content addressed cache of assembled output
+ *
+ * parser --cache <dir> looks up the output of a source file by a 64 bit
+ * FNV-1a key over the assembler version, the options, the module name
+ * and every byte of the source. An entry is three files in the directory:
+ *
+ *     <key>.out     everything the run printed (reports, label list)
+ *     <key>.<ext>   the file it wrote, mif or obj
+ *     <key>.dep     hash and path of every file .include read
+ *
+ * Included files are only known once the source is read, so they are
+ * checked against <key>.dep on a lookup instead of being in the key.
+ *
+ * A hit copies the output file and prints the report, so lexing,
+ * relaxation and encoding are skipped altogether. A miss assembles as
+ * usual with stdout captured, then stores both files. Files are written
+ * under a temporary name and renamed, so runs sharing a directory never
+ * read half an entry. A hit touches the entry; when the directory grows
+ * past its limit the least recently used files are removed first.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "common.h"
+
+#define KEYLEN      16      // hex digits of a key
+#define BUFSIZE     65536   // copy buffer
+
+/* file scope variables */
+static char*    cache_dir = NULL;   /* NULL if the cache is off */
+static long     cache_max = 0;      /* directory size limit in bytes */
+static char     key[KEYLEN + 1];    /* key of the current source */
+static int      saved_fd = -1;      /* stdout while it is captured */
+static FILE*    captured = NULL;    /* what the run printed */
+static char**   deps = NULL;        /* files included by the run */
+static int      ndeps = 0;
+
+
+/**
+* Helper Functions
+*/
+
+/* FNV-1a over n bytes */
+static uint64_t hash_bytes(uint64_t h, const void* data, size_t n)
+{
+    const unsigned char* p = data;
+    while (n--)
+        h = (h ^ *p++) * 0x100000001b3ull;
+    return h;
+}
+
+/* hash of the file at path into *h; -1 if it cannot be read */
+static int hash_file(char* path, uint64_t* h)
+{
+    static char buf[BUFSIZE];
+    size_t n;
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return -1;
+    while ((n = fread(buf, 1, sizeof buf, fp)) > 0)
+        *h = hash_bytes(*h, buf, n);
+    fclose(fp);
+    return 0;
+}
+
+/* return 1 if every file listed in dep still has its hash */
+static int deps_unchanged(char* dep)
+{
+    FILE* fp = fopen(dep, "r");
+    if (!fp) return 0;
+    char* line = NULL;
+    size_t len = 0;
+    int ok = 1;
+    while (ok && getline(&line, &len, fp) != -1) {
+        unsigned long long want;
+        char path[STRLEN * 4];
+        uint64_t h = 0xcbf29ce484222325ull;
+        ok = sscanf(line, "%llx %1023[^\n]", &want, path) == 2 &&
+             hash_file(path, &h) == 0 && h == want;
+    }
+    free(line);
+    fclose(fp);
+    return ok;
+}
+
+/* path of a cache file, key and extension */
+static char* entry_path(char* ext)
+{
+    static char path[STRLEN * 2];
+    snprintf(path, sizeof path, "%s/%s.%s", cache_dir, key, ext);
+    return path;
+}
+
+/* copy src to dst, -1 if either fails */
+static int copy_file(char* src, FILE* dst)
+{
+    FILE* in = fopen(src, "rb");
+    if (!in) return -1;
+    static char buf[BUFSIZE];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, in)) > 0)
+        fwrite(buf, 1, n, dst);
+    fclose(in);
+    return ferror(dst) ? -1 : 0;
+}
+
+/* copy src into the cache file ext, written aside and renamed */
+static void store_file(char* src, char* ext)
+{
+    char tmp[STRLEN * 2 + 32];  // entry_path and the suffix
+    if (snprintf(tmp, sizeof tmp, "%s.%d.tmp", entry_path(ext), (int) getpid()) >= (int) sizeof tmp)
+        return;       // too long a path is not cached
+    FILE* fp = fopen(tmp, "wb");
+    if (!fp) return;  // a cache that cannot be written is just off
+    int rv = copy_file(src, fp);
+    if (fclose(fp) != 0 || rv < 0 || rename(tmp, entry_path(ext)) < 0)
+        unlink(tmp);
+}
+
+/* return 1 if name is a cache file, <16 hex digits>.<ext> */
+static int is_entry(char* name)
+{
+    int i;
+    for (i = 0; i < KEYLEN; i++) {
+        if (!strchr("0123456789abcdef", name[i]) || name[i] == '\0')
+            return 0;
+    }
+    return name[KEYLEN] == '.' && strstr(name, ".tmp") == NULL;
+}
+
+/* cache file found while evicting */
+struct entry {
+    char   name[STRLEN];
+    time_t used;
+    long   size;
+};
+
+static int by_use(const void* a, const void* b)
+{
+    const struct entry* x = a;
+    const struct entry* y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+/* remove the least recently used files until the directory fits */
+static void evict()
+{
+    DIR* dir = opendir(cache_dir);
+    if (!dir) return;
+
+    struct entry* entries = NULL;
+    int n = 0, max = 0, i;
+    long total = 0;
+    struct dirent* d;
+    while ((d = readdir(dir)) != NULL) {
+        struct stat sb;
+        char path[STRLEN * 2];
+        if (!is_entry(d->d_name) || strlen(d->d_name) >= sizeof entries->name)
+            continue;
+        snprintf(path, sizeof path, "%s/%s", cache_dir, d->d_name);
+        if (stat(path, &sb) < 0)
+            continue;
+        if (n == max) {
+            max = max ? max * 2 : 64;
+            if ((entries = realloc(entries, max * sizeof(struct entry))) == NULL)
+                oops("realloc");
+        }
+        snprintf(entries[n].name, sizeof entries[n].name, "%s", d->d_name);
+        entries[n].used = sb.st_mtime;
+        entries[n].size = sb.st_size;
+        total += sb.st_size;
+        n++;
+    }
+    closedir(dir);
+
+    qsort(entries, n, sizeof(struct entry), by_use);
+    for (i = 0; i < n && total > cache_max; i++) {
+        char path[STRLEN * 2];
+        snprintf(path, sizeof path, "%s/%s", cache_dir, entries[i].name);
+        if (unlink(path) == 0)
+            total -= entries[i].size;
+    }
+    free(entries);
+}
+
+
+/**
+* Shared functions (cache.h)
+*/
+
+/* turn the cache on with directory dir, at most max bytes (0 for default) */
+void cache_init(char* dir, long max)
+{
+    cache_dir = dir;
+    cache_max = max > 0 ? max : CACHE_MAX;
+    mkdir(dir, 0777);  // may exist already
+}
+
+/*
+  name:    cache_lookup
+  purpose: key the source file with the options, and on a hit write the
+           cached output to out and print the cached report
+  field:   filename - source file
+           options  - version, options and module name, all that changes the output
+           out      - output file the run would write
+  return:  1 on a hit, 0 on a miss or when the cache is off
+*/
+int cache_lookup(char* filename, char* options, char* out)
+{
+    if (cache_dir == NULL) return 0;
+
+    uint64_t h = hash_bytes(0xcbf29ce484222325ull, options, strlen(options) + 1);
+    if (hash_file(filename, &h) < 0)
+        return 0;  // the assembler reports it
+    snprintf(key, sizeof key, "%016llx", (unsigned long long) h);
+
+    char* ext = strrchr(out, '.') + 1;
+    char data[STRLEN * 2];
+    snprintf(data, sizeof data, "%s", entry_path(ext));
+    if (access(data, R_OK) < 0 || access(entry_path("out"), R_OK) < 0 ||
+        !deps_unchanged(entry_path("dep")))
+        return 0;
+
+    FILE* fp_out = fopen(out, "wb");
+    if (!fp_out) oops("fopen failed..")
+    int rv = copy_file(data, fp_out);
+    fclose(fp_out);
+    if (rv < 0 || copy_file(entry_path("out"), stdout) < 0)
+        return 0;
+    utime(data, NULL);  // most recently used
+    utime(entry_path("out"), NULL);
+    utime(entry_path("dep"), NULL);
+    return 1;
+}
+
+/* record a file the run included, for <key>.dep */
+void cache_depend(char* path)
+{
+    if (cache_dir == NULL) return;
+    if ((deps = realloc(deps, (ndeps + 1) * sizeof(char*))) == NULL ||
+        (deps[ndeps++] = strdup(path)) == NULL)
+        oops("realloc");
+}
+
+/* helper to give stdout back when the run exits on an error (oops) */
+static void cache_abort()
+{
+    cache_store(NULL, 0);
+}
+
+/* capture stdout of a miss until cache_store */
+void cache_begin()
+{
+    static int registered = 0;
+    if (cache_dir == NULL || (captured = tmpfile()) == NULL) return;
+    if (!registered) atexit(cache_abort);
+    registered = 1;
+    fflush(stdout);
+    saved_fd = dup(STDOUT_FILENO);
+    dup2(fileno(captured), STDOUT_FILENO);
+}
+
+/*
+  name:    cache_store
+  purpose: print what the run captured and store it with out under the key.
+           nothing is stored when ok is 0, the run failed
+*/
+void cache_store(char* out, int ok)
+{
+    if (saved_fd < 0) return;
+    fflush(stdout);
+    dup2(saved_fd, STDOUT_FILENO);
+    close(saved_fd);
+    saved_fd = -1;
+
+    // replay the report, and keep it as <key>.out
+    char report[STRLEN * 2];
+    char dep[STRLEN * 2];
+    snprintf(report, sizeof report, "%s/%s.%d.tmp", cache_dir, key, (int) getpid());
+    snprintf(dep, sizeof dep, "%s/%s.%d.dep.tmp", cache_dir, key, (int) getpid());
+    FILE* fp = fopen(report, "wb");
+    static char buf[BUFSIZE];
+    size_t n;
+    int i;
+    rewind(captured);
+    while ((n = fread(buf, 1, sizeof buf, captured)) > 0) {
+        fwrite(buf, 1, n, stdout);
+        if (fp) fwrite(buf, 1, n, fp);
+    }
+    fclose(captured);
+    captured = NULL;
+
+    // included files with their hashes
+    FILE* fp_dep = fopen(dep, "w");
+    for (i = 0; fp_dep && i < ndeps; i++) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        if (hash_file(deps[i], &h) == 0)
+            fprintf(fp_dep, "%016llx %s\n", (unsigned long long) h, deps[i]);
+        else ok = 0;
+    }
+    int written = fp != NULL && fclose(fp) == 0;
+    written = fp_dep != NULL && fclose(fp_dep) == 0 && written;
+    if (written && ok) {
+        store_file(out, strrchr(out, '.') + 1);  // data before the report
+        store_file(dep, "dep");
+        store_file(report, "out");
+        evict();
+    }
+    unlink(report);
+    unlink(dep);
+    for (i = 0; i < ndeps; i++)
+        free(deps[i]);
+    free(deps);
+    deps = NULL;
+    ndeps = 0;
+}
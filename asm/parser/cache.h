@@ -0,0 +1,16 @@
+/*
+ * cache.h -- content addressed cache of assembled output
+ */
+
+#ifndef CACHE_INCL
+#define CACHE_INCL
+
+#define CACHE_MAX   (64L << 20)     // default directory limit, 64MB
+
+void  cache_init(char* dir, long max);
+int   cache_lookup(char* filename, char* options, char* out);
+void  cache_begin();
+void  cache_depend(char* path);
+void  cache_store(char* out, int ok);
+
+#endif /* CACHE_INCL */
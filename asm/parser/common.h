@@ -12,12 +12,18 @@
 #define px(x)   { if (DEBUG) printf("[%04x]\n",x); }  // print hex
 #define ps(x)   { if (DEBUG) printf("[%s]\n",  x); }  // print string
 #define ps2(x,y){ if (DEBUG) printf("[%s: %s]\n",x,y); } // two strings
-#define oops(x) { perror(x); exit(1); }                  // perror and exit
-#define oops2(x,y) { fprintf(stderr, "%s: [%s]\n",x,y); exit(1); } // two strings
+#define oops(x) { oops_lock(); perror(x); exit(1); }     // perror and exit
+#define oops2(x,y) { oops_lock(); fprintf(stderr, "%s: [%s]\n",x,y); exit(1); } // two strings
 #define STOP    { fflush(stdout); sleep(3); }
 #define pstop(x){ if (DEBUG) printf("%s: [%s]\n",__func__, x == NULL ? "null" : x); fflush(stdout); sleep(3); }
 
+void oops_lock();    // defined in strfunc.c, one thread exits
+
 /* Assembler constants definition */
+/* VERSION keys the cache (cache.c) and heads the map. Raise it whenever the
+   same source and options give other output, words, mif text or reports,
+   or a cached entry of the old output is taken for the new one */
+#define VERSION "min16-asm 1.0"
 #define STRLEN  256                                   // decode string length
 
 #endif /* COMMON_INCL */
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "common.h"
 #include "strfunc.h"
 
@@ -24,7 +25,7 @@ static int addr_mode_list[14][4] = {
     {I_TYPE , I_TYPE , I_TYPE , I_TYPE },
     {I_TYPE , I_TYPE , I_TYPE , I_TYPE },
     {I_TYPE , I_TYPE , I_TYPE , I_TYPE },
-    {RSVD   , RSVD   , RSVD   , RSVD   },
+    {I_TYPE , RSVD   , RSVD   , RSVD   },  // SYS is a software-only service trap
     {RSVD   , RSVD   , RSVD   , RSVD   },
     {J_TYPE , J_TYPE , R1_TYPE, R2_TYPE},
     {O_TYPE , O_TYPE , RSVD   , RSVD   },
@@ -42,7 +43,7 @@ static char* command_list[14][4] = {
     {"ADDIU", "SUBIU", "MULIU", "SLTIU"},
     {"ANDI" , "ORI"  , "XORI" , "NORI" },
     {"SLLI" , "SRLI" , "SRAI" , "ROTLI"},
-    {"RSVD" , "RSVD" , "RSVD" , "RSVD" },
+    {"SYS"  , "RSVD" , "RSVD" , "RSVD" },
     {"RSVD" , "RSVD" , "RSVD" , "RSVD" },
     {"J"    , "JAL"  , "JR"   , "JALR" },
     {"BEQ"  , "BNE"  , "RSVD" , "RSVD" },
@@ -61,7 +62,7 @@ static int opfunc_list[14][4] = {
     {0b010100, 0b010101, 0b010110, 0b010111},
     {0b011000, 0b011001, 0b011010, 0b011011},
     {0b011100, 0b011101, 0b011110, 0b011111},
-    {      -1,       -1,       -1,       -1},
+    {0b100000,       -1,       -1,       -1},
     {      -1,       -1,       -1,       -1},
     {0b101000, 0b101001, 0b101010, 0b101011},
     {0b101100, 0b101101,       -1,       -1},
@@ -97,7 +98,6 @@ int   func_col(int);
 /* decode and return instruction */
 char* decode(int num)
 {
-    static char decstr[STRLEN];
     static char* formats[] = {
         "(R1):  %s \t%s", 
         "(R2):  %s \t%s, %s", 
@@ -107,8 +107,7 @@ char* decode(int num)
         "(RSVD)"
     };
     int mode = addr_mode_list[op_row(num)][func_col(num)];
-    sprintf(decstr, formats[mode], int_to_opstr(num), oparg1(num), oparg2(num), oparg3(num));
-    return decstr;
+    return arena_printf(scratch_arena(), formats[mode], int_to_opstr(num), oparg1(num), oparg2(num), oparg3(num));
 }
 
 char* oparg1(int num)
@@ -6,50 +6,67 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
-#include <regex.h>
 #include <unistd.h>
-#include "linkedlist.h"
 #include "directives.h"
+#include "lexer.h"
+#include "ir.h"
+#include "expr.h"
+#include "relax.h"
 #include "strfunc.h"
+#include "arena.h"
 #include "common.h"
 
-extern void write_mif(int, int, char*, FILE*);        // defined in parser.c
-extern struct list* get_label_list();                 // defined in parser.c
-extern void update_address(int);                      // defined in parser.c    
+extern void write_mif(int, int, char*, FILE*);        // defined in asm.c
+extern int  annotating();                             // defined in asm.c
+extern void update_address(int);                      // defined in asm.c    
+extern void write_byte(int, int, char*, char*, FILE*); // defined in asm.c
+
+/* file scope variables */
+static int byte_words = 0;    /* 1: a word for every byte of data, -w */
 
 /* directive handlers */
-int handle_space(char*, int, FILE*);
-int handle_word(char*, int, FILE*);
-int handle_half(char*, int, FILE*);
-int handle_byte(char*, int, FILE*);
-int handle_ascii(char*, int, FILE*);
-int handle_asciiz(char*, int, FILE*);
-int handle_org(char*, int, FILE*);
-int handle_align(char*, int, FILE*);
+int handle_space(struct stmt*, int, FILE*);
+int handle_word(struct stmt*, int, FILE*);
+int handle_half(struct stmt*, int, FILE*);
+int handle_byte(struct stmt*, int, FILE*);
+int handle_ascii(struct stmt*, int, FILE*);
+int handle_asciiz(struct stmt*, int, FILE*);
+int handle_org(struct stmt*, int, FILE*);
+int handle_align(struct stmt*, int, FILE*);
+int handle_global(struct stmt*, int, FILE*);
+int handle_keep(struct stmt*, int, FILE*);
 
 /*  
   name:    directive
   purpose: create an assembler directive struct
-  field:   str        - directive string used by regexp
+  field:   str        - directive string
            *f         - function pointer to handle directive
 */
 struct directive {
     char*    str;
-    int (*f)(char*, int, FILE*);
+    int (*f)(struct stmt*, int, FILE*);
 };
 
 
-/* file scope table sructure to register directive type and function pointers */
+/* file scope table indexed by enum directive_id (lexer.h). .equ is handled with labels,
+   .macro, .rept and .include are expanded while the source is read (macro.c) */
 static struct directive directive_table[] = {
-    {".space",  handle_space},
-    {".word",   handle_word},
-    {".half",   handle_half},
-    {".byte",   handle_byte},
-    {".ascii",  handle_ascii},
-    {".asciiz", handle_asciiz},
-    {".org",    handle_org},
-    {".align",  handle_align},
-    {NULL, NULL}
+    [DIR_SPACE]  = {".space",  handle_space},
+    [DIR_WORD]   = {".word",   handle_word},
+    [DIR_HALF]   = {".half",   handle_half},
+    [DIR_BYTE]   = {".byte",   handle_byte},
+    [DIR_ASCII]  = {".ascii",  handle_ascii},
+    [DIR_ASCIIZ] = {".asciiz", handle_asciiz},
+    [DIR_ORG]    = {".org",    handle_org},
+    [DIR_ALIGN]  = {".align",  handle_align},
+    [DIR_EQU]    = {".equ",    NULL},
+    [DIR_GLOBAL] = {".global", handle_global},
+    [DIR_MACRO]  = {".macro",  NULL},
+    [DIR_ENDM]   = {".endm",   NULL},
+    [DIR_INCLUDE]= {".include",NULL},
+    [DIR_REPT]   = {".rept",   NULL},
+    [DIR_ENDR]   = {".endr",   NULL},
+    [DIR_KEEP]   = {".keep",   handle_keep},
 };
 
 /* helper to get arg part of directive string */
@@ -62,42 +79,17 @@ char* get_args(char* str, char* directive)
 * Shared functions (directives.h)
 */
 
-/* helper for check_directive to slice out directive */
-char* get_directive(char* str)
+/* -w of parser and min16-ld: .byte, .ascii and .asciiz a word per byte */
+void set_byte_words(int on)
 {
-    static char tmp[STRLEN];
-    strcpy(tmp, str);
-    char* comm = strchr(tmp, '#');
-    if (comm) *comm = '\0';
-
-    char* start;
-    char* label = strchr(tmp, ':');
-    if (label) start = label + 1;
-
-    start = strchr(tmp, '.');
-    if (!start) return NULL;
-    char* end = strchr(start, ' ');
-    if (!end) return NULL;
-    *end = '\0';
-
-    return start;
+    byte_words = on;
 }
 
-/* go through directive_table to try directive match and encode the string */
-int check_directive(char* str, int address, FILE* fp)
+/* call the handler of the directive lexer.c found in st. -1 if it has none */
+int run_directive(struct stmt* st, int address, FILE* fp)
 {
-    int i;
-    char* directive;
-    directive = get_directive(str);
-    if (directive == NULL) return -1;
-
-    for (i = 0; directive_table[i].str != NULL; i++) {
-        if (strcmp(directive, directive_table[i].str) == 0) {
-            int rv = directive_table[i].f(str, address, fp); 
-            return rv;
-        }
-    }
-    return -1;  // not a directive
+    if (st->dir < 0 || directive_table[st->dir].f == NULL) return -1;  // .equ
+    return directive_table[st->dir].f(st, address, fp);
 }
 
 
@@ -106,40 +98,12 @@ int check_directive(char* str, int address, FILE* fp)
 *    label: nothing 
 *    label:    .equ    <value>
 */
-/* check if label exists, then check .equ exists. return label value */
-int handle_label(char* str, int address)
+/* return the value of a label defined by st */
+int label_value(struct stmt* st, int address)
 {
-    char tmp[STRLEN];
-    strcpy(tmp, str);
-
-    char* p = search_chr(tmp, '#');
-    if (p != NULL) *p = '\0';  // slice out if comment exists
-    p = tmp;
-
-    p = search_chr(p, ':');    
-    if (p == NULL) return -1;  // not a label
-    *p = '\0';                 // else slice out the label
-
-    p = strstr(p + 1, ".equ");
-    
-    // if label found and no .equ
-    if (p == NULL) {
+    if (st->dir != DIR_EQU || st->kind != ST_DIRECTIVE)
         return address;
-    }
-
-    // else remove "." for .equ directive search 
-    *p = '\0';                 
-    return strop(p + strlen(".equ") + 1);
-}
-
-/* check if label exists */
-int is_label(char* str)
-{
-    char* p = str;
-    p = search_chr(p, ':');
-    
-    if (p == NULL) return 0;  // not a label
-    return 1;    
+    return expr_eval(st->args[0].expr);
 }
 
 /**
@@ -150,26 +114,59 @@ int is_label(char* str)
 *  o To reserve space
 *    .space    <number of bytes>   # skip over specified number of bytes
 */
-int handle_space(char* str, int address, FILE* fp)
+int handle_space(struct stmt* st, int address, FILE* fp)
 { 
-    return address + strop(get_args(str, ".space"));
+    return address + expr_eval(st->args[0].expr);
 }
 
 
-/* helper to write toknized arguments and return address */
-int write_and_update_address(char* str, int address, FILE* fp, int increment)
+/* helper to write the arguments of st a word each and return address */
+int write_and_update_address(struct stmt* st, int address, FILE* fp, int increment)
 {
-    char* tok = strtok(no_comment_str(str), " \t");
-    for (;;)
-    {
-        tok = strtok(NULL, " \t");
-        if (tok == NULL) break;
-        if (fp) write_mif(address, strop(tok), concat2(str, tok), fp);
+    struct strview head = view_until(strip(st->text), " \t");  // the directive
+
+    int i;
+    for (i = 0; i < st->nargs; i++) {
+        if (fp) write_mif(address, expr_eval(st->args[i].expr), annotating() ?
+            arena_printf(scratch_arena(), "%.*s: %s", head.len, head.p, st->args[i].text) : NULL, fp);
         address += increment;
     }
     return address;     
 }
 
+/* helper to write one byte of data and return the address after it. head and
+   item annotate it: packed two to a word, or a word each with -w */
+static int write_data_byte(int address, int value, char* head, char* item, FILE* fp)
+{
+    if (byte_words) {
+        if (fp) write_mif(address, value & 0xff, annotating() ?
+            arena_printf(scratch_arena(), "%s: %s", head, item) : NULL, fp);
+        return address + 2;
+    }
+    if (fp) write_byte(address, value, head, item, fp);
+    return address + 1;
+}
+
+/* helper to write the chars of a string directive line, with the terminator if z */
+static int write_string(struct stmt* st, int address, FILE* fp, char* directive, int z)
+{
+    char* str = strip(st->text);
+    struct strview line = view_until(str, "\n");
+    struct strview text = view_until(get_args(str, directive) + 1, "\"");  // skip '"'
+    char* head = fp && annotating() ? arena_printf(scratch_arena(), "%.*s", line.len, line.p) : NULL;
+    int i;
+    for (i = 0; i < text.len + z; i++) {
+        char c = i < text.len ? text.p[i] : '\0';
+        char* item = NULL;
+        if (head && byte_words)
+            item = arena_printf(scratch_arena(), "%.*s", c != 0, &c);  // as it always was
+        else if (head)
+            item = c ? arena_printf(scratch_arena(), "'%c'", c) : "'\\0'";
+        address = write_data_byte(address, c, head, item, fp);
+    }
+    return address;
+}
+
 /***
 *  o To reserve space and initialize it to particular values
 *    .word <w1>,<w2>, ... ,<wn>
@@ -179,74 +176,82 @@ int write_and_update_address(char* str, int address, FILE* fp, int increment)
 *    .byte <b1>,<b2>, ... ,<bn>
 *    .ascii    <string>        # string in double quotes
 *    .asciiz   <string>        # null terminated string
+*
+*    A word is 16 bits, so .half is the same as .word. asm.c aligns both,
+*    and every label and instruction, to a word. .byte, .ascii and .asciiz
+*    pack two bytes to a word, low byte first, and go on from an odd
+*    address the data before them left; -w puts every byte in a word of
+*    its own, the layout of the older assembler.
 */
-int handle_word(char* str, int address, FILE* fp)
+int handle_word(struct stmt* st, int address, FILE* fp)
 { 
-    return write_and_update_address(str, address, fp, 2);
+    return write_and_update_address(st, address, fp, 2);
 }
 
-int handle_half(char* str, int address, FILE* fp)
+int handle_half(struct stmt* st, int address, FILE* fp)
 { 
-    return write_and_update_address(str, address, fp, 1);
+    return write_and_update_address(st, address, fp, 2);
 }
 
-int handle_byte(char* str, int address, FILE* fp)
+int handle_byte(struct stmt* st, int address, FILE* fp)
 { 
-    return write_and_update_address(str, address, fp, 1);
+    struct strview view = view_until(strip(st->text), " \t");  // the directive
+    char* head = fp && annotating() ? arena_printf(scratch_arena(), "%.*s", view.len, view.p) : NULL;
+    int i;
+    for (i = 0; i < st->nargs; i++)
+        address = write_data_byte(address, fp ? expr_eval(st->args[i].expr) : 0, head, st->args[i].text, fp);
+    return address;
 }
 
-int handle_ascii(char* str, int address, FILE* fp)
+int handle_ascii(struct stmt* st, int address, FILE* fp)
 { 
-    char chararr[] = "Z";
-    char* s = get_args(str, ".ascii");
-    s++;  // skip '"'
-    for (; *s != '\"'; s++) {
-        *chararr = *s;
-        if (fp) write_mif(address, (int) *chararr, concat2(trimmed(str, '\n'), chararr), fp);
-        address += 2;
-    }    
-    return address; 
-}
-
-int handle_asciiz(char* str, int address, FILE* fp)
-{
-    char chararr[] = "Z";
-    char* s = get_args(str, ".asciiz");
-    s++;  // skip '"'
-    for (; *s != '\"'; s++) {
-        *chararr = *s;
-        if (fp) write_mif(address, (int) *chararr, concat2(trimmed(str, '\n'), chararr), fp);
-        address += 2;
-    }    
-    *chararr = '\0';
-    if (fp) write_mif(address, (int) *chararr, concat2(trimmed(str, '\n'), chararr), fp);
-    address += 2;
+    return write_string(st, address, fp, ".ascii", 0);
+}
 
-    return address; 
+int handle_asciiz(struct stmt* st, int address, FILE* fp)
+{
+    return write_string(st, address, fp, ".asciiz", 1);
 }
 
 /***
 *  o To set the location counter
 *    .org  <location>
 */
-int handle_org(char* str, int address, FILE* fp)
+int handle_org(struct stmt* st, int address, FILE* fp)
 { 
-    char* new_address_str = get_args(str, ".org");
-    return strop(new_address_str); 
+    int new_address = expr_eval(st->args[0].expr);
+    if (fp == NULL) relax_org();  // relax.c, after expr_eval records the label used
+    return new_address; 
 }
 
 /***
 *  o To force alignment
 *   .align    <n>         # align next item on a 2^n byte boundary
 */
-int handle_align(char* str, int address, FILE* fp)
+int handle_align(struct stmt* st, int address, FILE* fp)
 { 
-    int n = strop(get_args(str, ".align"));
+    int n = expr_eval(st->args[0].expr);
     int aln = pow(2,n);
+    if (fp == NULL) relax_align(address, aln);  // relax.c
     int quo = address / aln;
     int adj = address % aln == 0 ? 0 : 1;
     return aln * (quo + adj);
 }
 
+/***
+*  o To export labels to other modules (parser -c, obj.c)
+*    .global   <label>, <label>, ...
+*/
+int handle_global(struct stmt* st, int address, FILE* fp)
+{
+    return address;
+}
 
-
+/***
+*  o To keep labels that nothing names when unreachable code is stripped (-s, strip.c)
+*    .keep     <label>, <label>, ...
+*/
+int handle_keep(struct stmt* st, int address, FILE* fp)
+{
+    return address;
+}
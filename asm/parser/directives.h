@@ -5,8 +5,10 @@
 #ifndef DIRECTIVES_INCL
 #define DIRECTIVES_INCL
 
-int check_directive(char*, int, FILE*);
-int handle_label(char*, int );
-int is_label(char*);
+struct stmt;
+
+int run_directive(struct stmt*, int, FILE*);
+int label_value(struct stmt*, int);
+void set_byte_words(int);
 
 #endif /* DIRECTIVES_INCL */
\ No newline at end of file
@@ -8,18 +8,15 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
-#include <regex.h>
-#include "linkedlist.h"
+#include "relax.h"
+#include "synth.h"
+#include "lexer.h"
+#include "expr.h"
 #include "encoder.h"
 #include "decoder.h"
 #include "common.h"
 #include "strfunc.h"
 
-#define CODELEN 6                                     // num of char in opfunc code incl '\0'
-#define REGNUM  16                                    // num of registers
-#define NUMSTR  512                                   // TARGET/OFFSET/IMMEDIATE number string size
-#define DEPTH   32768                                 // max number of instructions
-
 
 /* Assembler command mapping with OP + FUNC */
 enum opfunc {
@@ -31,10 +28,12 @@ enum opfunc {
     ADDIU = 0b010100, SUBIU = 0b010101, MULIU = 0b010110, SLTIU = 0b010111,
     ANDI  = 0b011000, ORI   = 0b011001, XORI  = 0b011010, NORI  = 0b011011,
     SLLI  = 0b011100, SRLI  = 0b011101, SRAI  = 0b011110, ROTLI = 0b011111,
+    SYS   = 0b100000,
     J     = 0b101000, JAL   = 0b101001, JR    = 0b101010, JALR  = 0b101011,
     BEQ   = 0b101100, BNE   = 0b101101,
     LW    = 0b110000, LB    = 0b110001, SW    = 0b110010, SB    = 0b110011,
     MFHI  = 0b110100, MFLO  = 0b110101, MTHI  = 0b110110, MTLO  = 0b110111, 
+    LI    = PSEUDO | 0, PUSH  = PSEUDO | 1, POP   = PSEUDO | 2, RET   = PSEUDO | 3,
 };
 
 /* Assembler registers */
@@ -42,283 +41,445 @@ enum reg {
     R0, AT, SP, FP, RA, RB, RC, RD, S0, S1, T0, T1, HI, LO, PC, FL,
 };
 
-/* autogen boundary list of list (IJO type has boundary) 
-   NOTE - this boudary is with abs value */
-static int autogen_boundary_list[14][4] = {
-    {0xffff, 0xffff, 0xffff, 0xffff},  // R_TYPE has no autogen
-    {0xffff, 0xffff, 0xffff, 0xffff},
-    {0xffff, 0xffff, 0xffff, 0xffff},
-    {0xffff, 0xffff, 0xffff, 0xffff},
-    {0x001f, 0x001f, 0x001f, 0x001f},  // I_TYPE has 6 bits but signed,   so check 5 bits
-    {0x003f, 0x003f, 0x003f, 0x003f},  // I_TYPE has 6 bits but unsigned, so check 6 bits
-    {0x003f, 0x003f, 0x003f, 0x003f},  // I_TYPE has 6 bits but logical,  so check 6 bits
-    {0x003f, 0x003f, 0x001f, 0x003f},  // SRAI is signed, so check 5 bits
-    {0xffff, 0xffff, 0xffff, 0xffff},  // RSVD has no autogen
-    {0xffff, 0xffff, 0xffff, 0xffff},
-    {0x03ff, 0x03ff, 0xffff, 0xffff},  // J_TYPE has 10 bits (unsigned)
-    {0x0007, 0x0007, 0xffff, 0xffff},
-    {0x0007, 0x0007, 0x0007, 0x0007},  // O_TYPE has 4 bits (signed), so check 3 bits
-    {0xffff, 0xffff, 0xffff, 0xffff},
+/*
+ * Expansion templates
+ *
+ * An operand out of the range of its field, and every pseudo-instruction,
+ * is expanded into the fixed sequence of a template. A slot is either the
+ * value loaded into a register (synth.c, 1 to SYNTHMAX words) or one
+ * instruction whose fields are registers, numbers or operands of the line.
+ * So the size of an expansion is known from the value alone, and its
+ * longest form bounds the growth of a site in relax.c.
+ *
+ * A site relax.c made longer than its expansion is padded in front, with
+ * AND $at, $r0 or, when $at already holds the value, AND $at, $at.
+ */
+
+/* operands of a slot, other than a register or a number */
+enum slot_operand {
+    OPD_RD = -1, OPD_RS = -2, OPD_NUM = -3,
+};
+
+/* slot kinds: the value, or the format of the instruction */
+enum slot_kind {
+    T_NONE, T_CONST, T_R, T_I, T_J, T_O,
+};
+
+/* slot flags */
+#define S_FAR   1     // only when the value is not a J target (0 - 0x3ff)
+#define S_NEAR  2     // only when it is
+#define S_OPT   4     // left out when b is $r0, an ADD of nothing
+
+#define SELF    0x100 // opfunc of a slot: the expanded one's own, xor the low bits
+#define TSLOTS  4     // slots per template
+
+/*
+  name:    slot
+  purpose: one part of an expansion template
+  field:   kind    - T_CONST: the value into register a. T_R, T_I, T_J, T_O: an instruction
+           opfunc  - op + func code, or SELF | bits
+           a, b, c - rd, rs and imm|target|offset: register, number or OPD_*
+           flags   - S_FAR, S_NEAR, S_OPT
+*/
+struct slot {
+    int kind;
+    int opfunc;
+    int a, b, c;
+    int flags;
 };
 
-/* autogen address increase list of list */
-static int addr_increase_list[14][4] = {
-    { 0,  0,  0,  0},
-    { 0,  0,  0,  0},
-    { 0,  0,  0,  0},
-    { 0,  0,  0,  0},
-    {24, 24, 24, 24},  // I_TYPE autogen makes 24 more instructions
-    {24, 24, 24, 24},  // one instruction cause 2 address increase
-    {24, 24, 24, 24},  // so 24 increase for IJ_type
-    {24, 24, 24, 24},
-    { 0,  0,  0,  0},
-    { 0,  0,  0,  0},
-    {24, 24,  0,  0},  // J_TYPE      has 24 increase
-    {30, 30,  0,  0},  // BEQ|BNE     has 30 increase
-    {26, 26, 26, 26},  // LW|LB|SW|SB has 26 increase
-    { 0,  0,  0,  0},
+/*
+  name:    expansion
+  purpose: expansion template of the instructions matching it
+  field:   mask, match - opfunc & mask == match
+           limit       - largest abs(value) the field takes, -1 if it always expands
+           bits        - field width in the mif message, 0 for a pseudo-instruction
+           seq         - slots in order, T_NONE after the last
+*/
+struct expansion {
+    int mask, match;
+    int limit;
+    int bits;
+    struct slot seq[TSLOTS];
 };
 
-/* Register list. index matches with the register number. */
-static char* registers[] = {
-    "r0", "at", "sp", "fp", "ra", "rb", "rc", "rd", 
-    "s0", "s1", "t0", "t1", "hi", "lo", "pc", "fl",
+/* first match wins, so SRAI comes before the other shifts */
+static struct expansion expansion_table[] = {
+    // I_TYPE: $at = value, then the R_TYPE of the same operation with $at
+    {0b1111100, ADDI,  0x001f, 5, {{T_CONST, 0, AT}, {T_R, SELF | 0b010000, OPD_RD, AT}}},  // signed
+    {0b1111100, ADDIU, 0x003f, 5, {{T_CONST, 0, AT}, {T_R, SELF | 0b010000, OPD_RD, AT}}},  // unsigned
+    {0b1111100, ANDI,  0x003f, 5, {{T_CONST, 0, AT}, {T_R, SELF | 0b010000, OPD_RD, AT}}},  // logical
+    {0b1111111, SRAI,  0x001f, 5, {{T_CONST, 0, AT}, {T_R, SELF | 0b010000, OPD_RD, AT}}},  // SRAI
+    {0b1111100, SLLI,  0x003f, 5, {{T_CONST, 0, AT}, {T_R, SELF | 0b010000, OPD_RD, AT}}},  // shifts
+    // J|JAL: JR $at or JALR $at, $ra
+    {0b1111110, J,     0x03ff, 10, {{T_CONST, 0, AT}, {T_R, SELF | 0b000010, AT, RA}}},
+    // BEQ|BNE out of 4 signed bits, for the target address: the inverted
+    // branch skips a J, or a JR $at when J does not reach
+    {0b1111110, BEQ,   0x0007, 3, {{T_CONST, 0, AT, 0, 0, S_FAR}, {T_O, SELF | 1, OPD_RD, OPD_RS, 2},
+                                       {T_R, JR, AT, R0, 0, S_FAR}, {T_J, J, 0, 0, OPD_NUM, S_NEAR}}},
+    // LW|LB: $at = $rs + value, the ADD left out for $r0
+    {0b1111110, LW,    0x0007, 3, {{T_CONST, 0, AT}, {T_R, ADD, AT, OPD_RS, 0, S_OPT},
+                                       {T_O, SELF, OPD_RD, AT, 0}}},
+    // SW|SB store $rs at $rd: $at = $rd + value
+    {0b1111110, SW,    0x0007, 3, {{T_CONST, 0, AT}, {T_R, ADD, AT, OPD_RD, 0, S_OPT},
+                                       {T_O, SELF, AT, OPD_RS, 0}}},
+    // pseudo-instructions (lexer.h)
+    {0b1111111, LI,    -1, 0, {{T_CONST, 0, OPD_RD}}},
+    {0b1111111, PUSH,  -1, 0, {{T_I, SUBIU, SP, 0, 2}, {T_O, SW, SP, OPD_RD, 0}}},
+    {0b1111111, POP,   -1, 0, {{T_O, LW, OPD_RD, SP, 0}, {T_I, ADDIU, SP, 0, 2}}},
+    {0b1111111, RET,   -1, 0, {{T_R, JR, RA, R0}}},
 };
 
+#define NEXPANSIONS (int) (sizeof expansion_table / sizeof expansion_table[0])
+
 /* API to write to mif file */
-extern FILE* get_fp();                           // defined in parser.c
-extern int   get_address();                      // defined in parser.c
-extern void  update_address(int);                // defined in parser.c
-extern int   is_label_used();                    // defined in parser.c
-extern struct list* get_label_list();            // defined in parser.c
-extern struct list* get_used_list();             // defined in parser.c
+extern FILE* get_fp();                           // defined in asm.c
+extern int   get_address();                      // defined in asm.c
+extern void  update_address(int);                // defined in asm.c
+
+extern void  write_mif(int, int, char*, FILE*);  // defined in asm.c
+extern int   annotating();                       // defined in asm.c
+extern void  mif_asm_gen_message(int, int);      // defined in asm.c
+extern void  mif_pseudo_message();               // defined in asm.c
+extern void  mif_blank_message();                // defined in asm.c
+extern void  peep_message(int, int);             // defined in asm.c
+extern int   get_optimize();                     // defined in asm.c
+
+
+/* $at tracking for the peephole (-O1) */
+static int at_src = -1;   /* 1st path: site whose value $at holds, -1 if unknown */
+static __thread int at_reuse = 0;  /* 2nd path: the current site reuses $at */
 
-extern void  write_mif(int, int, char*, FILE*);  // defined in parser.c
-extern void  mif_asm_gen_message(int, int);      // defined in parser.c
-extern void  mif_blank_message();                // defined in parser.c
+/* autogen statistics for the report, counted by each encoding thread */
+static __thread int autogen_sites = 0;
+static __thread int autogen_bytes = 0;
+static __thread int autogen_saved = 0;
 
 
 /* mif related encoding helper */
-int gen_IJ_to_R(int num, int instruction);
-int gen_O_to_R(int opfunc, int rd, int rs, int num);
 int gen_instr_R(int opfunc, int rd, int rs);
 int gen_instr_I(int opfunc, int rd, int imm);
 int gen_instr_J(int opfunc, int target);
 int gen_instr_O(int opfunc, int rd, int rs, int offs);
 
 /* Data conversion and Helper functions */
-int   is_autogen(int num, int opfunc, int address);  // to be called from linkedlist.c
-void  slice_cpy(char*, char*, int, int);
-int   reg_to_int(char*);
+int   is_autogen(int num, int opfunc, int address);  // to be called from relax.c
+int   autogen_increase(int num, int opfunc, struct operands* ops);  // to be called from relax.c
+int   autogen_growth(struct operands* ops, int num);
+int   reuse_increase(struct operands* ops);
+int   branch_target(int opfunc, int num, int address);  // to be called from relax.c
+int   branch_offset(int opfunc, struct expr* e, int num, int address);  // to be called from relax.c
+int   is_branch(int opfunc);                         // to be called from relax.c
+int   opfunc_to_increase(int opfunc);
 int   word_to_int(char*);
-int   opstr_to_opfunc(char*);
 
+static struct expansion* expansion_of(int opfunc);
+static int expansion_value(int opfunc, int num, int address);
+static int expansion_size(struct expansion* x, struct operands* ops, int num, int reuse);
+static int expand(struct expansion* x, struct operands* ops, int num, int grow, int* inst);
+static int autogen(struct operands* ops, int num, int grow);
+static int at_after(struct expansion* x, struct operands* ops, int site);
+static int clobbers_at(int instr);
+
+
+/* encode function for each addressing mode, pseudo-instructions are expanded */
+static int (*encode_table[])(struct operands*) = {
+    [R1_MODE] = encode_R1,
+    [R2_MODE] = encode_R2,
+    [I_MODE]  = encode_I,
+    [J_MODE]  = encode_J,
+    [O_MODE]  = encode_O,
+};
 
 /**
 * Instruction Encoding Functions 
 */
 
-/* just do nothing and return 0 */
-/* NOTE: value 0x0000 is ADD $r0, $r0 but it's the same as do nothing */
-int encode_blank(char* str, regmatch_t* matched)
+/* encode the instruction of ops. return it, or EXPANDED when its words are
+   written already and the address moved past them */
+int encode(struct operands* ops)
 {
-    return 0;
+    if (ops->op->opfunc & PSEUDO)
+        return encode_P(ops);
+    return encode_table[ops->op->mode](ops);
 }
 
 /* encode and return instruction for R_TYPE with only one register */
-int encode_R1(char* str, regmatch_t* matched)
+int encode_R1(struct operands* ops)
 {
-    char op[CODELEN], rd[CODELEN];
-    slice_cpy(str, op, matched[1].rm_so, matched[1].rm_eo);
-    slice_cpy(str, rd, matched[2].rm_so, matched[2].rm_eo);
-    return opstr_to_opfunc(op)<<10 | reg_to_int(rd)<<6;
+    return ops->op->opfunc<<10 | ops->rd<<6;
 }
 
 /* encode and return instruction for R_TYPE with two registers */
-int encode_R2(char* str, regmatch_t* matched)
+int encode_R2(struct operands* ops)
 {
-    char op[CODELEN], rd[CODELEN], rs[CODELEN];
-    slice_cpy(str, op, matched[1].rm_so, matched[1].rm_eo);
-    slice_cpy(str, rd, matched[2].rm_so, matched[2].rm_eo);
-    slice_cpy(str, rs, matched[3].rm_so, matched[3].rm_eo);
-    return opstr_to_opfunc(op)<<10 | reg_to_int(rd)<<6 | reg_to_int(rs)<<2;
+    return ops->op->opfunc<<10 | ops->rd<<6 | ops->rs<<2;
 }
 
 
 /* encode and return instruction for I_PAT  */
-int encode_I(char* str, regmatch_t* matched)
+int encode_I(struct operands* ops)
 {
-    char op[CODELEN], rd[CODELEN], imm[NUMSTR];
-    slice_cpy(str, op,  matched[1].rm_so, matched[1].rm_eo);
-    slice_cpy(str, rd,  matched[2].rm_so, matched[2].rm_eo);
-    slice_cpy(str, imm, matched[3].rm_so, matched[3].rm_eo);
+    int op = ops->op->opfunc;
+    int num = expr_eval(ops->expr);  // this records used labels in relax.c
 
-    int num = strop(imm);  // this marks is_used_label when found
+    if (op == SYS && (num < 0 || num > 0x3f))
+        oops2("encode_I: SYS service number out of range", int_to_str(num))
 
-    // build used_list on 1st path
-    if ((get_fp() == NULL) && (is_label_used())) {
-        build_used_list(get_used_list(), imm, op);  // ex. imm = "tag", op = "ANDI" 
-    }
 
-    if (!is_autogen(num, opstr_to_opfunc(op), get_address())) {
+    int grow = autogen_growth(ops, num);
+    if (!grow && !at_reuse) {
         int numlast = abs(num);
         if (num < 0)
             numlast = (numlast ^ 0x003f) + 1; // 6-bit version negation
-        return opstr_to_opfunc(op)<<10 | reg_to_int(rd)<<6 | numlast;
+        return op<<10 | ops->rd<<6 | (numlast & 0x003f);  // 1st path site may not fit yet
     }
     // handling too big abs(imm) > 5 bits
-    mif_asm_gen_message(5, num);
-    int opfunc = opstr_to_opfunc(op) ^ 0b010000;  // ex. convert ADDI to ADD
-    int instruction = gen_instr_R(opfunc, reg_to_int(rd), AT); // R2 type
-    int rv = gen_IJ_to_R(num, instruction);
-    mif_blank_message();
-    return rv;
+    return autogen(ops, num, grow);
 }
 
 
 /* encode and return instruction for J_PAT  */
-int encode_J(char* str, regmatch_t* matched)
+int encode_J(struct operands* ops)
 {
-    char op[CODELEN], target[NUMSTR];
-    slice_cpy(str, op, matched[1].rm_so, matched[1].rm_eo);
-    slice_cpy(str, target, matched[2].rm_so, matched[2].rm_eo);
-
-    uint16_t num = strop(target);  // this marks is_used_label when found
+    int op = ops->op->opfunc;
+    uint16_t num = expr_eval(ops->expr);  // this records used labels in relax.c
 
-    // build used_list on 1st path
-    if ((get_fp() == NULL) && (is_label_used())) {
-        build_used_list(get_used_list(), target, op);  // ex. target = "tag", op = "ANDI" 
-    }
-    if (!is_autogen(num, opstr_to_opfunc(op), get_address())) {
-        return (opstr_to_opfunc(op)<<10) | (num);
-        // return (opstr_to_opfunc(op)<<10) | (num & 0x03ff);
+    int grow = autogen_growth(ops, num);
+    if (!grow && !at_reuse) {
+        return (op<<10) | (num & 0x03ff);
     }
     // handling too big target and num is 10 bits farther away from the next address
-    mif_asm_gen_message(10, num);
-    int opfunc = -1;
-    if (strcmp(op, "J") == 0) opfunc = JR;         // R1 type
-    if (strcmp(op, "JAL") == 0) opfunc = JALR;     // R2 type
-    int instruction = gen_instr_R(opfunc, AT, RA); // R1 or R2 type. AT holds big num.
-    int rv = gen_IJ_to_R(num, instruction);
-    mif_blank_message();
-    return rv;
+    return autogen(ops, num, grow);
 }
 
 
+/* encode and return instruction for O_PAT  */
+int encode_O(struct operands* ops)
+{
+    int op = ops->op->opfunc;
+    int num = expr_eval(ops->expr);  // this records used labels in relax.c
+    num = branch_offset(op, ops->expr, num, get_address());
+
+    int grow = autogen_growth(ops, num);
+    if (!grow && !at_reuse) {
+        int numlast = abs(num);
+        if (num < 0)
+            numlast = (numlast ^ 0x000f) + 1; // 4-bit version negation
+        return op<<10 | ops->rd<<7 | ops->rs<<4 | (numlast & 0x000f);
+    }
+    // handling too big abs(offset) > 3 bits
+    return autogen(ops, num, grow);
+}
+
 
-/* generate instructions to convert I,J_TYPE to R2_TYPE if num is too big */
-int gen_IJ_to_R(int num, int instruction)
+/* write a pseudo-instruction, always its expansion. LI and LA with a label
+   are sized by relax.c like an autogen */
+int encode_P(struct operands* ops)
 {
-    FILE* fp = get_fp();
-    int address = get_address();
+    struct expansion* x = expansion_of(ops->op->opfunc);
+    int num = ops->expr ? expr_eval(ops->expr) : 0;  // this records used labels in relax.c
+    int grow = ops->expr ? autogen_growth(ops, num) : autogen_increase(num, ops->op->opfunc, ops);
+    if (get_fp() == NULL)
+        at_src = get_optimize() ? at_after(x, ops, -1) : -1;
+    return autogen(ops, num, grow);
+}
 
-    // break down num into 6-4-6 bits and store to register at
-    int a = (num & 0xFC00) >> 10;
-    int b = (num & 0x03C0) >> 6;
-    int c = (num & 0x003F);
-
-    int inst[DEPTH] = {0,};
-    inst[0]  = gen_instr_R(AND,  T1, R0);
-    inst[1]  = gen_instr_R(AND,  AT, R0);
-    inst[2]  = gen_instr_I(ORI,  T1, a);
-    inst[3]  = gen_instr_I(SLLI, T1, 10);
-    inst[4]  = gen_instr_R(OR,   AT, T1);
-    inst[5]  = gen_instr_R(AND,  T1, R0);
-    inst[6]  = gen_instr_I(ORI,  T1, b);
-    inst[7]  = gen_instr_I(SLLI, T1, 6);
-    inst[8]  = gen_instr_R(OR,   AT, T1);
-    inst[9]  = gen_instr_R(AND,  T1, R0);
-    inst[10] = gen_instr_I(ORI,  T1, c);
-    inst[11] = gen_instr_R(OR,   AT, T1);  // $at is num
-
-    inst[12] = instruction;  // append the R_TYPE instruction     
-
-    int i = 0;
-    for (; inst[i] != 0; i++)
-    {
-        if (fp) write_mif(address, inst[i], concat2("asm", decode(inst[i])), fp);
-        address += 2;
+
+/* write the words of an instruction without an operand value, an R_TYPE or
+   PUSH, POP and RET, into inst (EXPANDMAX). return the count (obj.c) */
+int encode_fixed(struct operands* ops, int* inst)
+{
+    if (!(ops->op->opfunc & PSEUDO)) {
+        inst[0] = encode_table[ops->op->mode](ops);
+        return 1;
     }
-    update_address(address);
-    return 0;
+    at_reuse = 0;
+    return expand(expansion_of(ops->op->opfunc), ops, 0, autogen_increase(0, ops->op->opfunc, ops), inst);
 }
 
 
-/* encode and return instruction for O_PAT  */
-int encode_O(char* str, regmatch_t* matched)
+/**
+* Expansion Functions
+*/
+
+/* return the template expanding opfunc, NULL if it never expands */
+static struct expansion* expansion_of(int opfunc)
+{
+    int i;
+    for (i = 0; i < NEXPANSIONS; i++) {
+        if ((opfunc & expansion_table[i].mask) == expansion_table[i].match)
+            return &expansion_table[i];
+    }
+    return NULL;
+}
+
+/* helper to get the register or number an operand of a slot stands for */
+static int slot_operand(int a, struct operands* ops, int num)
 {
-    char op[CODELEN], rd[CODELEN], rs[CODELEN], offs[NUMSTR];
-    slice_cpy(str, op, matched[1].rm_so, matched[1].rm_eo);
-    slice_cpy(str, rd, matched[2].rm_so, matched[2].rm_eo);
-    slice_cpy(str, rs, matched[3].rm_so, matched[3].rm_eo);
-    slice_cpy(str, offs, matched[4].rm_so, matched[4].rm_eo);
+    switch (a) {
+        case OPD_RD:  return ops->rd;
+        case OPD_RS:  return ops->rs;
+        case OPD_NUM: return num;
+    }
+    return a;
+}
 
-    int num = strop(offs);   // this marks is_used_label when found
+/* return 1 if slot s is part of the expansion of ops for num, ops NULL for the longest */
+static int slot_used(struct slot* s, struct operands* ops, int num)
+{
+    int near = num >= 0 && num <= 0x03ff;  // a J target reaches it
+    if ((s->flags & S_FAR) && near)
+        return 0;
+    if ((s->flags & S_NEAR) && !near)
+        return 0;
+    return !(s->flags & S_OPT) || ops == NULL || slot_operand(s->b, ops, num) != R0;
+}
 
-    // build used_list on 1st path
-    if ((get_fp() == NULL) && (is_label_used())) {
-        build_used_list(get_used_list(), offs, op);  // ex. offs = "tag", op = "ANDI" 
+/* encode the instruction of slot s */
+static int slot_word(struct slot* s, struct operands* ops, int num)
+{
+    int op = s->opfunc & SELF ? ops->op->opfunc ^ (s->opfunc & ~SELF) : s->opfunc;
+    int a = slot_operand(s->a, ops, num);
+    int b = slot_operand(s->b, ops, num);
+    int c = slot_operand(s->c, ops, num);
+    switch (s->kind) {
+        case T_R: return gen_instr_R(op, a, b);
+        case T_I: return gen_instr_I(op, a, c & 0x003f);
+        case T_J: return gen_instr_J(op, c & 0x03ff);
     }
+    return gen_instr_O(op, a, b, c & 0x000f);
+}
 
-    if (!is_autogen(num, opstr_to_opfunc(op), get_address())) {
-        int numlast = abs(num);
-        if (num < 0)
-            numlast = (numlast ^ 0x000f) + 1; // 4-bit version negation
-        return opstr_to_opfunc(op)<<10 | reg_to_int(rd)<<7 | reg_to_int(rs)<<4 | numlast;
+/* return number of words x expands ops to for num, reuse 1 if $at holds it.
+   ops NULL for the longest with any registers */
+static int expansion_size(struct expansion* x, struct operands* ops, int num, int reuse)
+{
+    struct slot* s;
+    int n = 0;
+    for (s = x->seq; s < x->seq + TSLOTS && s->kind != T_NONE; s++) {
+        if (!slot_used(s, ops, num))
+            continue;
+        if (s->kind != T_CONST)
+            n++;
+        else if (!reuse || s->a != AT)
+            n += synth_len(num);
     }
-    // handling too big abs(target) > 3 bits
-    mif_asm_gen_message(3, num);
-    int rv = gen_O_to_R(opstr_to_opfunc(op), reg_to_int(rd), reg_to_int(rs), num);
-    mif_blank_message();
-    return rv;
+    return n;
 }
 
+/* return number of words of the longest expansion of x */
+static int expansion_max(struct expansion* x)
+{
+    struct slot* s;
+    int far = 0, near = 0;
+    for (s = x->seq; s < x->seq + TSLOTS && s->kind != T_NONE; s++) {
+        int n = s->kind == T_CONST ? SYNTHMAX : 1;
+        if (!(s->flags & S_NEAR)) far += n;
+        if (!(s->flags & S_FAR))  near += n;
+    }
+    return far > near ? far : near;
+}
 
-/* generate instructions to convert O_TYPE to R2_TYPE if num is too big */
-int gen_O_to_R(int opfunc, int rd, int rs, int num)
+/*
+  name:    expand
+  purpose: write the expansion of ops for num into inst, padded in front to
+           the grow bytes longer than one instruction relax.c chose
+  field:   x    - template of the instruction
+           ops  - instruction
+           num  - operand value
+           grow - address increase
+           inst - EXPANDMAX words
+  return:  number of words, grow / 2 + 1
+*/
+static int expand(struct expansion* x, struct operands* ops, int num, int grow, int* inst)
+{
+    int words = grow / 2 + 1;
+    int pad = words - expansion_size(x, ops, num, at_reuse);
+    int reg = x->seq[0].kind == T_CONST ? slot_operand(x->seq[0].a, ops, num) : AT;
+    int n = 0;
+    struct slot* s;
+
+    if (words > EXPANDMAX)
+        oops2("expand: longer than the template allows", ops->op->str)
+    if (pad < 0) {  // a site is one word on 1st path, only the address moves
+        if (get_fp()) oops2("expand: shorter than the expansion", ops->op->str)
+        return words;
+    }
+    for (; n < pad; n++)  // keeps the size relax.c chose
+        inst[n] = at_reuse ? gen_instr_R(AND, reg, reg) : gen_instr_R(AND, reg, R0);
+    for (s = x->seq; s < x->seq + TSLOTS && s->kind != T_NONE; s++) {
+        if (!slot_used(s, ops, num))
+            continue;
+        if (s->kind != T_CONST)
+            inst[n++] = slot_word(s, ops, num);
+        else if (!at_reuse || s->a != AT)
+            n += synth_const(num, slot_operand(s->a, ops, num), inst + n);
+    }
+    return n;
+}
+
+/* write the expansion of ops for num, grow bytes longer than one instruction,
+   and move the address past it. return EXPANDED */
+static int autogen(struct operands* ops, int num, int grow)
 {
     FILE* fp = get_fp();
+    int opfunc = ops->op->opfunc;
     int address = get_address();
-
-    // break down num into 6-4-6 bits and store to register at
-    int a = (num & 0xFC00) >> 10;
-    int b = (num & 0x03C0) >> 6;
-    int c = (num & 0x003F);
-
-    int inst[DEPTH] = {0,};
-    inst[0]  = gen_instr_R(AND , T1, R0);
-    inst[1]  = gen_instr_R(AND , AT, R0);
-    inst[2]  = gen_instr_I(ORI , T1, a);
-    inst[3]  = gen_instr_I(SLLI, T1, 10);
-    inst[4]  = gen_instr_R(OR  , AT, T1);
-    inst[5]  = gen_instr_R(AND , T1, R0);
-    inst[6]  = gen_instr_I(ORI , T1, b);
-    inst[7]  = gen_instr_I(SLLI, T1, 6);
-    inst[8]  = gen_instr_R(OR  , AT, T1);
-    inst[9]  = gen_instr_R(AND , T1, R0);
-    inst[10] = gen_instr_I(ORI , T1, c);
-    inst[11] = gen_instr_R(OR  , AT, T1);  // $at is num
-
-    // test equality of rd and rs then do the BEQ or BNE
-    if (opfunc == BEQ || opfunc == BNE) {
-        inst[12] = gen_instr_R(SUB , rd, rs);
-        inst[13] = gen_instr_J(J   , address + 15); // go to inst[15]
-        inst[14] = gen_instr_R(JR  , AT, R0);           // R0 is used as don't care
-        inst[15] = gen_instr_O(opfunc, rd, R0, 0b1111); // go to inst[14] if EQ or NE
+    int inst[EXPANDMAX];
+    struct expansion* x = expansion_of(opfunc);
+
+    if (x->bits)
+        mif_asm_gen_message(x->bits, num);
+    else
+        mif_pseudo_message();
+    int i, n;
+    if (is_branch(opfunc) && !is_autogen(num, opfunc, address)) {
+        n = 0;  // a BEQ or BNE that fits now: the offset counts from the branch, so pad behind it
+        inst[n++] = gen_instr_O(opfunc, ops->rd, ops->rs, num & 0x000f);
+        while (n < grow / 2 + 1)
+            inst[n++] = gen_instr_R(AND, AT, R0);
     }
-    else { // LW, LB, SW, SB
-        inst[12] = gen_instr_R(ADD , AT, rs);           // $at = $rs + $at (num)
-        inst[13] = gen_instr_O(opfunc, rd, AT, 0);
+    else {
+        int value = expansion_value(opfunc, num, address);
+        n = expand(x, ops, value, grow, inst);
+        if (n > 1 && is_branch(opfunc) && (ops->rd == AT || ops->rs == AT) && slot_used(&x->seq[0], ops, value))
+            oops2("autogen: a far branch loads its target into $at, it cannot compare $at", ops->op->str)
     }
 
-    int i = 0;
-    for (; inst[i] != 0; i++)
-    {
-        if (fp) write_mif(address, inst[i], concat2("asm", decode(inst[i])), fp);
+    if (fp && at_reuse)
+        peep_message((autogen_increase(num, opfunc, ops) - grow) / 2, num);
+    if (fp && x->bits) {
+        autogen_sites++;
+        autogen_bytes += grow;
+        autogen_saved += opfunc_to_increase(opfunc) - grow;
+    }
+    for (i = 0; i < n; i++) {
+        if (fp) write_mif(address, inst[i], annotating() ? concat2("asm", decode(inst[i])) : NULL, fp);
         address += 2;
     }
     update_address(address);
-    return 0;
+    mif_blank_message();
+    return EXPANDED;
+}
+
+/* return the site whose value $at holds after the expansion of ops: site if
+   it loads the value there, at_src if it leaves $at alone, -1 otherwise */
+static int at_after(struct expansion* x, struct operands* ops, int site)
+{
+    int src = at_src;
+    struct slot* s;
+    for (s = x->seq; s < x->seq + TSLOTS && s->kind != T_NONE; s++) {
+        if (s->flags & S_NEAR)
+            continue;                              // $at only holds the value on the far form
+        if (s->kind == T_CONST)
+            src = s->a == AT ? site : slot_operand(s->a, ops, 0) == AT ? -1 : src;
+        else if ((s->flags & S_OPT) && slot_operand(s->b, ops, 0) == R0)
+            continue;                              // ADD $at, $r0
+        else if (clobbers_at(slot_word(s, ops, 0)))
+            src = -1;
+    }
+    return src;
 }
 
 
@@ -353,29 +514,6 @@ int gen_instr_O(int opfunc, int rd, int rs, int offs)
 * Data Conversion Helper Functions 
 */
 
-/* helper to slice and copy string */
-void slice_cpy(char* src, char* dst, int start, int end)
-{
-    int i, j;
-    for (i = start, j = 0; i < end; i++, j++) {    
-        if (isspace(src[i]))  // sometimes src includes trailing spaces, so remove them
-            break;
-        dst[j] = src[i];
-    }
-    dst[j] = '\0';
-}
-
-/* helper to convert register str to int */
-int reg_to_int(char* str)
-{
-    int i;                                 
-    for (i = 0; i < REGNUM; i++) {
-        if (strcmp(registers[i], str) == 0)
-            return i;
-    }
-    oops("reg_to_int: unexpected register")
-}
-
 
 /* helper to convert instruction to int */
 int word_to_int(char* str)
@@ -388,20 +526,11 @@ int word_to_int(char* str)
     return rv;
 }
 
-/* helper to get autogen boundary */
-int opfunc_to_boundary(int num)
+/* Helper to get autogen address increase of the longest expansion of opfunc */
+int opfunc_to_increase(int opfunc)
 {
-    int op = (num & 0x3c) >> 2;
-    int func = num & 0x3;
-    return autogen_boundary_list[op][func];    
-}
-
-/* Helper to get autogen address increase */
-int opfunc_to_increase(int num)
-{
-    int op = (num & 0x3c) >> 2;
-    int func = num & 0x3;
-    return addr_increase_list[op][func];    
+    struct expansion* x = expansion_of(opfunc);
+    return x ? 2 * expansion_max(x) - 2 : 0;
 }
 
 /* Check if autogen needed */
@@ -412,7 +541,7 @@ int opfunc_to_increase(int num)
  */
 int is_autogen(int num, int opfunc, int address)
 {
-    int boundary = opfunc_to_boundary(opfunc);
+    struct expansion* x = expansion_of(opfunc);
 
     // if ((opfunc == J) || (opfunc == JAL)) {
     //     uint16_t addr_part = (address + 2) & 0xFC00;
@@ -423,8 +552,173 @@ int is_autogen(int num, int opfunc, int address)
     //         return 0;
     // }
 
-    if (abs(num) > boundary)
+    if (x != NULL && is_branch(opfunc))
+        return num < -x->limit - 1 || num > x->limit;  // 4 signed bits
+    if (x != NULL && abs(num) > x->limit)
         return 1;  // YES
     return 0;      // NO
 }
 
+/* Return address increase of the autogen of ops for num, 0 if none is needed.
+   ops NULL for the longest with any registers */
+int autogen_increase(int num, int opfunc, struct operands* ops)
+{
+    if (!is_autogen(num, opfunc, get_address()))
+        return 0;
+    return 2 * expansion_size(expansion_of(opfunc), ops, expansion_value(opfunc, num, get_address()), 0) - 2;
+}
+
+/*
+  name:    autogen_why
+  purpose: tell why the instruction of ops took words words, for the map (map.c)
+  field:   num       - its operand value at its final address, the current one
+           words     - words the 2nd path wrote for it
+           buf, size - where the reason goes
+*/
+void autogen_why(struct operands* ops, int num, int words, char* buf, int size)
+{
+    int opfunc = ops->op->opfunc;
+    struct expansion* x = expansion_of(opfunc);
+    num = branch_offset(opfunc, ops->expr, num, get_address());
+    int need = x && is_autogen(num, opfunc, 0) ? expansion_size(x, ops, expansion_value(opfunc, num, get_address()), 0) : 1;
+    int n;
+    if (x == NULL || x->limit < 0)
+        n = snprintf(buf, size, "pseudo-instruction");
+    else if (words < need)
+        n = snprintf(buf, size, "$at holds %d already (-O1)", num);
+    else if (need == 1)
+        n = snprintf(buf, size, "%d fits, kept long by relaxation", num);
+    else if (is_branch(opfunc))
+        n = snprintf(buf, size, "offset %d words out of %d to %d", num, -x->limit - 1, x->limit);
+    else if (opfunc == J || opfunc == JAL)
+        n = snprintf(buf, size, "target 0x%04x > 0x%x, 0x%x over", num & 0xffff, x->limit, (num & 0xffff) - x->limit);
+    else
+        n = snprintf(buf, size, "%d > %d, %d over", abs(num), x->limit, abs(num) - x->limit);
+    if (words > need && need > 1 && n < size)
+        snprintf(buf + n, size - n, ", padded by relaxation");
+}
+
+/* Return address increase of the instruction on the current line */
+/*
+    A label or '$' operand, or any autogen with the peephole on, is sized
+    by relax.c: on 1st path it is recorded as a site and kept short, on 2nd
+    path it takes the size chosen there, which never falls below what its
+    value needs unless $at already holds the value (at_reuse).
+ */
+int autogen_growth(struct operands* ops, int num)
+{
+    int opfunc = ops->op->opfunc;
+    int need = autogen_increase(num, opfunc, ops);
+    at_reuse = 0;
+    // a branch that does not fit expands for its target, which moves with the code
+    if (!relax_deps() && !(get_optimize() && need) && !(is_branch(opfunc) && need)) {
+        if (get_optimize() && get_fp() == NULL && branch_target(opfunc, num, 0) >= 0)
+            relax_branch(opfunc, num);             // may go to an address without a label
+        return need;
+    }
+    if (get_fp() == NULL) {
+        struct expansion* x = expansion_of(opfunc);
+        // only an expansion that loads the value into $at can find it there
+        int src = get_optimize() && x && x->seq[0].kind == T_CONST && x->seq[0].a == AT &&
+                  !is_branch(opfunc) ? at_src : -1;
+        int site = relax_site(opfunc, ops->expr, ops, src, reuse_increase(ops));
+        at_src = get_optimize() && x ? at_after(x, ops, site) : -1;
+        return 0;
+    }
+    int grow = relax_next_grow(&at_reuse);
+    if (at_reuse)
+        return grow;
+    return grow > need ? grow : need;
+}
+
+/* Helper to get the address increase of the autogen of ops when $at holds the value */
+int reuse_increase(struct operands* ops)
+{
+    struct expansion* x = expansion_of(ops->op->opfunc);
+    return x ? 2 * expansion_size(x, ops, -1, 1) - 2 : 0;  // -1: not a J target
+}
+
+/* Return the byte address a J, JAL, BEQ or BNE at address goes to, -1 for others.
+   num of a branch is in words from itself, expanded or not */
+int branch_target(int opfunc, int num, int address)
+{
+    if (opfunc == J || opfunc == JAL)
+        return num & 0xffff;
+    if (is_branch(opfunc))
+        return (address + 2 * num) & 0xffff;
+    return -1;
+}
+
+/* Return 1 for BEQ and BNE */
+int is_branch(int opfunc)
+{
+    return opfunc == BEQ || opfunc == BNE;
+}
+
+/* Return the operand num of e for the instruction at address: a BEQ or BNE
+   to a value that moves with the code goes there, as the words from itself */
+int branch_offset(int opfunc, struct expr* e, int num, int address)
+{
+    if (!is_branch(opfunc) || e == NULL || expr_weight(e) == 0)
+        return num;
+    return (int16_t) (num - address) / 2;
+}
+
+/* Helper to get the value an expansion of num at address works with: the target of a branch */
+static int expansion_value(int opfunc, int num, int address)
+{
+    return is_branch(opfunc) ? branch_target(opfunc, num, address) : num;
+}
+
+/* Helper to check if instr writes $at or leaves the block */
+static int clobbers_at(int instr)
+{
+    int opfunc = (instr >> 10) & 0x3f;
+    int rd = (instr >> 6) & 0xf;
+    if (opfunc < SYS || opfunc == MFHI || opfunc == MFLO)
+        return rd == AT;
+    if (opfunc == LW || opfunc == LB)
+        return rd >> 1 == AT;                      // O_TYPE rd is 3 bits
+    return opfunc != SYS && opfunc != SW && opfunc != SB && opfunc != MTHI && opfunc != MTLO;
+}
+
+/* Forget $at at a label or directive, which starts a new basic block */
+void at_forget()
+{
+    at_src = -1;
+}
+
+/* Forget $at after an instruction that writes it or leaves the block */
+void at_track(int instr)
+{
+    if (clobbers_at(instr))
+        at_forget();                               // jumps and branches too
+}
+
+/* Forget $at after a word encoded by parser -c, a branch in it is recorded
+   like one with a constant operand (asm.c) */
+void at_word(int instr)
+{
+    int opfunc = (instr >> 10) & 0x3f;
+    if (get_optimize() && (opfunc == J || opfunc == JAL))
+        relax_branch(opfunc, instr & 0x03ff);
+    else if (get_optimize() && (opfunc == BEQ || opfunc == BNE))
+        relax_branch(opfunc, ((instr & 0x000f) ^ 0x8) - 0x8);  // 4-bit signed offset
+    at_track(instr);
+}
+
+/* Report autogen statistics */
+void autogen_stats(int* sites, int* bytes, int* saved)
+{
+    *sites = autogen_sites;
+    *bytes = autogen_bytes;
+    *saved = autogen_saved;
+}
+
+/* Add the statistics another thread counted */
+void autogen_merge(int sites, int bytes, int saved)
+{
+    autogen_sites += sites;
+    autogen_bytes += bytes;
+    autogen_saved += saved;
+}
@@ -5,12 +5,31 @@
 #ifndef ENCODER_INCL
 #define ENCODER_INCL
 
+struct operands;  // lexer.h
+
+#define EXPANDED   -1   // encode wrote an expansion, the address moved past it
+#define EXPANDMAX  10   // longest expansion in words, SYNTHMAX and 4 slots
+
 /* instruction encoding functions */
-int encode_blank(char*, regmatch_t*);
-int encode_R1(char*, regmatch_t*);
-int encode_R2(char*, regmatch_t*);
-int encode_I(char*, regmatch_t*);
-int encode_J(char*, regmatch_t*);
-int encode_O(char*, regmatch_t*);
+int encode(struct operands*);
+int encode_fixed(struct operands*, int* inst);
+int encode_R1(struct operands*);
+int encode_R2(struct operands*);
+int encode_I(struct operands*);
+int encode_J(struct operands*);
+int encode_O(struct operands*);
+int encode_P(struct operands*);
+
+/* $at tracking for the peephole */
+void at_forget();
+void at_track(int instr);
+void at_word(int instr);
+
+/* autogen statistics: sites expanded, bytes added, bytes saved over the longest expansion */
+void autogen_stats(int* sites, int* bytes, int* saved);
+void autogen_merge(int sites, int bytes, int saved);
+
+/* why an instruction expanded, for the map (map.c) */
+void autogen_why(struct operands* ops, int num, int words, char* buf, int size);
 
 #endif /* ENCODER_INCL */
\ No newline at end of file
@@ -0,0 +1,389 @@
+/*
+ * expr.c -- operand expressions parsed once into trees
+ *
+ * The lexer hands every operand and directive argument to expr_parse,
+ * which builds a tree by precedence climbing, lowest first:
+ *
+ *     |    ^    &    + -    * / %    unary - ~    primary
+ *
+ * Binary operators are left associative. A primary is a number (decimal,
+ * 0x hex, 0b binary, 0 octal), a character in single quotes, '$' for the
+ * location counter, a label, or an expression in parentheses.
+ *
+ * Subtrees without a label or '$' are folded into one number while
+ * parsing, so evaluating a tree again after relaxation only walks the
+ * label dependent nodes. Labels are kept as symbol ids and read straight
+ * from the symbol table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "expr.h"
+#include "symtab.h"
+#include "strfunc.h"
+#include "common.h"
+
+/* Helper function declarations */
+void* emalloc(size_t n);                            // defined in linkedlist.c
+
+extern int   get_address();                         // defined in asm.c
+extern FILE* get_fp();                              // defined in asm.c
+extern void  relax_dep(int sym);                    // defined in relax.c
+
+/* file scope variables */
+static char  errstr[STRLEN];    /* last parse error, empty if none */
+static char* errpos;            /* where it happened */
+
+static struct expr* binary(char** pp, int min);
+
+
+/**
+* Helper Functions
+*/
+
+/* skip blanks */
+static char* skip_space(char* p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+/* record the first error at p and return NULL */
+static struct expr* fail(char* p, char* msg)
+{
+    if (errpos == NULL) {
+        errpos = p;
+        snprintf(errstr, sizeof errstr, "%s", msg);
+    }
+    return NULL;
+}
+
+/* binding strength of a binary operator, 0 if c is none */
+static int prec(char c)
+{
+    switch (c) {
+        case '*': case '/': case '%': return 5;
+        case '+': case '-':           return 4;
+        case '&':                     return 3;
+        case '^':                     return 2;
+        case '|':                     return 1;
+        default:                      return 0;
+    }
+}
+
+/* apply a binary operator. dividing by zero gives 0 */
+static int operate(int l, int r, char op)
+{
+    switch (op) {
+        case '*': return l * r;
+        case '/': return r ? l / r : 0;
+        case '%': return r ? l % r : 0;
+        case '+': return l + r;
+        case '-': return l - r;
+        case '&': return l & r;
+        case '^': return l ^ r;
+        default:  return l | r;
+    }
+}
+
+/* new node */
+static struct expr* node(int kind, int op, int num, struct expr* l, struct expr* r)
+{
+    struct expr* e = emalloc(sizeof(struct expr));
+    e->kind = kind;
+    e->op = op;
+    e->num = num;
+    e->l = l;
+    e->r = r;
+    return e;
+}
+
+/* fold a node whose operands are numbers into a number */
+static struct expr* fold(struct expr* e)
+{
+    if (e->l->kind != E_NUM || (e->kind == E_BIN && e->r->kind != E_NUM))
+        return e;
+    int num = e->kind == E_NEG ? -e->l->num :
+              e->kind == E_NOT ? ~e->l->num : operate(e->l->num, e->r->num, e->op);
+    expr_free(e->l);
+    expr_free(e->r);
+    e->kind = E_NUM;
+    e->num = num;
+    e->l = e->r = NULL;
+    return e;
+}
+
+/* value of label id, 0 on the 1st path while it is not defined yet */
+static int sym_value(int id)
+{
+    struct symbol* s = sym_get(id);
+    relax_dep(id);  // relax.c
+    if (s->defined) return s->num;
+    if (get_fp() != NULL) oops2("expr: undefined label", s->str)
+    return 0;
+}
+
+/* number in decimal, 0x hex, 0b binary or 0 octal */
+static struct expr* number(char** pp)
+{
+    char* p = *pp;
+    char* e;
+    long n;
+
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        n = strtol(p + 2, &e, 16);
+    else if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B'))
+        n = strtol(p + 2, &e, 2);
+    else {
+        int base = *p == '0' ? 8 : 10;
+        for (e = p; isdigit((unsigned char) *e); e++) {
+            if (*e > '7') base = 10;  // 09 reads as decimal
+        }
+        n = strtol(p, NULL, base);
+    }
+    if (e == p + 2 && !isdigit((unsigned char) p[1]))
+        return fail(p, "bad number");
+    if (isalnum((unsigned char) *e) || *e == '_')
+        return fail(e, "bad number");
+    *pp = e;
+    return node(E_NUM, 0, (int) n, NULL, NULL);
+}
+
+/* character in single quotes, '\n' style escapes included */
+static struct expr* character(char** pp)
+{
+    char* p = *pp + 1;
+    int c = (unsigned char) *p;
+
+    if (c == '\0' || (c == '\\' && p[1] == '\0'))
+        return fail(*pp, "unterminated character");
+    p++;
+    if (c == '\\') {
+        switch (*p++) {
+            case 'n':  c = '\n'; break;
+            case 't':  c = '\t'; break;
+            case 'r':  c = '\r'; break;
+            case '0':  c = '\0'; break;
+            case '\\': c = '\\'; break;
+            case '\'': c = '\''; break;
+            default:   return fail(p - 2, "unknown escape");
+        }
+    }
+    if (*p != '\'')
+        return fail(*pp, "expected one character in quotes");
+    *pp = p + 1;
+    return node(E_NUM, 0, c, NULL, NULL);
+}
+
+/* number, character, '$', label or (expression) */
+static struct expr* primary(char** pp)
+{
+    char* p = skip_space(*pp);
+    struct expr* e;
+
+    *pp = p;
+    if (isdigit((unsigned char) *p))
+        return number(pp);
+    if (*p == '\'')
+        return character(pp);
+    if (*p == '$') {
+        *pp = p + 1;
+        return node(E_PC, 0, 0, NULL, NULL);
+    }
+    if (isalpha((unsigned char) *p) || *p == '_') {
+        struct strview name = { p, 0 };
+        while (isalnum((unsigned char) p[name.len]) || p[name.len] == '_') name.len++;
+        *pp = p + name.len;
+        return node(E_SYM, 0, sym_id(view_str(name)), NULL, NULL);  // symtab.c
+    }
+    if (*p == '(') {
+        *pp = p + 1;
+        if ((e = binary(pp, 1)) == NULL)
+            return NULL;
+        p = skip_space(*pp);
+        if (*p != ')') {
+            expr_free(e);
+            return fail(p, "expected ')'");
+        }
+        *pp = p + 1;
+        return e;
+    }
+    return fail(p, "expected expression");
+}
+
+/* unary - or ~ in front of a primary */
+static struct expr* unary(char** pp)
+{
+    char* p = skip_space(*pp);
+    struct expr* e;
+
+    if (*p != '-' && *p != '~')
+        return primary(pp);
+    *pp = p + 1;
+    if ((e = unary(pp)) == NULL)
+        return NULL;
+    return fold(node(*p == '-' ? E_NEG : E_NOT, 0, 0, e, NULL));
+}
+
+/* operators binding at least as strong as min, left to right */
+static struct expr* binary(char** pp, int min)
+{
+    struct expr* l = unary(pp);
+    struct expr* r;
+
+    while (l != NULL) {
+        char* p = skip_space(*pp);
+        int pr = prec(*p);
+        if (pr == 0 || pr < min)
+            break;
+        *pp = p + 1;
+        if ((r = binary(pp, pr + 1)) == NULL) {
+            expr_free(l);
+            return NULL;
+        }
+        if ((*p == '/' || *p == '%') && r->kind == E_NUM && r->num == 0) {
+            expr_free(l);
+            expr_free(r);
+            return fail(p, "division by zero");
+        }
+        l = fold(node(E_BIN, *p, 0, l, r));
+    }
+    return l;
+}
+
+
+/**
+* Shared functions (expr.h)
+*/
+
+/* parse the expression at str and set *end after it. on a syntax error
+   return NULL with *end at the error (see expr_error) */
+struct expr* expr_parse(char* str, char** end)
+{
+    char* p = str;
+    errpos = NULL;
+    errstr[0] = '\0';
+
+    struct expr* e = binary(&p, 1);
+    *end = e ? p : errpos;
+    return e;
+}
+
+/* last parse error, empty string if none */
+char* expr_error()
+{
+    return errstr;
+}
+
+/* value of e. labels and '$' are read now and recorded in relax.c */
+int expr_eval(struct expr* e)
+{
+    switch (e->kind) {
+        case E_NUM: return e->num;
+        case E_SYM: return sym_value(e->num);
+        case E_PC:  relax_dep(-1); return get_address();
+        case E_NEG: return -expr_eval(e->l);
+        case E_NOT: return ~expr_eval(e->l);
+        default:    return operate(expr_eval(e->l), expr_eval(e->r), e->op);
+    }
+}
+
+/* write e to buf in a form expr_parse reads back, without blanks.
+   return the length, as snprintf */
+int expr_print(struct expr* e, char* buf, int size)
+{
+    switch (e->kind) {
+        case E_NUM: return snprintf(buf, size, e->num < 0 ? "(%d)" : "%d", e->num);
+        case E_SYM: return snprintf(buf, size, "%s", sym_get(e->num)->str);
+        case E_PC:  return snprintf(buf, size, "$");
+    }
+#define REST(n) buf + ((n) < size ? (n) : size), (n) < size ? size - (n) : 0
+    int n = snprintf(buf, size, "(%s", e->kind == E_NEG ? "-" : e->kind == E_NOT ? "~" : "");
+    n += expr_print(e->l, REST(n));
+    if (e->kind == E_BIN) {
+        n += snprintf(REST(n), "%c", e->op);
+        n += expr_print(e->r, REST(n));
+    }
+    n += snprintf(REST(n), ")");
+    return n;
+#undef REST
+}
+
+/* how far the value of e moves when every relocatable label and '$' move
+   by 1. 0 for a distance, EXPR_MOVES if not by a fixed amount */
+int expr_weight(struct expr* e)
+{
+    long l, r, w;
+    switch (e->kind) {
+        case E_NUM: return 0;
+        case E_SYM: return sym_get(e->num)->reloc != 0;
+        case E_PC:  return 1;
+        case E_NEG:
+        case E_NOT: l = expr_weight(e->l); return l == EXPR_MOVES ? EXPR_MOVES : -l;
+    }
+    l = expr_weight(e->l);
+    r = expr_weight(e->r);
+    if (l == 0 && r == 0) return 0;  // a distance, whatever the operator
+    if (l == EXPR_MOVES || r == EXPR_MOVES) return EXPR_MOVES;
+    switch (e->op) {
+        case '+': w = l + r; break;
+        case '-': w = l - r; break;
+        case '*':
+            if (e->l->kind == E_NUM) { w = e->l->num * r; break; }
+            if (e->r->kind == E_NUM) { w = l * e->r->num; break; }
+            // fall through
+        default:  return EXPR_MOVES;
+    }
+    return labs(w) < EXPR_MOVES ? w : EXPR_MOVES;
+}
+
+/* return 1 if e was folded to a number */
+int expr_const(struct expr* e)
+{
+    return e->kind == E_NUM;
+}
+
+/* return a copy of tree e, NULL for NULL */
+struct expr* expr_copy(struct expr* e)
+{
+    if (e == NULL) return NULL;
+    return node(e->kind, e->op, e->num, expr_copy(e->l), expr_copy(e->r));
+}
+
+void expr_free(struct expr* e)
+{
+    if (e == NULL) return;
+    expr_free(e->l);
+    expr_free(e->r);
+    free(e);
+}
+
+
+/* DEBUG: uncomment to test in main function in parser.c */
+void expr_test()
+{
+    ps(__func__)
+
+    char* tests[] = {
+        "1", "1+2", " (1) +2", "(1)+(2)", "1+(2)", "3*4", "1+2*3", "1+(2+3)*4",
+        "(2+3) *4", "((1))", "(((1)))", "1+2+3+4+2*(3+4)+5", "1*(2*(3+4)+5)+6",
+        "(0x2*(010+0b10)+0b101*2)", " ( 0x2 * ( 010 + 0b10 ) + 0b101 * 2 ) ",
+        "0x10 + 0x4", "0b0111", "1-2*3+4", "8-4-2", "-1+2", "~0 & 0xff", "'-'",
+        "'\\n'", "0xf000 | 0x0700", "1/0", "(1", "1 +", "12ab", "label + 4",
+    };
+    int i;
+    char* end;
+    for (i = 0; i < (int) (sizeof tests / sizeof tests[0]); i++) {
+        struct expr* e = expr_parse(tests[i], &end);
+        if (e == NULL)
+            printf("[%s] col %d: %s\n", tests[i], (int) (end - tests[i]) + 1, expr_error());
+        else if (expr_const(e))
+            printf("[%s] = %d\n", tests[i], expr_eval(e));
+        else
+            printf("[%s] depends on labels\n", tests[i]);
+        expr_free(e);
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * expr.h -- operand expressions parsed once into trees
+ */
+
+#ifndef EXPR_INCL
+#define EXPR_INCL
+
+#define EXPR_MOVES 0x100  // expr_weight of a value that moves in no fixed way
+
+/* node kinds */
+enum expr_kind { E_NUM, E_SYM, E_PC, E_NEG, E_NOT, E_BIN };
+
+/*
+  name:    expr
+  purpose: one node of an expression tree
+  field:   kind - enum expr_kind
+           op   - E_BIN: operator character (* / % + - & ^ |)
+           num  - E_NUM: value, E_SYM: symbol id (symtab.c)
+           l, r - operands, r for E_BIN only
+*/
+struct expr {
+    char  kind;
+    char  op;
+    int   num;
+    struct expr* l;
+    struct expr* r;
+};
+
+struct expr* expr_parse(char* str, char** end);
+char* expr_error();
+int   expr_eval(struct expr* e);
+int   expr_const(struct expr* e);
+int   expr_weight(struct expr* e);
+int   expr_print(struct expr* e, char* buf, int size);
+struct expr* expr_copy(struct expr* e);
+void  expr_free(struct expr* e);
+void  expr_test();    // DEBUG
+
+#endif /* EXPR_INCL */
@@ -0,0 +1,308 @@
+/*
+ * ir.c -- source program read once into statement records
+ *
+ * ir_read loads the whole file with one read, cuts it into lines in place
+ * and lexes every line into a struct stmt, operands and directive
+ * arguments parsed into expression trees. Relaxation (pass 1) and encoding
+ * (pass 2) both walk this array, so the file is not read twice and no line
+ * is split, matched or hashed again. Statement text points into the source
+ * buffer and stays valid until ir_free.
+ *
+ * Every line passes the macro processor (macro.c) first, which records
+ * .macro and .rept bodies and hands their expansions and the files of
+ * .include back here, so the passes only ever see plain statements.
+ *
+ * min16-ld builds the same array from object files with ir_append, one
+ * module after another, and links it with the same two passes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "ir.h"
+#include "macro.h"
+#include "expr.h"
+#include "common.h"
+
+#define STMTS   256     // statement and buffer slots added at a time
+
+/* file scope variables */
+static char**       sources = NULL;  /* whole files, lines cut at '\n' */
+static int          nsources = 0;
+static char**       files = NULL;    /* real paths of the files read */
+static int          nfiles = 0;
+static char*        current = NULL;  /* file being read, for .include */
+static struct stmt* stmts = NULL;    /* one record per line */
+static int          nstmts = 0;
+static int          maxstmts = 0;
+static char**       texts = NULL;    /* statement text copied by ir_append */
+static int          ntexts = 0;
+
+
+/**
+* Helper Functions
+*/
+
+/* read the whole file into a '\0' terminated buffer */
+static char* slurp(char* filename, long* size)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) oops("fopen failed..")
+    if (fseek(fp, 0, SEEK_END) != 0 || (*size = ftell(fp)) < 0)
+        oops("ftell");
+    rewind(fp);
+
+    char* buf = malloc(*size + 1);
+    if (buf == NULL) oops("malloc");
+    if ((long) fread(buf, 1, *size, fp) != *size)
+        oops("fread");
+    buf[*size] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+
+/* add a statement for text at line, text not copied */
+static struct stmt* add_stmt(char* text, int line)
+{
+    if (nstmts == maxstmts) {
+        maxstmts = maxstmts ? maxstmts * 2 : STMTS;
+        if ((stmts = realloc(stmts, maxstmts * sizeof(struct stmt))) == NULL)
+            oops("realloc");
+    }
+    struct stmt* st = &stmts[nstmts++];
+    memset(st, 0, sizeof(struct stmt));
+    st->text = text;
+    st->line = line;
+    st->kind = ST_BLANK;
+    st->sym = st->dir = -1;
+    return st;
+}
+
+/* return 1 if path was read already, else remember it */
+static int read_before(char* path)
+{
+    char real[PATH_MAX];
+    int i;
+    if (realpath(path, real) == NULL)
+        snprintf(real, sizeof real, "%s", path);
+    for (i = 0; i < nfiles; i++) {
+        if (strcmp(files[i], real) == 0) return 1;
+    }
+    if ((files = realloc(files, (nfiles + 1) * sizeof(char*))) == NULL ||
+        (files[nfiles++] = strdup(real)) == NULL)
+        oops("realloc");
+    return 0;
+}
+
+/*
+  read filename and hand every line to the macro processor (macro.c), or
+  lex it. lines of an included file take line at of its .include, the
+  source file numbers its own lines from 1
+*/
+static void read_file(char* filename, int at, int depth)
+{
+    long size;
+    int n = 0;
+
+    if (read_before(filename)) {  // include guard
+        fprintf(stderr, "include: %s is read already, the .include at line %d is skipped\n", filename, at);
+        return;
+    }
+    char* saved = current;
+    current = files[nfiles - 1];
+    if (nsources % STMTS == 0 &&
+        (sources = realloc(sources, (nsources + STMTS) * sizeof(char*))) == NULL)
+        oops("realloc");
+    char* source = sources[nsources++] = slurp(filename, &size);
+
+    // same lines getline would return, without the newline
+    char* p = source;
+    while (p < source + size) {
+        char* nl = strchr(p, '\n');
+        if (nl) *nl = '\0';
+        int line = at ? at : ++n;
+        if (!macro_line(p, line, depth))  // macro.c
+            ir_lex(p, line, 0);
+        p = nl ? nl + 1 : source + size;
+    }
+    current = saved;
+}
+
+
+/**
+* Shared functions (ir.h)
+*/
+
+/* read and lex filename once, macros, .rept and .include expanded
+   (macro.c). return the number of statements */
+int ir_read(char* filename)
+{
+    ir_free();
+    macro_init();
+    read_file(filename, 0, 0);
+    macro_end();        // a .macro or .rept left open
+    macro_free();
+    return nstmts;
+}
+
+/*
+  name:    ir_include
+  purpose: read the file an .include names, relative to the file including
+           it. a file is read once, as if it had an include guard
+  field:   filename - name in the .include
+           line     - line of the .include, given to every statement
+           depth    - nesting of macros and includes
+  return:  0, or -1 if the file cannot be read (nothing is added)
+*/
+int ir_include(char* filename, int line, int depth)
+{
+    char path[PATH_MAX];
+    char* slash = strrchr(current, '/');
+    if (filename[0] != '/' && slash)
+        snprintf(path, sizeof path, "%.*s/%s", (int) (slash - current), current, filename);
+    else
+        snprintf(path, sizeof path, "%s", filename);
+    if (access(path, R_OK) < 0)
+        return -1;
+    read_file(path, line, depth);
+    return 0;
+}
+
+/* lex text into a new statement at line. text is copied if copy is 1,
+   else it must stay valid until ir_free */
+struct stmt* ir_lex(char* text, int line, int copy)
+{
+    struct stmt* st = copy ? ir_append(text, line) : add_stmt(text, line);
+    lex_line(st->text, st);
+    return st;
+}
+
+/* append a copy of statement i at line, as ir_lex of its text would.
+   return the index of the copy */
+int ir_copy(int i, int line)
+{
+    int j;
+    struct stmt* st = ir_append(stmts[i].text, line);
+    struct stmt* from = &stmts[i];  // after ir_append, which may move the array
+    st->kind = from->kind;
+    st->label = from->label;
+    st->sym = from->sym;
+    st->dir = from->dir;
+    st->ops = from->ops;
+    st->ops.expr = expr_copy(from->ops.expr);
+    st->word = from->word;
+    if (from->error && (st->error = strdup(from->error)) == NULL)
+        oops("strdup");
+    if (from->nargs > 0 && (st->args = malloc(from->nargs * sizeof(struct arg))) == NULL)
+        oops("malloc");
+    for (j = 0; j < from->nargs; j++) {
+        st->args[j].expr = expr_copy(from->args[j].expr);
+        if ((st->args[j].text = strdup(from->args[j].text)) == NULL)
+            oops("strdup");
+    }
+    st->nargs = from->nargs;
+    return nstmts - 1;
+}
+
+/* add an error statement for text (copied) at line */
+void ir_error(char* text, int line, char* msg)
+{
+    struct stmt* st = ir_append(text, line);
+    st->kind = ST_ERROR;
+    if ((st->error = strdup(msg)) == NULL)
+        oops("strdup");
+}
+
+/* name of the i-th file read, the source first and then its includes.
+   NULL after the last */
+char* ir_file(int i)
+{
+    return i < nfiles ? files[i] : NULL;
+}
+
+/* append an empty statement for text (copied) at line. the pointer is
+   valid until the next ir_append */
+struct stmt* ir_append(char* text, int line)
+{
+    if (ntexts % STMTS == 0 && (texts = realloc(texts, (ntexts + STMTS) * sizeof(char*))) == NULL)
+        oops("realloc");
+    if ((texts[ntexts] = strdup(text)) == NULL)
+        oops("strdup");
+    return add_stmt(texts[ntexts++], line);
+}
+
+/* number of statements, one per source line */
+int ir_count()
+{
+    return nstmts;
+}
+
+/* statement i, line i + 1 of a source file */
+struct stmt* ir_get(int i)
+{
+    return &stmts[i];
+}
+
+/* helper to free what the lexer parsed for st */
+static void free_stmt(struct stmt* st)
+{
+    int j;
+    for (j = 0; j < st->nargs; j++) {
+        expr_free(st->args[j].expr);
+        free(st->args[j].text);
+    }
+    free(st->args);
+    expr_free(st->ops.expr);
+    free(st->error);
+}
+
+/* remove statement i for every drop[i] that is not 0, keeping the order (strip.c) */
+void ir_remove(char* drop)
+{
+    int i, n = 0;
+    for (i = 0; i < nstmts; i++) {
+        if (drop[i])
+            free_stmt(&stmts[i]);
+        else
+            stmts[n++] = stmts[i];
+    }
+    nstmts = n;
+}
+
+/* put statement order[i] at i, every statement once (layout.c) */
+void ir_order(int* order)
+{
+    int i;
+    if (nstmts == 0) return;
+    struct stmt* moved = malloc(nstmts * sizeof(struct stmt));
+    if (moved == NULL) oops("malloc");
+    for (i = 0; i < nstmts; i++)
+        moved[i] = stmts[order[i]];
+    free(stmts);
+    stmts = moved;
+    maxstmts = nstmts;
+}
+
+/* release the source buffer and the statements */
+void ir_free()
+{
+    int i;
+    for (i = 0; i < nstmts; i++)
+        free_stmt(&stmts[i]);
+    for (i = 0; i < ntexts; i++)
+        free(texts[i]);
+    for (i = 0; i < nsources; i++)
+        free(sources[i]);
+    for (i = 0; i < nfiles; i++)
+        free(files[i]);
+    free(texts);
+    free(sources);
+    free(files);
+    free(stmts);
+    stmts = NULL;
+    texts = sources = files = NULL;
+    nstmts = maxstmts = ntexts = nsources = nfiles = 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * ir.h -- source program read once into statement records
+ */
+
+#ifndef IR_INCL
+#define IR_INCL
+
+#include "lexer.h"
+
+/* what lex_line found on a line */
+enum stmt_kind {
+    ST_BLANK, ST_LABEL, ST_DIRECTIVE, ST_INSTR, ST_UNKNOWN, ST_ERROR, ST_WORD,
+};
+
+/*
+  name:    arg
+  purpose: one directive argument
+  field:   expr - parsed argument (expr.c)
+           text - argument as written, for the mif file
+*/
+struct arg {
+    struct expr* expr;
+    char* text;
+};
+
+/*
+  name:    stmt
+  purpose: one source line, classified once by the lexer
+  field:   text  - the line without its newline, inside the source buffer
+           line  - line number from 1, of the .include or macro call it came from
+           kind  - enum stmt_kind
+           label - 1 if the line defines a label
+           sym   - symbol id of that label (symtab.c), else -1
+           dir   - directive id (lexer.h) for ST_DIRECTIVE, else -1
+           ops   - mnemonic and operands for ST_INSTR
+           args  - ST_DIRECTIVE: nargs arguments (none for .ascii, .asciiz)
+           word  - ST_WORD: instruction encoded by parser -c (obj.c)
+           error - syntax error with its column for ST_ERROR, else NULL
+*/
+struct stmt {
+    char* text;
+    int   line;
+    int   kind;
+    int   label;
+    int   sym;
+    int   dir;
+    struct operands ops;
+    struct arg* args;
+    int   nargs;
+    int   word;
+    char* error;
+};
+
+int   ir_read(char* filename);
+int   ir_include(char* filename, int line, int depth);
+struct stmt* ir_lex(char* text, int line, int copy);
+int   ir_copy(int i, int line);
+void  ir_error(char* text, int line, char* msg);
+char* ir_file(int i);
+struct stmt* ir_append(char* text, int line);
+int   ir_count();
+struct stmt* ir_get(int i);
+void  ir_remove(char* drop);
+void  ir_order(int* order);
+void  ir_free();
+
+#endif /* IR_INCL */
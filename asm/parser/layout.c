@@ -0,0 +1,361 @@
+/*
+ * layout.c -- profile-guided order of the code, parser -p and min16-ld -p
+ *
+ * J and JAL hold a 10 bit target (encoder.c), so a jump to a label past
+ * address 0x3ff is an autogen sequence that loads the address into $at
+ * and jumps through it. Given the instructions a run executed (emulator
+ * -m prefix -g 1 writes them to prefix.csv), the statements are put in an
+ * order that brings the most called code down where J reaches it.
+ *
+ * The statements are cut into regions as in strip.c: one starts at the
+ * first line, at every label and at every .org. Regions that must stay
+ * next to each other form a unit:
+ *
+ *     a region that runs into the next, not ending in J, JR, RET or data
+ *     the regions from a branch to where it lands
+ *     the regions of the labels (and '$') of one expression, .word end - start
+ *
+ * The first unit, a unit with .org and a unit that runs off the end of
+ * the source stay in place. The units between two of them move among
+ * themselves: the called ones first, most J and JAL the profile counted
+ * into their labels per byte, then the others in source order.
+ *
+ * Both orders are placed by the 1st path and addr_resolution (asm.c). An
+ * autogen sequence runs straight through, so the profile count of every
+ * instruction times the words it loses is the predicted drop in executed
+ * instructions, and the new order is kept only when it is positive. A J
+ * or JAL to a number, or an .equ of one, leaves the order alone. The
+ * profile must come from the same source, assembled with the same options
+ * and no -p.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "layout.h"
+#include "asm.h"
+#include "ir.h"
+#include "expr.h"
+#include "symtab.h"
+#include "common.h"
+
+/* opfunc of the instructions that move the pc (encoder.c) */
+#define OP_J     0b101000
+#define OP_JAL   0b101001
+#define OP_JR    0b101010
+#define OP_BEQ   0b101100
+#define OP_BNE   0b101101
+#define OP_RET   (PSEUDO | 3)
+
+#define MEMBYTES 0x10000    // byte addresses of the profile
+#define EQUDEPTH 16         // .equ of an .equ, followed this deep
+
+/* file scope variables */
+static long* execs;          /* profile count of every byte address */
+static int*  region;         /* region of every statement */
+static int*  first;          /* first statement of every region, and the end */
+static int   nregions;
+static char* joined;         /* region r stays in front of r + 1 */
+static int*  label_region;   /* region a label starts, by symbol id, -1 if none */
+static int*  equ_stmt;       /* statement of an .equ, by symbol id, -1 if none */
+static long* calls;          /* J and JAL into every unit, profile counted */
+static int*  size;           /* bytes of every unit */
+static int   ran;            /* 1 once layout_code ran */
+static int   moved, giveup_line;
+static long  saved;          /* executed instructions fewer, predicted */
+
+
+/**
+* Helper Functions
+*/
+
+/* opfunc of an instruction statement, encoded (obj.c) or not. -1 for others */
+static int opfunc_of(struct stmt* st)
+{
+    if (st->kind == ST_INSTR) return st->ops.op->opfunc;
+    if (st->kind == ST_WORD)  return (st->word >> 10) & 0x3f;
+    return -1;
+}
+
+/* return 1 if st writes data */
+static int is_data(struct stmt* st)
+{
+    return st->kind == ST_DIRECTIVE && (st->dir == DIR_WORD || st->dir == DIR_HALF ||
+           st->dir == DIR_BYTE || st->dir == DIR_ASCII || st->dir == DIR_ASCIIZ || st->dir == DIR_SPACE);
+}
+
+/* read the execs column of an emulator heatmap, one row per byte (-g 1) */
+static void read_profile(char* profile)
+{
+    FILE* fp = fopen(profile, "r");
+    if (!fp) oops(profile)
+    char line[STRLEN];
+    unsigned addr;
+    unsigned long long reads, writes, count;
+    while (fgets(line, sizeof line, fp)) {
+        if (sscanf(line, "0x%x,%llu,%llu,%llu", &addr, &reads, &writes, &count) == 4 && addr < MEMBYTES)
+            execs[addr] = count;
+    }
+    fclose(fp);
+}
+
+/* profile count of statement i placed at addr, an instruction starts on a word */
+static long count_at(int* addr, int i)
+{
+    int start = addr[i] + (addr[i] & 1);
+    return start < MEMBYTES ? execs[start] : 0;
+}
+
+/* instruction words of statement i placed at addr */
+static int words_at(int* addr, int i)
+{
+    return (addr[i + 1] - addr[i] - (addr[i] & 1)) / 2;
+}
+
+/* widen lo .. hi to the regions e names, '$' being region here */
+static void expr_span(struct expr* e, int here, int* lo, int* hi, int depth)
+{
+    if (e == NULL || depth > EQUDEPTH) return;
+    int r = e->kind == E_PC ? here : -1;
+    if (e->kind == E_SYM) {
+        r = label_region[e->num];
+        int equ = equ_stmt[e->num];
+        if (equ >= 0) expr_span(ir_get(equ)->args[0].expr, region[equ], lo, hi, depth + 1);
+    }
+    if (r >= 0 && r < *lo) *lo = r;
+    if (r > *hi) *hi = r;
+    expr_span(e->l, here, lo, hi, depth);
+    expr_span(e->r, here, lo, hi, depth);
+}
+
+/* widen lo .. hi to where a branch at statement i offset words away may land.
+   an instruction is one word at least, so it is at most offset instructions away */
+static void branch_span(int i, int offset, int* lo, int* hi)
+{
+    int step = offset < 0 ? -1 : 1;
+    int n = abs(offset) + 1;
+    for (; i >= 0 && i < ir_count() && n >= 0; i += step) {
+        if (region[i] < *lo) *lo = region[i];
+        if (region[i] > *hi) *hi = region[i];
+        if (opfunc_of(ir_get(i)) >= 0) n--;
+    }
+}
+
+/* keep regions lo .. hi next to each other */
+static void join(int lo, int hi)
+{
+    for (; lo < hi; lo++)
+        joined[lo] = 1;
+}
+
+/* join the regions statement i ties together */
+static void join_statement(int i)
+{
+    struct stmt* st = ir_get(i);
+    int j, lo, hi, here = region[i], op = opfunc_of(st);
+    for (j = 0; st->kind == ST_DIRECTIVE && j < st->nargs; j++) {
+        lo = nregions, hi = -1;
+        expr_span(st->args[j].expr, here, &lo, &hi, 0);
+        join(lo, hi);
+    }
+    if (op < 0) return;
+    struct expr* e = st->kind == ST_INSTR ? st->ops.expr : NULL;
+    int number = st->kind == ST_WORD || (e && expr_const(e));
+    lo = nregions, hi = -1;
+    if (op == OP_BEQ || op == OP_BNE)
+        lo = hi = here;
+    if ((op == OP_BEQ || op == OP_BNE) && number)
+        branch_span(i, e ? expr_eval(e) : ((st->word & 0xf) ^ 8) - 8, &lo, &hi);
+    else
+        expr_span(e, here, &lo, &hi, 0);
+    join(lo, hi);
+    // a number, or an .equ of one, is an address that does not move with the code
+    if ((op == OP_J || op == OP_JAL) && (number || hi < 0) && giveup_line == 0)
+        giveup_line = st->line;
+}
+
+/* return 1 if region r runs into the next one */
+static int falls(int r)
+{
+    int i, f = 1;
+    for (i = first[r]; i < first[r + 1]; i++) {
+        struct stmt* st = ir_get(i);
+        int op = opfunc_of(st);
+        if (is_data(st))
+            f = 0;
+        if (op >= 0)
+            f = op != OP_J && op != OP_JR && op != OP_RET;
+    }
+    return f;
+}
+
+/* qsort compare for units, most calls per byte first, then in source order */
+static int by_calls(const void* a, const void* b)
+{
+    int u = *(int*) a, v = *(int*) b;
+    double cu = calls[u] / (double) (size[u] > 0 ? size[u] : 1);
+    double cv = calls[v] / (double) (size[v] > 0 ? size[v] : 1);
+    if (cu != cv) return cu > cv ? -1 : 1;
+    return u - v;
+}
+
+
+/**
+* Shared functions (layout.h)
+*/
+
+/*
+  name:    layout_code
+  purpose: put the statements (ir.c) in the order that runs the fewest
+           instructions with the profile, before assemble. nothing moves
+           in a source with errors, which are reported as usual
+  field:   profile - heatmap csv of emulator -m -g 1
+*/
+void layout_code(char* profile)
+{
+    int i, j, u, n = ir_count(), nsyms = sym_total();
+    ran = 1;
+    moved = giveup_line = 0;
+    saved = 0;
+    if (n == 0) return;
+    for (i = 0; i < n; i++) {
+        int kind = ir_get(i)->kind;
+        if (kind == ST_ERROR || kind == ST_UNKNOWN) return;
+    }
+
+    execs = calloc(MEMBYTES, sizeof(long));
+    region = calloc(n + 1, sizeof(int));
+    first = calloc(n + 2, sizeof(int));
+    joined = calloc(n + 1, 1);
+    label_region = malloc((nsyms + 1) * sizeof(int));
+    equ_stmt = malloc((nsyms + 1) * sizeof(int));
+    int* addr = calloc(n + 1, sizeof(int));
+    int* placed = calloc(n + 1, sizeof(int));
+    int* order = calloc(n + 1, sizeof(int));
+    if (!execs || !region || !first || !joined || !label_region || !equ_stmt || !addr || !placed || !order)
+        oops("calloc");
+    for (i = 0; i < nsyms; i++)
+        label_region[i] = equ_stmt[i] = -1;
+    read_profile(profile);
+    place_statements(addr);  // asm.c, the order the profile ran
+
+    // regions, as in strip.c
+    nregions = 0;
+    for (i = 0; i < n; i++) {
+        struct stmt* st = ir_get(i);
+        int equ = st->kind == ST_DIRECTIVE && st->dir == DIR_EQU;
+        if (i == 0 || (st->label && !equ) || (st->kind == ST_DIRECTIVE && st->dir == DIR_ORG))
+            first[nregions++] = i;
+        region[i] = nregions - 1;
+        if (st->label && equ)
+            equ_stmt[st->sym] = i;
+        else if (st->label)
+            label_region[st->sym] = region[i];
+    }
+    first[nregions] = n;
+
+    // units of regions that stay together
+    for (i = 0; i < nregions - 1; i++)
+        joined[i] = falls(i);
+    for (i = 0; i < n; i++)
+        join_statement(i);
+    int nunits = 0;
+    int* unit_first = calloc(nregions + 1, sizeof(int));  // first region of every unit
+    int* unit_of = calloc(nregions + 1, sizeof(int));
+    calls = calloc(nregions + 1, sizeof(long));
+    size = calloc(nregions + 1, sizeof(int));
+    int* sorted = calloc(nregions + 1, sizeof(int));
+    if (!unit_first || !unit_of || !calls || !size || !sorted)
+        oops("calloc");
+    for (i = 0; i < nregions; i++) {
+        if (i == 0 || !joined[i - 1])
+            unit_first[nunits++] = i;
+        unit_of[i] = nunits - 1;
+    }
+    unit_first[nunits] = nregions;
+
+    // the first unit, a unit with .org and a unit running off the end stay
+    char* pinned = calloc(nunits + 1, 1);
+    if (!pinned) oops("calloc");
+    pinned[0] = 1;
+    for (i = 0; i < n; i++) {
+        struct stmt* st = ir_get(i);
+        if (st->kind == ST_DIRECTIVE && st->dir == DIR_ORG)
+            pinned[unit_of[region[i]]] = 1;
+    }
+    if (falls(nregions - 1))
+        pinned[nunits - 1] = 1;
+
+    // J and JAL the profile counted into every unit
+    for (i = 0; i < n; i++) {
+        struct stmt* st = ir_get(i);
+        int op = opfunc_of(st);
+        if (st->kind != ST_INSTR || (op != OP_J && op != OP_JAL) || expr_const(st->ops.expr)) continue;
+        int lo = nregions, hi = -1;
+        expr_span(st->ops.expr, region[i], &lo, &hi, 0);
+        if (hi >= 0) calls[unit_of[hi]] += count_at(addr, i);
+    }
+    for (u = 0; u < nunits; u++)
+        size[u] = addr[first[unit_first[u + 1]]] - addr[first[unit_first[u]]];
+
+    // called units first, among the units between two that stay
+    for (u = 0; u < nunits; u++)
+        sorted[u] = u;
+    for (u = 0; u < nunits; u = j) {
+        for (j = u; j < nunits && !pinned[j]; j++) {}
+        qsort(sorted + u, j - u, sizeof(int), by_calls);
+        if (j == u) j++;
+    }
+    for (u = 0; u < nunits; u++)
+        moved += sorted[u] != u;
+
+    if (moved > 0 && giveup_line == 0) {
+        int k = 0;
+        for (u = 0; u < nunits; u++) {
+            for (i = first[unit_first[sorted[u]]]; i < first[unit_first[sorted[u] + 1]]; i++)
+                order[k++] = i;
+        }
+
+        ir_order(order);              // ir.c
+        place_statements(placed);     // asm.c, the new order
+        for (j = 0; j < n; j++) {
+            if (opfunc_of(ir_get(j)) >= 0)
+                saved += count_at(addr, order[j]) * (words_at(addr, order[j]) - words_at(placed, j));
+        }
+        if (saved <= 0) {
+            for (j = 0; j < n; j++)
+                placed[order[j]] = j;
+            ir_order(placed);         // back to the source order
+        }
+    }
+    if (saved <= 0 || giveup_line > 0)
+        moved = 0;
+
+    free(execs);
+    free(region);
+    free(first);
+    free(joined);
+    free(label_region);
+    free(equ_stmt);
+    free(addr);
+    free(placed);
+    free(order);
+    free(unit_first);
+    free(unit_of);
+    free(calls);
+    free(size);
+    free(sorted);
+    free(pinned);
+}
+
+/* print the units moved and the instructions saved, or why the order stayed */
+void layout_report()
+{
+    if (!ran) return;
+    if (giveup_line > 0)
+        printf("%-4s\t: order kept, J to an address on line %d\n\n", "LAYOUT", giveup_line);
+    else if (moved == 0)
+        printf("%-4s\t: order kept, no executed instruction saved\n\n", "LAYOUT");
+    else
+        printf("%-4s\t: %d units moved, %ld fewer instructions executed (predicted)\n\n", "LAYOUT", moved, saved);
+}
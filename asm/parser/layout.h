@@ -0,0 +1,11 @@
+/*
+ * layout.h -- profile-guided order of the code
+ */
+
+#ifndef LAYOUT_INCL
+#define LAYOUT_INCL
+
+void layout_code(char* profile);
+void layout_report();
+
+#endif /* LAYOUT_INCL */
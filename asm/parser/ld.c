@@ -0,0 +1,113 @@
+/*
+ * ld.c -- min16-ld, links the objects of parser -c into one mif file
+ *
+ * Usage: ./min16-ld [-O0|-O1] [-s] [-w] [-p profile] [-f format] [-j n] [-t] [--map] [-o out.mif] a.obj b.obj ...
+ *
+ *    -O1  (default) drop autogen constants already held in $at
+ *    -O0  no peephole
+ *    -s   strip code and data no label reaches from the entry or .keep (strip.c)
+ *    -w   a word for every byte of .byte, .ascii and .asciiz, the older layout
+ *    -p   order the code of every module so the calls counted in profile,
+ *         emulator -m -g 1 csv, reach their labels with one J (layout.c)
+ *    -f   amif (default) annotated mif, mif without comments, bin or hex (out.c)
+ *    -j   threads encoding the modules, one per cpu by default (asm.c)
+ *    -t   report the time of every phase (bench.c)
+ *    --map  write out.map next to out.mif: segments, labels, autogen sites and
+ *           the words and cycles of every routine (map.c)
+ *    -o   file to write, a.mif (a.bin, a.hex) by default
+ *
+ * The modules are placed in the order given, unless -p moves their code.
+ * Labels, relaxation and autogen are resolved over all of them at once
+ * (asm.c), so a far label in another module expands its reference here
+ * exactly as it would in one source file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "asm.h"
+#include "obj.h"
+#include "out.h"
+#include "directives.h"
+#include "strip.h"
+#include "layout.h"
+#include "map.h"
+#include "arena.h"
+#include "ir.h"
+#include "symtab.h"
+#include "common.h"
+
+/**
+* Start function
+*/
+void linker(int ac, char* av[])
+{
+    ps("-- ld.c --")
+    char* out = NULL;
+    char* profile = NULL;
+    int i, strip = 0, map = 0, timing = 0, format = OUT_AMIF;
+    for (i = 1; i < ac && av[i][0] == '-'; i++) {
+        if (strcmp(av[i], "-O0") == 0)
+            set_optimize(0);
+        else if (strcmp(av[i], "-O1") == 0)
+            set_optimize(1);
+        else if (strcmp(av[i], "-s") == 0)
+            strip = 1;
+        else if (strcmp(av[i], "-w") == 0)
+            set_byte_words(1);       // directives.c
+        else if (strcmp(av[i], "-p") == 0 && i + 1 < ac)
+            profile = av[++i];
+        else if (strcmp(av[i], "--map") == 0)
+            map = 1;
+        else if (strcmp(av[i], "-o") == 0 && i + 1 < ac)
+            out = av[++i];
+        else if (strcmp(av[i], "-f") == 0 && i + 1 < ac && (format = out_format(av[i + 1])) >= 0)
+            i++;
+        else if (strcmp(av[i], "-j") == 0 && i + 1 < ac)
+            set_jobs(atoi(av[++i]));
+        else if (strcmp(av[i], "-t") == 0)
+            timing = 1;
+        else
+            break;
+    }
+    if (i >= ac || av[i][0] == '-' || format < 0)
+        oops("Usage: ./min16-ld [-O0|-O1] [-s] [-w] [-p profile.csv] [-f amif|mif|bin|hex] [-j n] [-t] [--map] [-o out.mif] a.obj b.obj ...\t")
+    set_format(format);
+
+    char* first = av[i];
+    set_timing(timing);              // asm.c
+    symtab_init();                   // labels of every module
+    for (; i < ac; i++)
+        obj_read(av[i]);             // statements appended (ir.c)
+    if (obj_check() > 0)
+        exit(1);
+    time_phase("read");
+    if (strip) {
+        strip_unreachable(0);        // every module is here, exports are not roots
+        time_phase("strip");
+    }
+    if (profile) {
+        layout_code(profile);        // code of one module may move past another
+        time_phase("layout");
+    }
+    if (out == NULL)
+        out = outname(first, out_ext(format));
+    assemble(out);
+    if (map) {
+        map_write(outname(out, "map"));
+        time_phase("map");
+    }
+    time_report();
+    ir_free();
+    obj_free();
+    symtab_free();
+    arena_done();                    // lists and strings of the run
+}
+
+/* main controler */
+int main(int ac, char* av[])
+{
+    linker(ac, av);
+    return 0;
+}
@@ -0,0 +1,495 @@
+/*
+ * lexer.c -- single pass tokenizer and perfect hash keyword lookup
+ *
+ * lex_line walks a line once: optional label, then a directive or a
+ * mnemonic with its operands, and records what it found in a statement
+ * (ir.h) so that no later pass looks at the text again. Mnemonics,
+ * registers and directives are classified with one hash and one compare
+ * against tables laid out at compile time, so no keyword is found by
+ * scanning a list.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "lexer.h"
+#include "ir.h"
+#include "expr.h"
+#include "symtab.h"
+#include "strfunc.h"
+#include "common.h"
+
+/*
+ * Perfect hash tables
+ *
+ * slot = fold(fnv1a(seed, upper case key)) & (size - 1). The seeds were
+ * searched so that every key lands in its own slot. To add a key, put it
+ * in any free slot and run make seeds: lexer_test() checks every table,
+ * and for one with a key out of its slot searches the seeds from 0 and
+ * prints the first that fits with the slot of every key.
+ */
+#define MNEMONIC_BITS  7
+#define MNEMONIC_SEED  0x85dba
+#define REGISTER_BITS  5
+#define REGISTER_SEED  0xc0
+#define DIRECTIVE_BITS 5
+#define DIRECTIVE_SEED 0xf3
+#define SEED_TRIES     (1u << 24)  // seeds lexer_test searches
+
+static struct mnemonic mnemonic_table[1 << MNEMONIC_BITS] = {
+    [  0] = {"SUBIU", 0b010101, I_MODE},
+    [  7] = {"ANDI",  0b011000, I_MODE},
+    [  9] = {"ADDI",  0b010000, I_MODE},
+    [ 13] = {"ROTL",  0b001111, R2_MODE},
+    [ 14] = {"ORI",   0b011001, I_MODE},
+    [ 17] = {"SLLI",  0b011100, I_MODE},
+    [ 21] = {"SW",    0b110010, O_MODE},
+    [ 22] = {"AND",   0b001000, R2_MODE},
+    [ 23] = {"BEQ",   0b101100, O_MODE},
+    [ 24] = {"LA",    0b1000000, I_MODE},
+    [ 25] = {"SRA",   0b001110, R2_MODE},
+    [ 27] = {"MUL",   0b000010, R2_MODE},
+    [ 32] = {"SLL",   0b001100, R2_MODE},
+    [ 33] = {"LB",    0b110001, O_MODE},
+    [ 38] = {"MULU",  0b000110, R2_MODE},
+    [ 42] = {"SB",    0b110011, O_MODE},
+    [ 45] = {"ADDU",  0b000100, R2_MODE},
+    [ 46] = {"LW",    0b110000, O_MODE},
+    [ 47] = {"MFLO",  0b110101, R1_MODE},
+    [ 49] = {"SUBI",  0b010001, I_MODE},
+    [ 52] = {"JR",    0b101010, R1_MODE},
+    [ 53] = {"ADD",   0b000000, R2_MODE},
+    [ 56] = {"JAL",   0b101001, J_MODE},
+    [ 57] = {"MTHI",  0b110110, R1_MODE},
+    [ 58] = {"SYS",   0b100000, I_MODE},
+    [ 59] = {"MFHI",  0b110100, R1_MODE},
+    [ 60] = {"ROTLI", 0b011111, I_MODE},
+    [ 65] = {"NORI",  0b011011, I_MODE},
+    [ 66] = {"SRL",   0b001101, R2_MODE},
+    [ 68] = {"NOR",   0b001011, R2_MODE},
+    [ 69] = {"SUBU",  0b000101, R2_MODE},
+    [ 72] = {"SLT",   0b000011, R2_MODE},
+    [ 73] = {"SLTU",  0b000111, R2_MODE},
+    [ 75] = {"SRLI",  0b011101, I_MODE},
+    [ 77] = {"MTLO",  0b110111, R1_MODE},
+    [ 79] = {"ADDIU", 0b010100, I_MODE},
+    [ 82] = {"MULI",  0b010010, I_MODE},
+    [ 85] = {"SLTI",  0b010011, I_MODE},
+    [ 88] = {"OR",    0b001001, R2_MODE},
+    [ 94] = {"RET",   0b1000011, P0_MODE},
+    [ 97] = {"BNE",   0b101101, O_MODE},
+    [ 99] = {"SRAI",  0b011110, I_MODE},
+    [103] = {"SLTIU", 0b010111, I_MODE},
+    [108] = {"SUB",   0b000001, R2_MODE},
+    [112] = {"LI",    0b1000000, I_MODE},
+    [114] = {"POP",   0b1000010, P1_MODE},
+    [117] = {"CALL",  0b101001, J_MODE},
+    [118] = {"XOR",   0b001010, R2_MODE},
+    [119] = {"MULIU", 0b010110, I_MODE},
+    [120] = {"JALR",  0b101011, R2_MODE},
+    [121] = {"PUSH",  0b1000001, P1_MODE},
+    [123] = {"J",     0b101000, J_MODE},
+    [126] = {"XORI",  0b011010, I_MODE},
+};
+
+/* register name and number */
+struct keyword {
+    char* str;
+    int   num;
+};
+
+static struct keyword register_table[1 << REGISTER_BITS] = {
+    [  4] = {"s1",  9}, [  5] = {"at",  1}, [  6] = {"rc",  6}, [ 10] = {"t0", 10},
+    [ 11] = {"lo", 13}, [ 12] = {"pc", 14}, [ 13] = {"fp",  3}, [ 16] = {"sp",  2},
+    [ 17] = {"fl", 15}, [ 18] = {"hi", 12}, [ 21] = {"rb",  5}, [ 23] = {"s0",  8},
+    [ 25] = {"t1", 11}, [ 27] = {"r0",  0}, [ 28] = {"ra",  4}, [ 31] = {"rd",  7},
+};
+
+static struct keyword directive_table[1 << DIRECTIVE_BITS] = {
+    [  2] = {".space",   DIR_SPACE},
+    [  5] = {".align",   DIR_ALIGN},
+    [ 11] = {".macro",   DIR_MACRO},
+    [ 12] = {".equ",     DIR_EQU},
+    [ 13] = {".keep",    DIR_KEEP},
+    [ 15] = {".word",    DIR_WORD},
+    [ 16] = {".org",     DIR_ORG},
+    [ 18] = {".byte",    DIR_BYTE},
+    [ 19] = {".endr",    DIR_ENDR},
+    [ 21] = {".asciiz",  DIR_ASCIIZ},
+    [ 22] = {".rept",    DIR_REPT},
+    [ 24] = {".ascii",   DIR_ASCII},
+    [ 25] = {".half",    DIR_HALF},
+    [ 26] = {".endm",    DIR_ENDM},
+    [ 30] = {".include", DIR_INCLUDE},
+    [ 31] = {".global",  DIR_GLOBAL},
+};
+
+/* largest register number each addressing mode can encode */
+#define REGMAX   11   // $r0 - $t1
+#define REGMAX_O  7   // O_TYPE has 3 bit registers, $r0 - $rd
+
+/* file scope variables */
+static char* line_start;        /* line being scanned, for columns */
+static char  errstr[STRLEN];    /* last syntax error, empty if none */
+
+
+/**
+* Keyword Lookup Functions
+*/
+
+/* hash of len chars of str, case insensitive */
+static unsigned hash(char* str, int len, unsigned seed, int bits)
+{
+    uint32_t h = seed;
+    int i;
+    for (i = 0; i < len; i++)
+        h = (h ^ toupper((unsigned char) str[i])) * 0x01000193;
+    h ^= h >> 16;
+    return h & ((1u << bits) - 1);
+}
+
+/* helper to compare table key with len chars of str */
+static int key_equal(char* key, char* str, int len)
+{
+    return key != NULL && strncasecmp(key, str, len) == 0 && key[len] == '\0';
+}
+
+/* return mnemonic entry, NULL if not a mnemonic */
+struct mnemonic* lookup_mnemonic(char* str, int len)
+{
+    struct mnemonic* m = &mnemonic_table[hash(str, len, MNEMONIC_SEED, MNEMONIC_BITS)];
+    return key_equal(m->str, str, len) ? m : NULL;
+}
+
+/* return register number, -1 if not a register (str without '$') */
+int lookup_register(char* str, int len)
+{
+    struct keyword* k = &register_table[hash(str, len, REGISTER_SEED, REGISTER_BITS)];
+    return key_equal(k->str, str, len) ? k->num : -1;
+}
+
+/* return directive id, -1 if not a directive (str with '.') */
+int lookup_directive(char* str, int len)
+{
+    struct keyword* k = &directive_table[hash(str, len, DIRECTIVE_SEED, DIRECTIVE_BITS)];
+    return key_equal(k->str, str, len) ? k->num : -1;
+}
+
+
+/**
+* Tokenizer
+*/
+
+/* skip blanks */
+static char* skip_space(char* p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+/* skip identifier characters */
+static char* skip_ident(char* p)
+{
+    while (isalnum((unsigned char) *p) || *p == '_') p++;
+    return p;
+}
+
+/* return 1 if nothing but a comment is left */
+static int at_end(char* p)
+{
+    p = skip_space(p);
+    return *p == '\0' || *p == '#';
+}
+
+/* record a syntax error at p and return -1 */
+static int lex_fail(char* p, char* msg)
+{
+    snprintf(errstr, sizeof errstr, "col %d: %s", (int) (p - line_start) + 1, msg);
+    return -1;
+}
+
+/* read "$reg" at *pp; return register number or -1 on error */
+static int scan_register(char** pp, int max)
+{
+    char* p = skip_space(*pp);
+    if (*p != '$')
+        return lex_fail(p, "expected register");
+    char* e = skip_ident(p + 1);
+    int reg = lookup_register(p + 1, e - p - 1);
+    if (reg < 0)
+        return lex_fail(p, "unknown register");
+    if (reg > max)
+        return lex_fail(p, "register not allowed here");
+    *pp = e;
+    return reg;
+}
+
+/* read ',' at *pp; return 0 or -1 on error */
+static int scan_comma(char** pp)
+{
+    char* p = skip_space(*pp);
+    if (*p != ',')
+        return lex_fail(p, "expected ','");
+    *pp = p + 1;
+    return 0;
+}
+
+/* parse the expression at *pp into a tree (expr.c); -1 on error */
+static int scan_expr(char** pp, struct expr** dst)
+{
+    char* e;
+    if ((*dst = expr_parse(*pp, &e)) == NULL)
+        return lex_fail(e, expr_error());
+    *pp = e;
+    return 0;
+}
+
+/* end of a data list item: next blank, ',' or comment outside quotes */
+static char* item_end(char* p)
+{
+    char quote = 0;
+    for (; *p != '\0'; p++) {
+        if (quote && *p == '\\' && p[1] != '\0') p++;
+        else if (quote && *p == quote) quote = 0;
+        else if (!quote && *p == '\'') quote = *p;
+        else if (!quote && strchr(" \t\r,#", *p)) break;
+    }
+    return p;
+}
+
+/* parse one data list item [p, e) on its own, items are split by blanks
+   as in .word 1 -2 3; -1 on error */
+static int scan_item(char* p, char* e, struct arg* a)
+{
+    char* end;
+    if ((a->text = strndup(p, e - p)) == NULL)
+        oops("strndup");
+    if ((a->expr = expr_parse(a->text, &end)) != NULL && *end == '\0')
+        return 0;
+    lex_fail(p + (end - a->text), a->expr ? "unexpected text in argument" : expr_error());
+    expr_free(a->expr);
+    free(a->text);
+    return -1;
+}
+
+/* directive arguments: one expression, or a list for the data directives */
+static int scan_args(char* p, struct stmt* st)
+{
+    int list = st->dir == DIR_WORD || st->dir == DIR_HALF || st->dir == DIR_BYTE ||
+               st->dir == DIR_GLOBAL || st->dir == DIR_KEEP;
+    int max = 0;
+
+    for (p = skip_space(p); !at_end(p); p = skip_space(p)) {
+        if (st->nargs > 0 && !list)
+            return lex_fail(p, "unexpected text after argument");
+        if (st->nargs == max) {
+            max = max ? max * 2 : 4;
+            if ((st->args = realloc(st->args, max * sizeof(struct arg))) == NULL)
+                oops("realloc");
+        }
+        struct arg* a = &st->args[st->nargs];
+        char* start = p;
+        if (list) {
+            p = item_end(p);
+            if (p == start)
+                return lex_fail(p, "expected expression");
+            if (scan_item(start, p, a) < 0)
+                return -1;
+            if ((st->dir == DIR_GLOBAL || st->dir == DIR_KEEP) && a->expr->kind != E_SYM) {
+                expr_free(a->expr);
+                free(a->text);
+                return lex_fail(start, "expected label");
+            }
+            if (*p == ',') p++;  // .word 1, 2 as well as .word 1 2
+        } else {
+            if (scan_expr(&p, &a->expr) < 0)
+                return -1;
+            if ((a->text = strndup(start, p - start)) == NULL)
+                oops("strndup");
+        }
+        st->nargs++;
+    }
+    if (st->nargs == 0)
+        return lex_fail(p, "expected expression");
+    return 0;
+}
+
+/* read operands of the addressing mode into ops; -1 on error */
+static int scan_operands(char* p, struct operands* ops)
+{
+    int max = ops->op->mode == O_MODE || ops->op->mode == P1_MODE ? REGMAX_O : REGMAX;
+    ops->rd = ops->rs = 0;
+    ops->expr = NULL;
+
+    switch (ops->op->mode) {
+        case R1_MODE:
+        case P1_MODE:
+            if ((ops->rd = scan_register(&p, max)) < 0) return -1;
+            break;
+        case R2_MODE:
+            if ((ops->rd = scan_register(&p, max)) < 0) return -1;
+            if (scan_comma(&p) < 0) return -1;
+            if ((ops->rs = scan_register(&p, max)) < 0) return -1;
+            break;
+        case I_MODE:
+            if ((ops->rd = scan_register(&p, max)) < 0) return -1;
+            if (scan_comma(&p) < 0) return -1;
+            if (scan_expr(&p, &ops->expr) < 0) return -1;
+            break;
+        case J_MODE:
+            if (scan_expr(&p, &ops->expr) < 0) return -1;
+            break;
+        case O_MODE:
+            if ((ops->rd = scan_register(&p, max)) < 0) return -1;
+            if (scan_comma(&p) < 0) return -1;
+            if ((ops->rs = scan_register(&p, max)) < 0) return -1;
+            if (scan_comma(&p) < 0) return -1;
+            if (scan_expr(&p, &ops->expr) < 0) return -1;
+            break;
+        case P0_MODE:
+            break;
+    }
+    if (!at_end(p))
+        return lex_fail(skip_space(p), "unexpected text after operands");
+    return 0;
+}
+
+
+/**
+* Shared functions (lexer.h)
+*/
+
+/* keep the last syntax error in st */
+static int lex_failed(struct stmt* st)
+{
+    if ((st->error = strdup(errstr)) == NULL)
+        oops("strdup");
+    return st->kind = ST_ERROR;
+}
+
+/*
+  name:    lex_line
+  purpose: classify one line into st, with the operands of an instruction
+           and the arguments of a directive parsed into trees (expr.c)
+  return:  st->kind (ST_BLANK, ST_LABEL, ST_DIRECTIVE, ST_INSTR, ST_UNKNOWN
+           when a directive has no arguments, or ST_ERROR with st->error).
+           ST_WORD only comes from object files (obj.c)
+*/
+int lex_line(char* str, struct stmt* st)
+{
+    char* p = skip_space(str);
+    char* e;
+
+    line_start = str;
+    errstr[0] = '\0';
+    st->kind = ST_BLANK;
+    st->label = 0;
+    st->sym = -1;
+    st->dir = -1;
+    st->ops.expr = NULL;
+    st->args = NULL;
+    st->nargs = 0;
+    st->error = NULL;
+
+    if (*p == '\0' || *p == '#' || *p == '*' || *p == '+')
+        return ST_BLANK;  // just blank
+
+    // label
+    e = skip_ident(p);
+    if (e > p && *skip_space(e) == ':') {
+        struct strview name = { p, (int) (e - p) };
+        st->label = 1;
+        st->sym = sym_id(view_str(name));  // symtab.c
+        p = skip_space(skip_space(e) + 1);
+        if (at_end(p)) return st->kind = ST_LABEL;
+    }
+
+    // directive, handled by directives.c
+    if (*p == '.') {
+        e = skip_ident(p + 1);
+        if ((st->dir = lookup_directive(p, e - p)) < 0) {
+            lex_fail(p, "unknown directive");
+            return lex_failed(st);
+        }
+        if (*e != ' ' && *e != '\t')
+            return st->kind = ST_UNKNOWN;  // no arguments
+        if (st->dir != DIR_ASCII && st->dir != DIR_ASCIIZ && scan_args(e, st) < 0)
+            return lex_failed(st);
+        return st->kind = ST_DIRECTIVE;
+    }
+
+    // mnemonic
+    e = skip_ident(p);
+    if (e == p)
+        lex_fail(p, "expected mnemonic");
+    else if ((st->ops.op = lookup_mnemonic(p, e - p)) == NULL)
+        lex_fail(p, "unknown mnemonic");
+    else if (*e != ' ' && *e != '\t' && st->ops.op->mode != P0_MODE)
+        lex_fail(e, "expected operands");
+    else if (scan_operands(e, &st->ops) == 0)
+        return st->kind = ST_INSTR;
+    return lex_failed(st);
+}
+
+
+/* DEBUG: return 1 if every key has a slot of its own with seed, slots in slot */
+static int perfect(char** keys, int n, unsigned seed, int bits, int* slot)
+{
+    char used[1 << MNEMONIC_BITS] = { 0 };  // the largest table
+    int i;
+    for (i = 0; i < n; i++) {
+        slot[i] = hash(keys[i], strlen(keys[i]), seed, bits);
+        if (used[slot[i]]++) return 0;
+    }
+    return 1;
+}
+
+/* DEBUG: check the keys of a table at their slots, or search a new seed */
+static void check_table(char* name, char** keys, int* at, int n, unsigned seed, int bits)
+{
+    int i, s, slot[1 << MNEMONIC_BITS];
+    for (i = 0; i < n && hash(keys[i], strlen(keys[i]), seed, bits) == at[i]; i++)
+        ;
+    if (i == n) {
+        printf("%s_SEED 0x%x: %d keys, every one in its slot\n", name, seed, n);
+        return;
+    }
+    printf("%s %s is not in slot %d, searching a new %s_SEED\n", name, keys[i], at[i], name);
+    for (seed = 0; seed < SEED_TRIES && !perfect(keys, n, seed, bits, slot); seed++)
+        ;
+    if (seed == SEED_TRIES) {
+        printf("no seed below 0x%x, raise %s_BITS\n", SEED_TRIES, name);
+        return;
+    }
+    printf("#define %s_SEED 0x%x\n", name, seed);
+    for (s = 0; s < (1 << bits); s++)
+        for (i = 0; i < n; i++)
+            if (slot[i] == s) printf("    [%3d] = %s\n", s, keys[i]);
+}
+
+/* DEBUG: check that every key hashes to its own slot, make seeds */
+void lexer_test()
+{
+    char* keys[1 << MNEMONIC_BITS];
+    int i, n, at[1 << MNEMONIC_BITS];
+    for (i = n = 0; i < (1 << MNEMONIC_BITS); i++) {
+        if (mnemonic_table[i].str == NULL) continue;
+        keys[n] = mnemonic_table[i].str;
+        at[n++] = i;
+    }
+    check_table("MNEMONIC", keys, at, n, MNEMONIC_SEED, MNEMONIC_BITS);
+    for (i = n = 0; i < (1 << REGISTER_BITS); i++) {
+        if (register_table[i].str == NULL) continue;
+        keys[n] = register_table[i].str;
+        at[n++] = i;
+    }
+    check_table("REGISTER", keys, at, n, REGISTER_SEED, REGISTER_BITS);
+    for (i = n = 0; i < (1 << DIRECTIVE_BITS); i++) {
+        if (directive_table[i].str == NULL) continue;
+        keys[n] = directive_table[i].str;
+        at[n++] = i;
+    }
+    check_table("DIRECTIVE", keys, at, n, DIRECTIVE_SEED, DIRECTIVE_BITS);
+}
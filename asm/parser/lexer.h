@@ -1,15 +1,61 @@
 /*
- * regexp.h -- a set of regular expression related functions
+ * lexer.h -- single pass tokenizer and perfect hash keyword lookup
  */
 
-#ifndef REGEXP_INCL
-#define REGEXP_INCL
+#ifndef LEXER_INCL
+#define LEXER_INCL
 
-int   check_pattern(char*);
-void  regfree_all();
-void  regexp_test();  // DEBUG
+/* addressing modes, selects the encode function. the pseudo-instructions
+   use these or P1_MODE (one O_TYPE register) and P0_MODE (no operands) */
+enum mode {
+    R1_MODE, R2_MODE, I_MODE, J_MODE, O_MODE, P1_MODE, P0_MODE,
+};
 
-#endif /* REGEXP_INCL */
+/* opfunc bit of the pseudo-instructions, expanded from templates (encoder.c) */
+#define PSEUDO  0b1000000
+
+/* directive ids, index of directive_table in directives.c */
+enum directive_id {
+    DIR_SPACE, DIR_WORD, DIR_HALF, DIR_BYTE, DIR_ASCII, DIR_ASCIIZ, DIR_ORG, DIR_ALIGN, DIR_EQU,
+    DIR_GLOBAL, DIR_MACRO, DIR_ENDM, DIR_INCLUDE, DIR_REPT, DIR_ENDR, DIR_KEEP,
+};
+
+/*
+  name:    mnemonic
+  purpose: keyword table entry for an instruction
+  field:   str    - canonical (upper case) mnemonic
+           opfunc - op + func code, with PSEUDO for a pseudo-instruction
+           mode   - addressing mode
+*/
+struct mnemonic {
+    char* str;
+    int   opfunc;
+    int   mode;
+};
+
+/*
+  name:    operands
+  purpose: one instruction as split by the lexer, passed to encode_*
+  field:   op     - mnemonic entry
+           rd, rs - register numbers
+           expr   - immediate, target or offset expression tree, NULL if none
+*/
+struct operands {
+    struct mnemonic* op;
+    int   rd, rs;
+    struct expr* expr;
+};
+
+struct stmt;
+struct expr;
+
+int   lex_line(char*, struct stmt*);
+struct mnemonic* lookup_mnemonic(char* str, int len);
+int   lookup_register(char* str, int len);
+int   lookup_directive(char* str, int len);
+void  lexer_test();  // DEBUG
+
+#endif /* LEXER_INCL */
 
 
 /*　
@@ -107,6 +153,10 @@ SUMMARY
 0111 10 SRAI  0x7 2        SRAI $rd, imm
 0111 11 ROTLI 0x7 3        ROTI $rd, imm 
 
+1000 00 SYS   0x8 0        SYS  $rd, service  (I-type, emulator only)
+                           0: exit($rd)  1: puts($rd)  2: print decimal $rd
+                           3: gets($rd), $t1 = buffer words in, length out
+
 
 10 : ORJ-Type (Jump/Branch Flow Control)
 1010 00 J     0xA 0        J    target   (J-type)
@@ -129,4 +179,13 @@ SUMMARY
 1101 10 MTHI  0xD 2        MTHI $rd (R-type)
 1101 11 MTLO  0xD 3        MTLO $rd (R-type)
 
+
+Pseudo-Instructions (expansion templates in encoder.c)
+LI   $rd, imm      shortest sequence setting $rd to imm, $at is left alone
+LA   $rd, label    same as LI
+PUSH $rd           SUBIU $sp, 2;  SW $sp, $rd, 0   ($rd is $r0 - $rd)
+POP  $rd           LW $rd, $sp, 0;  ADDIU $sp, 2   ($rd is $r0 - $rd)
+CALL target        same as JAL
+RET                JR $ra
+
 */
\ No newline at end of file
@@ -27,9 +27,6 @@ struct list {
 
 void  init_list(struct list*, void (*f) (struct list*, char*, int));
 void  build_error_list(struct list*, char*, int);
-void  build_label_list(struct list* llp, struct list* ulp, int num, char* str);
-void  build_used_list(struct list* ls, char* str, char* opstr);
-void  addr_resolution(struct list* llp, struct list* ulp);
 
 void  freelist(struct list*);
 char* getstr(struct list* ls, int num);
@@ -0,0 +1,514 @@
+/*
+ * macro.c -- .macro, .rept and .include while the source is read
+ *
+ *     .macro  name p1, p2         # define, parameters written \p1 \p2
+ *     ...                         # \@ is the number of the expansion,
+ *     .endm                       # for labels local to one expansion
+ *     name    a, b                # expand, arguments split at ','
+ *
+ *     .rept   <count>             # body repeated count times
+ *     ...
+ *     .endr
+ *
+ *     .include "file"             # read once, relative to this file
+ *
+ * ir.c hands every line to macro_line before lexing it. A body line is
+ * cut into text pieces and parameter slots when it is recorded, so an
+ * expansion only joins pieces and arguments and never searches the body
+ * for parameter names again. A line without slots is lexed at its first
+ * expansion only, the later ones copy that statement (ir_copy). A line
+ * with slots is lexed with its arguments in place, as an argument may be
+ * any text: a register, an expression or a whole operand list. Expanded
+ * lines go through macro_line again, so bodies may call other macros and
+ * nest .rept. Nesting deeper than MACRO_DEPTH (a macro calling itself)
+ * or more than MACRO_LINES expanded lines in all stop with an error at
+ * the line that started it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "macro.h"
+#include "ir.h"
+#include "lexer.h"
+#include "expr.h"
+#include "strfunc.h"
+#include "common.h"
+
+#define MACRO_DEPTH  32         // nested expansions and includes
+#define MACRO_LINES  (1 << 20)  // expanded lines in one program
+#define MACRO_SLOTS  64         // hash slots for macro names, power of 2
+
+/*
+  name:    piece
+  purpose: part of a recorded body line
+  field:   text  - literal text, NULL for a slot
+           param - parameter index of a slot, -1 for \@
+*/
+struct piece {
+    char* text;
+    int   param;
+};
+
+/*
+  name:    body
+  purpose: tokenized lines of a macro or .rept
+  field:   name    - macro name, NULL for .rept
+           params  - parameter names
+           count   - .rept count
+           line    - pieces of each line, npieces of them
+           lexed   - statement (ir.c) of the first expansion of a line
+                     without slots, -1 before it and for the others
+*/
+struct body {
+    char*          name;
+    char**         params;
+    int            nparams;
+    int            count;
+    struct piece** lines;
+    int*           npieces;
+    int*           lexed;
+    int            nlines;
+};
+
+/* file scope variables */
+static struct body** macros = NULL;     /* defined macros */
+static int           nmacros = 0;
+static int*          slots = NULL;      /* hash slots: index into macros, -1 if empty */
+static int           nslots = 0;
+static struct body*  recording = NULL;  /* body between .macro/.rept and its end */
+static int           rec_line = 0;      /* line that opened it */
+static int           nest = 0;          /* inner .macro or .rept in the body */
+static long          expanded = 0;      /* lines expanded so far */
+static int           expansions = 0;    /* number for \@ */
+
+
+/**
+* Helper Functions
+*/
+
+/* skip blanks */
+static char* skip_space(char* p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+/* skip identifier characters */
+static char* skip_ident(char* p)
+{
+    while (isalnum((unsigned char) *p) || *p == '_') p++;
+    return p;
+}
+
+/* FNV-1a hash of len chars, case sensitive as labels are */
+static unsigned hash_name(char* str, int len)
+{
+    unsigned h = 2166136261u;
+    while (len--)
+        h = (h ^ (unsigned char) *str++) * 16777619u;
+    return h;
+}
+
+/* macro named by len chars of str, NULL if none */
+static struct body* find_macro(char* str, int len)
+{
+    if (nslots == 0) return NULL;
+    unsigned i = hash_name(str, len) & (nslots - 1);
+    for (; slots[i] >= 0; i = (i + 1) & (nslots - 1)) {
+        struct body* m = macros[slots[i]];
+        if (strncmp(m->name, str, len) == 0 && m->name[len] == '\0')
+            return m;
+    }
+    return NULL;
+}
+
+/* add a defined macro to the table, doubling it when half full */
+static void add_macro(struct body* m)
+{
+    int i;
+    if ((macros = realloc(macros, (nmacros + 1) * sizeof(struct body*))) == NULL)
+        oops("realloc");
+    macros[nmacros++] = m;
+    if (nmacros * 2 > nslots) {
+        nslots = nslots ? nslots * 2 : MACRO_SLOTS;
+        if ((slots = realloc(slots, nslots * sizeof(int))) == NULL)
+            oops("realloc");
+        for (i = 0; i < nslots; i++) slots[i] = -1;
+        for (i = 0; i < nmacros; i++) {
+            unsigned h = hash_name(macros[i]->name, strlen(macros[i]->name)) & (nslots - 1);
+            while (slots[h] >= 0) h = (h + 1) & (nslots - 1);
+            slots[h] = i;
+        }
+        return;
+    }
+    unsigned h = hash_name(m->name, strlen(m->name)) & (nslots - 1);
+    while (slots[h] >= 0) h = (h + 1) & (nslots - 1);
+    slots[h] = nmacros - 1;
+}
+
+static void free_body(struct body* b)
+{
+    int i, j;
+    if (b == NULL) return;
+    for (i = 0; i < b->nlines; i++) {
+        for (j = 0; j < b->npieces[i]; j++)
+            free(b->lines[i][j].text);
+        free(b->lines[i]);
+    }
+    for (i = 0; i < b->nparams; i++)
+        free(b->params[i]);
+    free(b->params);
+    free(b->lines);
+    free(b->npieces);
+    free(b->lexed);
+    free(b->name);
+    free(b);
+}
+
+static struct body* new_body()
+{
+    struct body* b = calloc(1, sizeof(struct body));
+    if (b == NULL) oops("calloc");
+    return b;
+}
+
+/* add a literal piece of len chars, or a slot when text is NULL */
+static void add_piece(struct body* b, char* text, int len, int param)
+{
+    int n = b->npieces[b->nlines - 1];
+    struct piece** line = &b->lines[b->nlines - 1];
+    if ((*line = realloc(*line, (n + 1) * sizeof(struct piece))) == NULL)
+        oops("realloc");
+    (*line)[n].text = text ? strndup(text, len) : NULL;
+    (*line)[n].param = param;
+    b->npieces[b->nlines - 1]++;
+}
+
+/* cut a body line into pieces: text, \param and \@ */
+static void record_line(struct body* b, char* text)
+{
+    if ((b->lines = realloc(b->lines, (b->nlines + 1) * sizeof(struct piece*))) == NULL ||
+        (b->npieces = realloc(b->npieces, (b->nlines + 1) * sizeof(int))) == NULL ||
+        (b->lexed = realloc(b->lexed, (b->nlines + 1) * sizeof(int))) == NULL)
+        oops("realloc");
+    b->lines[b->nlines] = NULL;
+    b->lexed[b->nlines] = -1;
+    b->npieces[b->nlines++] = 0;
+
+    char* start = text;
+    char* p;
+    for (p = text; *p != '\0'; p++) {
+        if (*p != '\\') continue;
+        int param = -2, len = 0;
+        if (p[1] == '@') {
+            param = -1;
+            len = 1;
+        } else {
+            len = skip_ident(p + 1) - (p + 1);
+            int i;
+            for (i = 0; i < b->nparams && len > 0; i++) {
+                if (strncmp(b->params[i], p + 1, len) == 0 && b->params[i][len] == '\0')
+                    param = i;
+            }
+        }
+        if (param == -2) continue;  // not a parameter, keep the text
+        if (p > start) add_piece(b, start, p - start, 0);
+        add_piece(b, NULL, 0, param);
+        p += len;
+        start = p + 1;
+    }
+    if (p > start) add_piece(b, start, p - start, 0);
+}
+
+/* split the arguments of a call at top level ',' into args; -1 on too many */
+static int split_args(char* p, char** args, int max)
+{
+    int n = 0, depth = 0;
+    char quote = 0;
+    p = skip_space(p);
+    if (*p == '\0' || *p == '#') return 0;
+
+    char* start = p;
+    for (;; p++) {
+        if (quote) {
+            if (*p == '\\' && p[1] != '\0') p++;
+            else if (*p == quote) quote = 0;
+            if (*p != '\0') continue;
+        }
+        if (*p == '"' || *p == '\'') quote = *p;
+        else if (*p == '(') depth++;
+        else if (*p == ')') depth--;
+        else if ((*p == ',' && depth == 0) || *p == '\0' || (*p == '#' && depth == 0)) {
+            char* e = p;
+            while (e > start && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) e--;
+            if (n == max) return -1;
+            args[n++] = strndup(start, e - start);
+            if (*p != ',') break;
+            start = skip_space(p + 1);
+        }
+    }
+    return n;
+}
+
+/* write line i of body b with args into a new string */
+static char* expand_line(struct body* b, int i, char** args, int number)
+{
+    char num[16];
+    size_t len = 1;
+    int j;
+    snprintf(num, sizeof num, "%d", number);
+    for (j = 0; j < b->npieces[i]; j++) {
+        struct piece* pc = &b->lines[i][j];
+        len += strlen(pc->text ? pc->text : pc->param < 0 ? num : args[pc->param]);
+    }
+    char* str = malloc(len);
+    if (str == NULL) oops("malloc");
+    char* q = str;
+    for (j = 0; j < b->npieces[i]; j++) {
+        struct piece* pc = &b->lines[i][j];
+        char* s = pc->text ? pc->text : pc->param < 0 ? num : args[pc->param];
+        size_t n = strlen(s);
+        memcpy(q, s, n);
+        q += n;
+    }
+    *q = '\0';
+    return str;
+}
+
+/* feed the lines of body b with args to ir.c at line; -1 when a limit stops it */
+static int expand(struct body* b, char** args, char* text, int line, int depth)
+{
+    char msg[STRLEN];
+    int i;
+    if (depth >= MACRO_DEPTH) {
+        snprintf(msg, sizeof msg, "macro: expansion nested deeper than %d, %s calls itself?",
+                 MACRO_DEPTH, b->name ? b->name : ".rept");
+        ir_error(text, line, msg);
+        return -1;
+    }
+    int number = expansions++;
+    for (i = 0; i < b->nlines; i++) {
+        if (++expanded > MACRO_LINES) {
+            snprintf(msg, sizeof msg, "macro: more than %d lines expanded", MACRO_LINES);
+            if (expanded == MACRO_LINES + 1) ir_error(text, line, msg);
+            return -1;
+        }
+        int plain = b->npieces[i] == 0 || (b->npieces[i] == 1 && b->lines[i][0].text);
+        char* str = !plain ? expand_line(b, i, args, number) : b->npieces[i] ? b->lines[i][0].text : "";
+        if (!macro_line(str, line, depth + 1)) {
+            if (plain && b->lexed[i] >= 0)
+                ir_copy(b->lexed[i], line);  // lexed at the first expansion
+            else {
+                ir_lex(str, line, 1);
+                if (plain) b->lexed[i] = ir_count() - 1;
+            }
+        }
+        if (!plain) free(str);
+    }
+    return 0;
+}
+
+/* the label of a line as its own statement, "name:" */
+static void label_stmt(char* text, char* end, int line)
+{
+    char label[STRLEN];
+    snprintf(label, sizeof label, "%.*s", (int) (end - text), text);
+    ir_lex(label, line, 1);
+}
+
+/* .macro name p1, p2 */
+static void open_macro(char* p, char* text, int line)
+{
+    char* name = skip_space(p);
+    char* e = skip_ident(name);
+    char* params[STRLEN];
+    int i, n;
+
+    if (e == name) {
+        ir_error(text, line, "macro: name expected");
+        return;
+    }
+    if (find_macro(name, e - name) || lookup_mnemonic(name, e - name)) {
+        ir_error(text, line, "macro: name already defined");
+        return;
+    }
+    if ((n = split_args(*e == ',' ? e + 1 : e, params, STRLEN)) < 0) {
+        ir_error(text, line, "macro: too many parameters");
+        return;
+    }
+    recording = new_body();
+    recording->name = strndup(name, e - name);
+    recording->params = malloc((n + 1) * sizeof(char*));
+    if (recording->params == NULL) oops("malloc");
+    for (i = 0; i < n; i++) {
+        char* q = params[i][0] == '\\' ? params[i] + 1 : params[i];
+        if (*q == '\0' || *skip_ident(q) != '\0')
+            ir_error(text, line, "macro: parameter must be a name");
+        recording->params[i] = strdup(q);
+        free(params[i]);
+    }
+    recording->nparams = n;
+    rec_line = line;
+}
+
+/* .rept count */
+static void open_rept(char* p, char* text, int line)
+{
+    char* end;
+    struct expr* e = expr_parse(p, &end);
+    if (e == NULL || !expr_const(e) || (*skip_space(end) != '\0' && *skip_space(end) != '#')) {
+        ir_error(text, line, "rept: constant count expected");
+        expr_free(e);
+        return;
+    }
+    recording = new_body();
+    recording->count = e->num;
+    expr_free(e);
+    if (recording->count < 0) {
+        ir_error(text, line, "rept: negative count");
+        recording->count = 0;
+    }
+    rec_line = line;
+}
+
+/* .include "file" */
+static void include(char* p, char* text, int line, int depth)
+{
+    char name[STRLEN];
+    p = skip_space(p);
+    char* q = *p == '"' ? strchr(p + 1, '"') : NULL;
+    if (q == NULL || q - p - 1 >= STRLEN) {
+        ir_error(text, line, "include: file name in double quotes expected");
+        return;
+    }
+    snprintf(name, sizeof name, "%.*s", (int) (q - p - 1), p + 1);
+    if (depth >= MACRO_DEPTH)
+        ir_error(text, line, "include: nested too deep");
+    else if (ir_include(name, line, depth + 1) < 0)
+        ir_error(text, line, "include: cannot read file");
+}
+
+
+/**
+* Shared functions (macro.h)
+*/
+
+void macro_init()
+{
+    macro_free();
+}
+
+/*
+  name:    macro_line
+  purpose: record, expand or include for one source line
+  field:   text  - the line
+           line  - line number the statements take
+           depth - nesting of the expansion or include the line comes from
+  return:  1 if the line was taken here, 0 if ir.c should lex it
+*/
+int macro_line(char* text, int line, int depth)
+{
+    char* p = skip_space(text);
+    char* label = NULL;
+    char* e = skip_ident(p);
+    int dir = -1;
+
+    if (e > p && *skip_space(e) == ':') {  // label
+        label = skip_space(e) + 1;
+        p = skip_space(label);
+        e = skip_ident(p);
+    }
+    if (*p == '.') {
+        e = skip_ident(p + 1);
+        dir = lookup_directive(p, e - p);  // lexer.c
+    }
+
+    // body of a .macro or .rept, up to the .endm or .endr that ends it
+    if (recording) {
+        int open = recording->name ? DIR_MACRO : DIR_REPT;
+        int close = recording->name ? DIR_ENDM : DIR_ENDR;
+        if (dir == open) nest++;
+        if (dir != close || nest-- > 0) {
+            record_line(recording, text);
+            return 1;
+        }
+        nest = 0;
+        struct body* b = recording;
+        recording = NULL;
+        if (b->name) {
+            add_macro(b);
+            return 1;
+        }
+        int i;
+        for (i = 0; i < b->count && expand(b, NULL, text, line, depth) == 0; i++)
+            ;
+        free_body(b);
+        return 1;
+    }
+
+    switch (dir) {
+        case DIR_MACRO:
+            if (label) label_stmt(text, label, line);
+            open_macro(e, text, line);
+            return 1;
+        case DIR_REPT:
+            if (label) label_stmt(text, label, line);
+            open_rept(e, text, line);
+            return 1;
+        case DIR_INCLUDE:
+            if (label) label_stmt(text, label, line);
+            include(e, text, line, depth);
+            return 1;
+        case DIR_ENDM:
+        case DIR_ENDR:
+            ir_error(text, line, dir == DIR_ENDM ? "macro: .endm without .macro" :
+                                                   "rept: .endr without .rept");
+            return 1;
+    }
+
+    // call of a macro
+    struct body* m = e > p ? find_macro(p, e - p) : NULL;
+    if (m == NULL)
+        return 0;
+    char* args[STRLEN];
+    int i, n = split_args(e, args, STRLEN);
+    if (label) label_stmt(text, label, line);
+    if (n != m->nparams) {
+        char msg[STRLEN];
+        snprintf(msg, sizeof msg, "macro: %s takes %d arguments, %s given", m->name, m->nparams,
+                 n < 0 ? "too many" : int_to_str(n));
+        ir_error(text, line, msg);
+    }
+    else expand(m, args, text, line, depth);
+    for (i = 0; i < n; i++)
+        free(args[i]);
+    return 1;
+}
+
+/* report a .macro or .rept never closed */
+void macro_end()
+{
+    if (recording == NULL) return;
+    ir_error(recording->name ? ".macro" : ".rept", rec_line,
+             recording->name ? "macro: .endm expected" : "rept: .endr expected");
+    free_body(recording);
+    recording = NULL;
+}
+
+void macro_free()
+{
+    int i;
+    for (i = 0; i < nmacros; i++)
+        free_body(macros[i]);
+    free(macros);
+    free(slots);
+    free_body(recording);
+    macros = NULL;
+    slots = NULL;
+    recording = NULL;
+    nmacros = nslots = nest = expansions = 0;
+    expanded = 0;
+}
@@ -0,0 +1,13 @@
+/*
+ * macro.h -- .macro, .rept and .include while the source is read
+ */
+
+#ifndef MACRO_INCL
+#define MACRO_INCL
+
+void  macro_init();
+int   macro_line(char* text, int line, int depth);
+void  macro_end();
+void  macro_free();
+
+#endif /* MACRO_INCL */
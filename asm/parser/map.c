@@ -0,0 +1,239 @@
+/*
+ * map.c -- where the image size and the cycles go, parser --map and min16-ld --map
+ *
+ * After assemble, the statements are placed once more (place_statements,
+ * asm.c) and their words read back from the memory image (out.c), so the
+ * map shows what the 2nd path wrote, without a run:
+ *
+ *     SEGMENTS   one from address 0 and one from every .org: bytes of code and data
+ *     LABELS     address of every label, value of every .equ, in source order
+ *     AUTOGEN    every instruction written as more than one word, and why (encoder.c)
+ *     ROUTINES   every label-delimited routine: instruction words, data bytes
+ *                and cycles with each of its instructions run once
+ *
+ * Cycles follow the states of the cpu/min16 FSM (cpu.vhd) with memory
+ * ready at once: Init, MemOP, Fetch, Decode and Execute for most
+ * instructions, LoadStoreMemSet and LoadStoreMemOP in place of Execute for
+ * SW and SB, and LoadWriteBack after them for LW and LB.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "map.h"
+#include "asm.h"
+#include "ir.h"
+#include "expr.h"
+#include "symtab.h"
+#include "encoder.h"
+#include "strfunc.h"
+#include "out.h"
+#include "common.h"
+
+#define OP_LW    0b110000   // opfunc of the memory instructions (encoder.c)
+#define OP_LB    0b110001
+#define OP_SW    0b110010
+#define OP_SB    0b110011
+
+/* cycles of an instruction class in the cpu/min16 FSM */
+#define CYCLES_ALU    5     // and J, JR, BEQ, BNE, SYS
+#define CYCLES_STORE  6
+#define CYCLES_LOAD   7
+
+#define TEXT_WIDTH    39    // instruction column of AUTOGEN, clipped
+
+extern void update_address(int);                    // defined in asm.c
+
+/* file scope variables */
+static int* addr;           /* address of every statement, and the end */
+
+
+/**
+* Helper Functions
+*/
+
+/* cycles of the instruction word */
+static int cycles_of(int word)
+{
+    int op = (word >> 10) & 0x3f;
+    if (op == OP_LW || op == OP_LB) return CYCLES_LOAD;
+    if (op == OP_SW || op == OP_SB) return CYCLES_STORE;
+    return CYCLES_ALU;
+}
+
+/* return 1 if st writes data */
+static int is_data(struct stmt* st)
+{
+    return st->kind == ST_DIRECTIVE && (st->dir == DIR_WORD || st->dir == DIR_HALF ||
+           st->dir == DIR_BYTE || st->dir == DIR_ASCII || st->dir == DIR_ASCIIZ || st->dir == DIR_SPACE);
+}
+
+/* return 1 if st starts a routine: a label other than .equ, or .org */
+static int starts_routine(struct stmt* st)
+{
+    int equ = st->kind == ST_DIRECTIVE && st->dir == DIR_EQU;
+    return (st->label && !equ) || (st->kind == ST_DIRECTIVE && st->dir == DIR_ORG);
+}
+
+/* address of the first word of instruction statement i */
+static int start_of(int i)
+{
+    return addr[i] + (addr[i] & 1);
+}
+
+/* words the 2nd path wrote for statement i, 0 unless it is an instruction */
+static int words_of(int i)
+{
+    struct stmt* st = ir_get(i);
+    if (st->kind != ST_INSTR && st->kind != ST_WORD) return 0;
+    return (addr[i + 1] - start_of(i)) / 2;
+}
+
+/* bytes of data statement i */
+static int data_of(int i)
+{
+    return is_data(ir_get(i)) ? addr[i + 1] - addr[i] : 0;
+}
+
+/* cycles of the words of statement i, each run once */
+static long cycles_at(int i)
+{
+    int k, n = words_of(i);
+    long cycles = 0;
+    for (k = 0; k < n; k++)
+        cycles += cycles_of(out_read(start_of(i) + 2 * k));  // out.c
+    return cycles;
+}
+
+/* one line for every .org, code and data bytes between it and the next */
+static void map_segments(FILE* fp, int n)
+{
+    int i, j, k;
+    fprintf(fp, "[-- SEGMENTS --]\n%-8s%-8s%8s%8s%8s\n", "start", "end", "bytes", "code", "data");
+    for (i = 0; i < n; i = j) {
+        struct stmt* st = ir_get(i);
+        int start = st->kind == ST_DIRECTIVE && st->dir == DIR_ORG ? addr[i + 1] : 0;  // .org moved it
+        long code = 0, data = 0;
+        for (j = i + 1; j < n; j++) {
+            st = ir_get(j);
+            if (st->kind == ST_DIRECTIVE && st->dir == DIR_ORG) break;
+        }
+        for (k = i; k < j; k++) {
+            code += 2 * words_of(k);
+            data += data_of(k);
+        }
+        if (addr[j] > start)
+            fprintf(fp, "0x%04x  0x%04x  %8d%8ld%8ld\n", start, addr[j], addr[j] - start, code, data);
+    }
+    fprintf(fp, "\n");
+}
+
+/* every label and .equ in source order */
+static void map_labels(FILE* fp, int n)
+{
+    int i;
+    fprintf(fp, "[-- LABELS --]\n%-8s%-8s%s\n", "address", "word", "label");
+    for (i = 0; i < n; i++) {
+        struct stmt* st = ir_get(i);
+        if (!st->label) continue;
+        struct symbol* s = sym_get(st->sym);
+        if (st->kind == ST_DIRECTIVE && st->dir == DIR_EQU)
+            fprintf(fp, "%-16s%s (.equ %d, 0x%04x)\n", "", s->str, s->num, s->num & 0xffff);
+        else
+            fprintf(fp, "0x%04x  0x%04x  %s\n", s->num & 0xffff, (s->num & 0xffff) / 2, s->str);
+    }
+    fprintf(fp, "\n");
+}
+
+/* length of the instruction in text, without its comment and trailing blanks */
+static int code_length(char* text)
+{
+    int len = 0, quote = 0;
+    for (; text[len] != '\0'; len++) {
+        if (quote && text[len] == quote) quote = 0;
+        else if (!quote && (text[len] == '\'' || text[len] == '"')) quote = text[len];
+        else if (!quote && text[len] == '#') break;
+    }
+    while (len > 0 && isspace((unsigned char) text[len - 1])) len--;
+    return len;
+}
+
+/* every instruction of more than one word, with the reason encoder.c gives */
+static void map_autogen(FILE* fp, int n)
+{
+    int i, sites = 0, extra = 0;
+    char why[STRLEN];
+    fprintf(fp, "[-- AUTOGEN --]\n%-6s%-8s%6s  %-*s %s\n", "line", "address", "words", TEXT_WIDTH, "instruction", "why");
+    for (i = 0; i < n; i++) {
+        struct stmt* st = ir_get(i);
+        int words = words_of(i);
+        if (st->kind != ST_INSTR || words < 2) continue;
+        update_address(start_of(i));  // asm.c, for '$'
+        int num = st->ops.expr ? expr_eval(st->ops.expr) : 0;
+        autogen_why(&st->ops, num, words, why, sizeof why);  // encoder.c
+        char* text = strip(st->text);
+        int len = code_length(text);
+        fprintf(fp, "%-6d0x%04x  %6d  %-*.*s %s\n", st->line, start_of(i), words,
+                TEXT_WIDTH, len < TEXT_WIDTH ? len : TEXT_WIDTH, text, why);
+        sites++;
+        extra += words - 1;
+    }
+    fprintf(fp, "%d sites, %d words more than one each\n\n", sites, extra);
+}
+
+/* every routine: from a label or .org to the next one */
+static void map_routines(FILE* fp, int n)
+{
+    int i, j;
+    long words = 0, data = 0, cycles = 0;
+    fprintf(fp, "[-- ROUTINES --]\n%-8s%8s%8s%8s  %s\n", "address", "words", "data", "cycles", "routine");
+    for (i = 0; i < n; i = j) {
+        struct stmt* st = ir_get(i);
+        long w = words_of(i), d = data_of(i), c = cycles_at(i);
+        for (j = i + 1; j < n && !starts_routine(ir_get(j)); j++) {
+            w += words_of(j);
+            d += data_of(j);
+            c += cycles_at(j);
+        }
+        int org = st->kind == ST_DIRECTIVE && st->dir == DIR_ORG;
+        if (w == 0 && d == 0 && (org || !st->label)) continue;
+        fprintf(fp, "0x%04x  %8ld%8ld%8ld  %s\n", (org ? addr[i + 1] : start_of(i)) & 0xffff, w, d, c,
+                st->label ? sym_get(st->sym)->str : "-");
+        words += w;
+        data += d;
+        cycles += c;
+    }
+    fprintf(fp, "%ld words of code, %ld bytes of data, %ld cycles (%d ALU and jump, %d store, %d load)\n",
+            words, data, cycles, CYCLES_ALU, CYCLES_STORE, CYCLES_LOAD);
+}
+
+
+/**
+* Shared functions (map.h)
+*/
+
+/*
+  name:    map_write
+  purpose: write the map of the statements assemble just encoded
+  field:   name - map file to write
+*/
+void map_write(char* name)
+{
+    int n = ir_count();
+    FILE* fp = fopen(name, "w");
+    if (!fp) oops("fopen failed..")
+    if ((addr = calloc(n + 1, sizeof(int))) == NULL)
+        oops("calloc");
+    place_statements(addr);  // asm.c
+
+    fprintf(fp, "%s map\n\n", VERSION);
+    map_segments(fp, n);
+    map_labels(fp, n);
+    map_autogen(fp, n);
+    map_routines(fp, n);
+    fclose(fp);
+    free(addr);
+    addr = NULL;
+    printf("%-4s\t: %s\n\n", "MAP", name);
+}
@@ -0,0 +1,10 @@
+/*
+ * map.h -- where the image size and the cycles go
+ */
+
+#ifndef MAP_INCL
+#define MAP_INCL
+
+void map_write(char* name);
+
+#endif /* MAP_INCL */
@@ -0,0 +1,463 @@
+/*
+ * obj.c -- relocatable object files for separate assembly
+ *
+ * parser -c writes the lexed statements of one source file as an object,
+ * one record per line. min16-ld reads the objects back into one statement
+ * list (ir.c) and runs the two passes of asm.c over it, so autogen and the
+ * $at peephole are sized with the final addresses of every module.
+ *
+ *     min16 object 1                  first line
+ *     module <name>                   scopes the local labels
+ *     global <label>                  exported with .global
+ *     extern <label>                  used here, defined by another module
+ *     <line> label <label> | <src>    label defined here
+ *     <line> word <hex> | <src>       instruction encoded already: R-type, or
+ *                                     a constant operand that fits its field.
+ *                                     PUSH, POP and RET write one per word
+ *     <line> reloc <field> <mnemonic> <rd> <rs> <grow> <expr> | <src>
+ *                                     I, J or O field patched with expr at
+ *                                     link time. grow is the most autogen may
+ *                                     add in bytes, 0 if it never expands
+ *     <line> <directive> <arg>... | <src>
+ *                                     .equ <label> <expr>, .org, .align,
+ *                                     .space, .word, .half, .byte and .keep
+ *                                     with expressions, .ascii and .asciiz
+ *                                     with the string in the source
+ *     <line> note | <src>             DEBUG marker line
+ *
+ * Expressions are written without blanks (expr_print). A label that is not
+ * global is renamed "module.label" when it is linked, so every module has
+ * its own. A section runs from one .org to the next; code before the first
+ * .org of a module follows the module linked before it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "obj.h"
+#include "ir.h"
+#include "lexer.h"
+#include "expr.h"
+#include "symtab.h"
+#include "relax.h"
+#include "encoder.h"
+#include "linkedlist.h"
+#include "strfunc.h"
+#include "common.h"
+
+#define OBJMAGIC    "min16 object 1"
+#define EXPRLEN     1024    // printed expression
+
+extern int is_autogen(int num, int opfunc, int address);  // defined in encoder.c
+extern int opfunc_to_increase(int num);                   // defined in encoder.c
+
+/* symbol marks while writing */
+enum { DEFINED = 1, USED = 2, GLOBAL = 4 };
+
+/* field patched by a reloc record, by addressing mode */
+static char* field_name[] = { [I_MODE] = "I", [J_MODE] = "J", [O_MODE] = "O" };
+
+/* directive names by enum directive_id (lexer.h) */
+static char* directive_name[] = {
+    [DIR_SPACE] = ".space", [DIR_WORD] = ".word", [DIR_HALF] = ".half",
+    [DIR_BYTE] = ".byte", [DIR_ASCII] = ".ascii", [DIR_ASCIIZ] = ".asciiz",
+    [DIR_ORG] = ".org", [DIR_ALIGN] = ".align", [DIR_EQU] = ".equ",
+    [DIR_GLOBAL] = ".global", [DIR_KEEP] = ".keep",
+};
+
+/* file scope variables for linking */
+static char**      modules = NULL;   /* module names linked so far */
+static int         nmodules = 0;
+static int*        exporter = NULL;  /* module exporting symbol id, -1 if none */
+static int         nexporter = 0;
+static struct list imports;          /* module name and the symbol id it imports */
+
+
+/**
+* Helper Functions
+*/
+
+/* mark every label used in e */
+static void mark_used(struct expr* e, char* mark)
+{
+    if (e == NULL) return;
+    if (e->kind == E_SYM) mark[e->num] |= USED;
+    mark_used(e->l, mark);
+    mark_used(e->r, mark);
+}
+
+/* write one instruction as an encoded word or a relocation */
+static void write_instr(struct stmt* st, FILE* fp)
+{
+    struct operands* ops = &st->ops;
+    int mode = ops->op->mode;
+    char expr[EXPRLEN];
+    int inst[EXPANDMAX];
+    int i, n;
+
+    relax_line();  // relax.c
+    if (ops->expr == NULL) {  // R_TYPE, PUSH, POP and RET
+        n = encode_fixed(ops, inst);
+        for (i = 0; i < n; i++)
+            fprintf(fp, "%d word %04x | %s\n", st->line, inst[i] & 0xffff, strip(st->text));
+        return;
+    }
+    if (expr_const(ops->expr) && !is_autogen(expr_eval(ops->expr), ops->op->opfunc, 0)) {
+        fprintf(fp, "%d word %04x | %s\n", st->line, encode(ops) & 0xffff, strip(st->text));
+        return;
+    }
+    expr_print(ops->expr, expr, sizeof expr);
+    fprintf(fp, "%d reloc %s %s %d %d %d %s | %s\n", st->line, field_name[mode], ops->op->str,
+            ops->rd, ops->rs, opfunc_to_increase(ops->op->opfunc), expr, strip(st->text));
+}
+
+/* write one directive with its arguments */
+static void write_directive(struct stmt* st, FILE* fp)
+{
+    char expr[EXPRLEN];
+    int i;
+
+    fprintf(fp, "%d %s", st->line, directive_name[st->dir]);
+    if (st->dir == DIR_EQU)
+        fprintf(fp, " %s", sym_get(st->sym)->str);
+    for (i = 0; i < st->nargs; i++) {
+        expr_print(st->args[i].expr, expr, sizeof expr);
+        fprintf(fp, " %s", expr);
+    }
+    fprintf(fp, " | %s\n", strip(st->text));
+}
+
+/* cut the next blank separated field of a record, NULL if none */
+static char* next_field(char** pp)
+{
+    char* p = *pp;
+    while (*p == ' ') p++;
+    if (*p == '\0') return NULL;
+    char* f = p;
+    while (*p != ' ' && *p != '\0') p++;
+    if (*p) *p++ = '\0';
+    *pp = p;
+    return f;
+}
+
+/* split the first three fields of a record into f, the record is copied */
+static void head_fields(char* line, char* buf, int size, char* f[3])
+{
+    int k;
+    snprintf(buf, size, "%s", line);
+    for (k = 0; k < 3; k++) f[k] = next_field(&buf);
+}
+
+/* point the local labels used in e at their module names */
+static void localize(struct expr* e, int* local, int nlocal)
+{
+    if (e == NULL) return;
+    if (e->kind == E_SYM && e->num < nlocal && local[e->num] >= 0)
+        e->num = local[e->num];
+    localize(e->l, local, nlocal);
+    localize(e->r, local, nlocal);
+}
+
+/* parse one expression field of an object record */
+static struct expr* read_expr(char* str, int* local, int nlocal, char* filename)
+{
+    char* end;
+    struct expr* e = str ? expr_parse(str, &end) : NULL;
+    if (e == NULL || *end != '\0')
+        oops2("min16-ld: bad expression in object", filename)
+    localize(e, local, nlocal);
+    return e;
+}
+
+/* the symbol a label field names, renamed if it is local */
+static int read_label(char* name, int* local, int nlocal, char* filename)
+{
+    if (name == NULL) oops2("min16-ld: label expected in object", filename)
+    int id = sym_id(name);
+    return id < nlocal && local[id] >= 0 ? local[id] : id;
+}
+
+/* read every line of fp without its newline. return the count */
+static int read_lines(FILE* fp, char*** lines)
+{
+    char* line = NULL;
+    size_t len = 0;
+    int n = 0, max = 0;
+
+    *lines = NULL;
+    while (getline(&line, &len, fp) != -1) {
+        if (n == max) {
+            max = max ? max * 2 : 64;
+            if ((*lines = realloc(*lines, max * sizeof(char*))) == NULL)
+                oops("realloc");
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if (((*lines)[n++] = strdup(line)) == NULL)
+            oops("strdup");
+    }
+    free(line);
+    return n;
+}
+
+
+/**
+* Shared functions (obj.h)
+*/
+
+/*
+  name:    obj_write
+  purpose: write the statements (ir.c) of one source file as an object
+  field:   filename - object file to write
+           module   - module name, scopes the labels that are not global
+  return:  0, or the number of errors reported (nothing is written)
+*/
+int obj_write(char* filename, char* module)
+{
+    int i, j, nsyms = sym_total();
+    char* mark = calloc(nsyms + 1, 1);
+    struct list error_list;
+    if (mark == NULL) oops("calloc");
+    init_list(&error_list, NULL);
+
+    // labels defined, used and exported
+    for (i = 0; i < ir_count(); i++) {
+        struct stmt* st = ir_get(i);
+        char* line = strip(st->text);
+        if (strstr(st->text, "DEBUG")) continue;
+        if (st->label) mark[st->sym] |= DEFINED;
+        if (st->kind == ST_INSTR) mark_used(st->ops.expr, mark);
+        for (j = 0; j < st->nargs; j++) {
+            if (st->dir == DIR_GLOBAL) mark[st->args[j].expr->num] |= GLOBAL;
+            else mark_used(st->args[j].expr, mark);
+        }
+        if (st->kind == ST_ERROR)
+            build_error_list(&error_list, concat2(st->error, line), st->line);
+        else if (!st->label && st->kind == ST_UNKNOWN)
+            build_error_list(&error_list, concat2("Wrong Format", line), st->line);
+    }
+    for (i = 0; i < nsyms; i++) {
+        if ((mark[i] & GLOBAL) && !(mark[i] & DEFINED))
+            build_error_list(&error_list, concat2("global label not defined", sym_get(i)->str), 0);
+    }
+    if (error_list.next != NULL) {
+        int errors = getlength(&error_list);
+        printf("[-- ERROR LIST REPORT --]\n");
+        dumplist(&error_list, "line", 'd');    // decimal
+        freelist(&error_list);
+        free(mark);
+        return errors;
+    }
+
+    FILE* fp = fopen(filename, "w");
+    if (!fp) oops("fopen failed..")
+    fprintf(fp, "%s\nmodule %s\n", OBJMAGIC, module);
+    for (i = 0; i < nsyms; i++) {
+        if (mark[i] & GLOBAL)
+            fprintf(fp, "global %s\n", sym_get(i)->str);
+        else if ((mark[i] & USED) && !(mark[i] & DEFINED))
+            fprintf(fp, "extern %s\n", sym_get(i)->str);
+    }
+
+    relax_init();  // encode_* look at the labels of the line
+    for (i = 0; i < ir_count(); i++) {
+        struct stmt* st = ir_get(i);
+        if (strstr(st->text, "DEBUG")) {
+            fprintf(fp, "%d note | %s\n", st->line, st->text);
+            continue;
+        }
+        if (st->label && st->dir != DIR_EQU)
+            fprintf(fp, "%d label %s | %s\n", st->line, sym_get(st->sym)->str, strip(st->text));
+        if (st->kind == ST_INSTR)
+            write_instr(st, fp);
+        else if (st->kind == ST_DIRECTIVE && st->dir != DIR_GLOBAL)
+            write_directive(st, fp);
+    }
+    relax_free();
+    fclose(fp);
+    free(mark);
+    printf("%-4s\t: %s\n", "OBJECT", filename);
+    return 0;
+}
+
+/*
+  name:    obj_read
+  purpose: append the statements of an object file to the list (ir.c).
+           global labels keep their names, the others become "module.label"
+  field:   filename - object file written by obj_write
+*/
+void obj_read(char* filename)
+{
+    FILE* fp = fopen(filename, "r");
+    if (!fp) oops2("min16-ld: cannot open", filename)
+    char** lines;
+    int nlines = read_lines(fp, &lines);
+    fclose(fp);
+    if (nlines == 0 || strcmp(lines[0], OBJMAGIC) != 0)
+        oops2("min16-ld: not a min16 object", filename)
+
+    char buf[STRLEN];
+    char* module = NULL;
+    char* f[3];
+    char* p;
+    int i, j;
+
+    // module name, and every label named gets its id
+    for (i = 1; i < nlines; i++) {
+        head_fields(lines[i], buf, sizeof buf, f);
+        if (f[1] && strcmp(f[0], "module") == 0)
+            module = intern(f[1]);  // symtab.c
+        else if (f[1] && (strcmp(f[0], "global") == 0 || strcmp(f[0], "extern") == 0))
+            sym_id(f[1]);
+        else if (f[2] && (strcmp(f[1], "label") == 0 || strcmp(f[1], ".equ") == 0))
+            sym_id(f[2]);
+    }
+    if (module == NULL)
+        oops2("min16-ld: no module name", filename)
+    for (i = 0; i < nmodules; i++) {
+        if (modules[i] == module)
+            oops2("min16-ld: module linked twice", module)
+    }
+    if ((modules = realloc(modules, (nmodules + 1) * sizeof(char*))) == NULL)
+        oops("realloc");
+    modules[nmodules] = module;
+    if (nmodules == 0) init_list(&imports, NULL);
+
+    // exported and local labels
+    int nlocal = sym_total();
+    int* local = malloc(nlocal * sizeof(int));
+    if (local == NULL) oops("malloc");
+    for (i = 0; i < nlocal; i++) local[i] = -1;
+    if ((exporter = realloc(exporter, nlocal * sizeof(int))) == NULL)
+        oops("realloc");
+    for (; nexporter < nlocal; nexporter++) exporter[nexporter] = -1;
+
+    for (i = 1; i < nlines; i++) {
+        head_fields(lines[i], buf, sizeof buf, f);
+        if (f[1] && strcmp(f[0], "global") == 0) {
+            int id = sym_id(f[1]);
+            if (exporter[id] >= 0)
+                oops2("min16-ld: label exported by two modules", f[1])
+            exporter[id] = nmodules;
+        }
+        else if (f[1] && strcmp(f[0], "extern") == 0)
+            build_error_list(&imports, module, sym_id(f[1]));
+        else if (f[2] && (strcmp(f[1], "label") == 0 || strcmp(f[1], ".equ") == 0))
+            local[sym_id(f[2])] = -2;  // defined here
+    }
+    for (i = 0; i < nlocal; i++) {
+        if (local[i] == -2 && exporter[i] != nmodules) {
+            char name[STRLEN];
+            snprintf(name, sizeof name, "%s.%s", module, sym_get(i)->str);
+            local[i] = sym_id(name);
+        }
+        else local[i] = -1;
+    }
+
+    // statements, a label joins the next record of its line
+    int labelled = -1;
+    for (i = 1; i < nlines; i++) {
+        char* src = strstr(lines[i], " | ");
+        if (src == NULL)
+            continue;  // header
+        *src = '\0';
+        src += 3;
+        p = lines[i];
+        char* num = next_field(&p);
+        char* kind = next_field(&p);
+        if (num == NULL || kind == NULL)
+            oops2("min16-ld: bad record in object", filename)
+        int line = atoi(num);
+
+        if (labelled >= 0 && ir_get(labelled)->line != line)
+            labelled = -1;
+        if (strcmp(kind, "note") == 0) {
+            ir_append(src, line);
+            continue;
+        }
+        if (strcmp(kind, "label") == 0) {
+            struct stmt* st = ir_append(src, line);
+            st->kind = ST_LABEL;
+            st->label = 1;
+            st->sym = read_label(next_field(&p), local, nlocal, filename);
+            labelled = ir_count() - 1;
+            continue;
+        }
+
+        // the statement of the label on this line, or a new one
+        struct stmt* st = labelled >= 0 ? ir_get(labelled) : ir_append(src, line);
+        labelled = -1;
+        if (strcmp(kind, "word") == 0) {
+            char* word = next_field(&p);
+            if (word == NULL) oops2("min16-ld: bad record in object", filename)
+            st->kind = ST_WORD;
+            st->word = (int) strtol(word, NULL, 16);
+        }
+        else if (strcmp(kind, "reloc") == 0) {
+            next_field(&p);  // field, known from the mnemonic
+            char* name = next_field(&p);
+            char* rd = next_field(&p);
+            char* rs = next_field(&p);
+            next_field(&p);  // grow, sized again by relax.c
+            if (name == NULL || rd == NULL || rs == NULL ||
+                (st->ops.op = lookup_mnemonic(name, strlen(name))) == NULL)
+                oops2("min16-ld: bad relocation in object", filename)
+            st->kind = ST_INSTR;
+            st->ops.rd = atoi(rd);
+            st->ops.rs = atoi(rs);
+            st->ops.expr = read_expr(next_field(&p), local, nlocal, filename);
+        }
+        else if ((st->dir = lookup_directive(kind, strlen(kind))) >= 0) {
+            st->kind = ST_DIRECTIVE;
+            if (st->dir == DIR_EQU) {
+                st->label = 1;
+                st->sym = read_label(next_field(&p), local, nlocal, filename);
+            }
+            char* arg;
+            for (j = 0; (arg = next_field(&p)) != NULL; j++) {
+                if ((st->args = realloc(st->args, (j + 1) * sizeof(struct arg))) == NULL)
+                    oops("realloc");
+                if ((st->args[j].text = strdup(arg)) == NULL)
+                    oops("strdup");
+                st->args[j].expr = read_expr(arg, local, nlocal, filename);
+                st->nargs = j + 1;
+            }
+        }
+        else oops2("min16-ld: unknown record in object", kind)
+    }
+
+    for (i = 0; i < nlines; i++)
+        free(lines[i]);
+    free(lines);
+    free(local);
+    nmodules++;
+}
+
+/*
+  name:    obj_check
+  purpose: check that every label a module imports is exported by another
+  return:  number of labels not found, each reported
+*/
+int obj_check()
+{
+    int errors = 0;
+    struct list* p;
+    for (p = nmodules ? imports.next : NULL; p != NULL; p = p->next) {
+        if (p->num < nexporter && exporter[p->num] >= 0)
+            continue;
+        fprintf(stderr, "min16-ld: undefined label [%s] in module [%s]\n", sym_get(p->num)->str, p->str);
+        errors++;
+    }
+    return errors;
+}
+
+/* release the module and import tables */
+void obj_free()
+{
+    if (nmodules > 0) freelist(&imports);
+    free(modules);
+    free(exporter);
+    modules = NULL;
+    exporter = NULL;
+    nmodules = nexporter = 0;
+}
@@ -0,0 +1,13 @@
+/*
+ * obj.h -- relocatable object files for separate assembly
+ */
+
+#ifndef OBJ_INCL
+#define OBJ_INCL
+
+int   obj_write(char* filename, char* module);
+void  obj_read(char* filename);
+int   obj_check();
+void  obj_free();
+
+#endif /* OBJ_INCL */
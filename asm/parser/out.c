@@ -0,0 +1,212 @@
+/*
+ * out.c -- memory image and the output file formats
+ *
+ * The 2nd path stores every word it encodes in a 32K word image, and the
+ * image is written in one go when the path ends. .byte, .ascii and
+ * .asciiz store single bytes, two to a word, little endian as the
+ * emulator loads them (LB of an even address reads the low byte):
+ *
+ *     mif   address : data lines only, in address order
+ *     bin   little endian words from address 0 up to the last word written
+ *     hex   Intel HEX, byte addresses, 16 data bytes per record
+ *
+ * The annotated mif, with the source line, binary and autogen comments of
+ * every word, is written by asm.c while it encodes and only when asked
+ * for, so the other formats never format a comment.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "out.h"
+#include "common.h"
+
+#define WORDS   32768   // memory depth in 16 bit words
+
+/* file scope variables */
+static uint16_t image[WORDS];       /* memory image */
+static uint8_t  used[WORDS / 8];    /* 1 bit for every word written */
+static int      last = -1;          /* highest word address written */
+
+static const char lower[] = "0123456789abcdef";    /* mif digits */
+static const char upper[] = "0123456789ABCDEF";    /* Intel HEX digits */
+
+
+/**
+* Helper Functions
+*/
+
+/* return 1 if word address a was written */
+static int is_used(int a)
+{
+    return used[a >> 3] >> (a & 7) & 1;
+}
+
+/* write n hex digits of v at p, return the end */
+static char* put_hex(char* p, unsigned v, int n, const char* digit)
+{
+    while (n--)
+        *p++ = digit[(v >> (4 * n)) & 0xf];
+    return p;
+}
+
+/* minimal mif: the header of asm.c and one line per word */
+static void write_mif(FILE* fp, char* header)
+{
+    char* buf = malloc((last + 1) * 16 + 1);
+    char* p = buf;
+    int a;
+    if (buf == NULL) oops("malloc");
+    for (a = 0; a <= last; a++) {
+        if (!is_used(a)) continue;
+        *p++ = '\t';
+        p = put_hex(p, a, 4, lower);
+        memcpy(p, " : ", 3);
+        p = put_hex(p + 3, image[a], 4, lower);
+        *p++ = ';';
+        *p++ = '\n';
+    }
+    fprintf(fp, "%s\n", header);
+    fwrite(buf, 1, p - buf, fp);
+    fprintf(fp, "END;\n");
+    free(buf);
+}
+
+/* binary: little endian words, as the emulator stores them */
+static void write_bin(FILE* fp)
+{
+    uint8_t* buf = malloc((last + 1) * 2 + 1);
+    int a;
+    if (buf == NULL) oops("malloc");
+    for (a = 0; a <= last; a++) {
+        buf[2 * a] = image[a] & 0xff;
+        buf[2 * a + 1] = image[a] >> 8;
+    }
+    fwrite(buf, 1, (last + 1) * 2, fp);
+    free(buf);
+}
+
+/* one Intel HEX record of n bytes at byte address addr */
+static char* hex_record(char* p, int type, int addr, uint8_t* data, int n)
+{
+    unsigned sum = n + (addr >> 8) + (addr & 0xff) + type;
+    int i;
+    *p++ = ':';
+    p = put_hex(p, n, 2, upper);
+    p = put_hex(p, addr, 4, upper);
+    p = put_hex(p, type, 2, upper);
+    for (i = 0; i < n; i++) {
+        p = put_hex(p, data[i], 2, upper);
+        sum += data[i];
+    }
+    p = put_hex(p, -sum & 0xff, 2, upper);
+    *p++ = '\n';
+    return p;
+}
+
+/* Intel HEX: records over runs of written words, then end of file */
+static void write_hex(FILE* fp)
+{
+    char* buf = malloc((last + 1) * 6 + 64);  // 16 bytes take 44 chars
+    char* p = buf;
+    uint8_t data[16];
+    int a = 0;
+    if (buf == NULL) oops("malloc");
+    while (a <= last) {
+        if (!is_used(a)) {
+            a++;
+            continue;
+        }
+        int start = a, n = 0;
+        while (a <= last && is_used(a) && n < 16) {
+            data[n++] = image[a] & 0xff;
+            data[n++] = image[a] >> 8;
+            a++;
+        }
+        p = hex_record(p, 0, start * 2, data, n);
+    }
+    p = hex_record(p, 1, 0, NULL, 0);
+    fwrite(buf, 1, p - buf, fp);
+    free(buf);
+}
+
+
+/**
+* Shared functions (out.h)
+*/
+
+/* empty the image */
+void out_clear()
+{
+    memset(used, 0, sizeof used);
+    last = -1;
+}
+
+/* return 1 if byte address is inside the memory */
+int out_inside(int address)
+{
+    return address >= 0 && address / 2 < WORDS;
+}
+
+/* store value at byte address. -1 if it is outside the memory */
+int out_word(int address, int value)
+{
+    int a = address / 2;
+    if (!out_inside(address))
+        return -1;
+    image[a] = value;
+    used[a >> 3] |= 1 << (a & 7);
+    if (a > last) last = a;
+    return 0;
+}
+
+/* store the byte value at byte address, keeping the other byte of the word.
+   -1 if it is outside the memory */
+int out_byte(int address, int value)
+{
+    int a = address / 2;
+    int shift = (address & 1) * 8;
+    if (!out_inside(address))
+        return -1;
+    if (!is_used(a))
+        image[a] = 0;
+    image[a] = (image[a] & ~(0xff << shift)) | (value & 0xff) << shift;
+    used[a >> 3] |= 1 << (a & 7);
+    if (a > last) last = a;
+    return 0;
+}
+
+/* word stored at byte address, 0 if none was */
+int out_read(int address)
+{
+    int a = address / 2;
+    return out_inside(address) && is_used(a) ? image[a] : 0;
+}
+
+/* write the image in format (enum out_format) to fp. header is the mif one */
+void out_write(FILE* fp, int format, char* header)
+{
+    switch (format) {
+        case OUT_MIF: write_mif(fp, header); break;
+        case OUT_BIN: write_bin(fp);         break;
+        case OUT_HEX: write_hex(fp);         break;
+    }
+}
+
+/* format named by str, -1 if none */
+int out_format(char* str)
+{
+    static char* names[] = { [OUT_AMIF] = "amif", [OUT_MIF] = "mif", [OUT_BIN] = "bin", [OUT_HEX] = "hex" };
+    int i;
+    for (i = 0; i < (int) (sizeof names / sizeof names[0]); i++) {
+        if (strcmp(str, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+/* file extension of format */
+char* out_ext(int format)
+{
+    return format == OUT_BIN ? "bin" : format == OUT_HEX ? "hex" : "mif";
+}
@@ -0,0 +1,24 @@
+/*
+ * out.h -- memory image and the output file formats
+ */
+
+#ifndef OUT_INCL
+#define OUT_INCL
+
+#include <stdio.h>
+
+/* output formats, -f of parser and min16-ld */
+enum out_format {
+    OUT_AMIF, OUT_MIF, OUT_BIN, OUT_HEX,
+};
+
+void  out_clear();
+int   out_inside(int address);
+int   out_word(int address, int value);
+int   out_byte(int address, int value);
+int   out_read(int address);
+void  out_write(FILE* fp, int format, char* header);
+int   out_format(char* str);
+char* out_ext(int format);
+
+#endif /* OUT_INCL */
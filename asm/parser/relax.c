@@ -0,0 +1,819 @@
+/*
+ * relax.c -- span-dependent instruction relaxation
+ *
+ * An I, J or O instruction whose operand mentions a label or '$' is a
+ * site: it is either short (one word) or autogen-expanded, which grows it
+ * by the bytes autogen needs for the operand value, at most the longest
+ * form of its expansion template in encoder.c (12 or 14 bytes). The 1st
+ * path assumes every site short and records it here together with the
+ * .org and .align directives that reset or realign the address shift.
+ *
+ * With the peephole on (-O1) every autogen candidate is a site, and a site
+ * remembers the earlier site in its basic block that last set $at (src).
+ * When both evaluate to the same value the site reuses $at and needs only
+ * the instructions after the constant. A site also depends on the labels
+ * of its src, so it is evaluated again whenever that value may change.
+ * A branch or jump with a constant operand may go to an address without a
+ * label, so it is recorded too, and a site after its target in the block
+ * of its src loads $at again.
+ *
+ * addr_resolution then relaxes the sites in rounds. The first round
+ * evaluates every site, a later one only the sites whose value a growth
+ * of the round before can move: a distance between labels and '$' only
+ * when the growth is inside it, anything else when it is in front of its
+ * last label. The shift each item adds is kept in a Fenwick tree, so a
+ * growth moves the items after it without a sweep. Sites only grow and
+ * the growth is bounded, so every round but the last grows at least one
+ * site and the loop ends; the 2nd path emits each site at the size chosen here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "relax.h"
+#include "symtab.h"
+#include "expr.h"
+#include "decoder.h"
+#include "common.h"
+
+#define ITEMS       256     // initial item slots
+#define MAXDEPS     8       // labels remembered per line, more re-evaluate every round
+#define MAXROUNDS   1000    // give up relaxing and expand the rest after this many rounds
+#define MEMTOP      0x10000 // byte address space
+
+/* Helper function declarations */
+void* emalloc(size_t n);                            // defined in linkedlist.c
+
+extern int  get_address();                          // defined in asm.c
+extern void update_address(int);                    // defined in asm.c
+
+/* defined in encoder.c */
+extern int opfunc_to_increase(int num);
+extern int autogen_increase(int num, int opfunc, struct operands* ops);
+extern int is_autogen(int num, int opfunc, int address);
+extern int branch_target(int opfunc, int num, int address);
+extern int branch_offset(int opfunc, struct expr* e, int num, int address);
+extern int is_branch(int opfunc);
+
+/* item kinds */
+enum item_kind { SITE, ORG, ALIGN, BRANCH };
+
+/*
+  name:    item
+  purpose: one span-dependent instruction, address barrier or branch, in source order
+  field:   kind    - SITE, ORG, ALIGN or BRANCH
+           base    - 1st path address (every site short)
+           addr    - address after relaxation
+           arg     - SITE: largest autogen increase, ALIGN: alignment in bytes,
+                     ORG: label the location follows (.org label), -1 if absolute
+           opfunc  - SITE, BRANCH: opcode and function code
+           expr    - SITE: operand expression tree, owned by the statement (ir.c)
+           ops     - SITE: operands of the statement, NULL for the longest expansion
+           grow    - SITE: address increase chosen so far. never shrinks
+           src     - SITE: earlier site whose value $at holds here, -1 if none
+           reuse   - SITE: increase when $at already holds the value
+           num     - SITE: value at the final address, BRANCH: constant operand
+           at      - SITE: 1 if the final site reuses $at
+           dep_n   - SITE: number of its own label edges, starting at dep_first
+           always  - SITE: too many labels to track, evaluate every round
+           uses_pc - SITE: expression uses '$'
+*/
+struct item {
+    int   kind;
+    int   base;
+    int   addr;
+    int   arg;
+    int   opfunc;
+    struct expr* expr;
+    struct operands* ops;
+    int   grow;
+    int   src;
+    int   reuse;
+    int   num;
+    int   dep_first;
+    int   dep_n;
+    char  at;
+    char  always;
+    char  uses_pc;
+};
+
+/* label to site dependency edge */
+struct dep {
+    int sym;
+    int item;
+};
+
+/* file scope variables */
+static struct item* items;          /* sites and barriers in source order */
+static int          nitems, maxitems;
+static struct dep*  deps;           /* label to site edges */
+static int          ndeps, maxdeps;
+static int*         shift_at;       /* address shift in front of item i, after a sweep */
+static int*         part;           /* address shift item i adds, summed by the Fenwick tree fen */
+static int*         fen;
+static int*         reach;          /* last position the value of site i moves with */
+static int*         moving;         /* sites moved by any change in front of their reach, by reach */
+static int          nmoving;
+static int*         fars;           /* expanded branches, moved by a change in front of their reach too */
+static int          nfars;
+static int*         span_start;     /* span sites of segment tree node k are span_site[span_start[k]..span_start[k+1]) */
+static int*         span_site;
+static int          leaves;         /* positions in the segment tree, a power of 2 */
+static int*         bars;           /* .org and .align items in order */
+static int          nbars;
+static int*         changed;        /* items whose shift changed this round */
+static int*         stamp;          /* round an item was last queued in */
+static int*         work;           /* sites to evaluate this round */
+static __thread int next_site;      /* 2nd path cursor, one per encoding thread */
+static int          resolving;      /* 1 while evaluating, stops dependency recording */
+
+/* the current line, one per encoding thread */
+static __thread int line_syms[MAXDEPS];  /* labels used on the current line */
+static __thread int line_nsyms;
+static __thread int line_pc;             /* current line uses '$' */
+static __thread int line_over;           /* more labels than MAXDEPS */
+
+
+/**
+* Helper Functions
+*/
+
+/* append an item and return it */
+static struct item* new_item(int kind, int base)
+{
+    if (nitems == maxitems) {
+        maxitems = maxitems ? maxitems * 2 : ITEMS;
+        if ((items = realloc(items, maxitems * sizeof(struct item))) == NULL)
+            oops("realloc");
+    }
+    struct item* it = &items[nitems++];
+    memset(it, 0, sizeof(struct item));
+    it->kind = kind;
+    it->base = base;
+    it->addr = base;
+    return it;
+}
+
+/* append a label to site edge */
+static void new_dep(int sym, int item)
+{
+    if (ndeps == maxdeps) {
+        maxdeps = maxdeps ? maxdeps * 2 : ITEMS;
+        if ((deps = realloc(deps, maxdeps * sizeof(struct dep))) == NULL)
+            oops("realloc");
+    }
+    deps[ndeps].sym = sym;
+    deps[ndeps].item = item;
+    ndeps++;
+}
+
+/* round n up to a multiple of aln */
+static int round_up(int n, int aln)
+{
+    return aln <= 1 ? n : (n + aln - 1) / aln * aln;
+}
+
+/* position of the label a .org location follows, which moves it too. -1 if absolute */
+static int org_from(struct item* it, int i)
+{
+    if (it->arg < 0) return -1;  // .org is absolute
+    struct symbol* s = sym_get(it->arg);
+    if (!s->defined || !s->reloc || s->count > i) return -1;
+    return s->count;
+}
+
+/* place every item with the current site sizes */
+static void sweep()
+{
+    int i, j, shift = 0;
+    for (i = 0; i < nitems; i++) {
+        struct item* it = &items[i];
+        shift_at[i] = shift;
+        it->addr = it->base + shift;
+        switch (it->kind) {
+            case SITE:  shift += it->grow; break;
+            case ORG:   shift = (j = org_from(it, i)) < 0 ? 0 : shift_at[j]; break;
+            case ALIGN: shift = round_up(it->addr, it->arg) - round_up(it->base, it->arg); break;
+        }
+    }
+    shift_at[nitems] = shift;
+}
+
+/* move every relocatable label by the shift in front of it, after a sweep */
+static void place_labels()
+{
+    int i, nsyms = sym_total();
+    for (i = 0; i < nsyms; i++) {
+        struct symbol* s = sym_get(i);
+        if (s->defined && s->reloc)
+            s->num = s->base + shift_at[s->count];
+    }
+}
+
+/* add d to the shift item i adds (Fenwick tree) */
+static void shift_add(int i, int d)
+{
+    part[i] += d;
+    for (i++; i <= nitems; i += i & -i)
+        fen[i] += d;
+}
+
+/* address shift in front of item i, part[0] to part[i - 1] */
+static int shift_before(int i)
+{
+    int shift = 0;
+    for (; i > 0; i -= i & -i)
+        shift += fen[i];
+    return shift;
+}
+
+/* move label id by the current shift in front of it, between sweeps */
+static void place_label(int id)
+{
+    struct symbol* s = sym_get(id);
+    if (s->defined && s->reloc)
+        s->num = s->base + shift_before(s->count);
+}
+
+/* place a site and the labels it uses with the current sizes, between sweeps */
+static void place(int i)
+{
+    struct item* it = &items[i];
+    int j;
+    it->addr = it->base + shift_before(i);
+    for (j = it->dep_first; j < it->dep_first + it->dep_n; j++)
+        place_label(deps[j].sym);
+}
+
+/* queue a site that can still grow once per round */
+static void queue(int* n, int i, int round)
+{
+    if (items[i].kind != SITE || items[i].grow == items[i].arg || stamp[i] == round)
+        return;
+    stamp[i] = round;
+    work[(*n)++] = i;
+}
+
+/* evaluate the operand of a site at its current address, a branch to a label as the words to it */
+static int eval(struct item* it)
+{
+    int saved = get_address();
+    update_address(it->addr);  // '$' is the site address
+    int num = branch_offset(it->opfunc, it->expr, expr_eval(it->expr), it->addr);
+    update_address(saved);
+    return num;
+}
+
+/* address increase a site needs for its value at its current address */
+static int increase(struct item* it)
+{
+    int saved = get_address();
+    update_address(it->addr);  // a branch expands for its target address
+    int need = autogen_increase(it->num, it->opfunc, it->ops);
+    update_address(saved);
+    return need;
+}
+
+/* return 1 if $at already holds the value of a site */
+static int holds_at(struct item* it)
+{
+    if (it->src < 0) return 0;
+    struct item* src = &items[it->src];
+    int num = eval(src);
+    return is_autogen(num, src->opfunc, src->addr) && num == it->num;
+}
+
+/* evaluate a site at its current address. return the increase it needs */
+static int needs_grow(struct item* it)
+{
+    it->num = eval(it);
+    int need = increase(it);
+    if (need > it->reuse && holds_at(it))
+        need = it->reuse;
+    return need;
+}
+
+/* relaxing did not settle: expand every site to the full increase */
+static void expand_all()
+{
+    int i;
+    fprintf(stderr, "relax: no fixed point after %d rounds, expanding all remaining sites\n", MAXROUNDS);
+    for (i = 0; i < nitems; i++) {
+        if (items[i].kind == SITE)
+            items[i].grow = items[i].arg;
+    }
+    sweep();
+}
+
+/* helper to sort branch targets */
+static int by_address(const void* a, const void* b)
+{
+    return *(const int*) a - *(const int*) b;
+}
+
+/* forget $at at every site a branch can reach from outside the block of its src.
+   return the number of sites that no longer reuse $at */
+static int block_targets()
+{
+    int i, n = 0, blocked = 0;
+    int* target = emalloc((nitems + 1) * sizeof(int));
+    for (i = 0; i < nitems; i++) {
+        struct item* it = &items[i];
+        if (it->kind == SITE)
+            n += (target[n] = branch_target(it->opfunc, eval(it), it->addr)) >= 0;
+        else if (it->kind == BRANCH)
+            target[n++] = branch_target(it->opfunc, it->num, it->addr);
+    }
+    qsort(target, n, sizeof(int), by_address);
+    for (i = 0; i < nitems; i++) {
+        struct item* it = &items[i];
+        if (it->kind != SITE || it->src < 0) continue;
+        int lo = 0, hi = n;  // first target after src
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (target[mid] <= items[it->src].addr) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo < n && target[lo] <= it->addr) {
+            it->src = -1;
+            blocked++;
+        }
+    }
+    free(target);
+    return blocked;
+}
+
+/* decide which sites reuse $at at their final address */
+static void mark_reuse()
+{
+    int i;
+    for (i = 0; i < nitems; i++) {
+        struct item* it = &items[i];
+        if (it->kind != SITE || it->src < 0) continue;
+        it->num = eval(it);
+        it->at = it->grow < increase(it) && holds_at(it);
+    }
+}
+
+
+/**
+* Shared functions (relax.h)
+*/
+
+/* reset for a new assembly */
+void relax_init()
+{
+    relax_free();
+    relax_line();
+}
+
+void relax_free()
+{
+    free(items);     items = NULL;     nitems = maxitems = 0;
+    free(deps);      deps = NULL;      ndeps = maxdeps = 0;
+    free(shift_at);  shift_at = NULL;
+    free(part);      part = NULL;
+    free(fen);       fen = NULL;
+    free(reach);     reach = NULL;
+    free(moving);    moving = NULL;     nmoving = 0;
+    free(fars);      fars = NULL;       nfars = 0;
+    free(span_start); span_start = NULL;
+    free(span_site); span_site = NULL;
+    free(bars);      bars = NULL;      nbars = 0;
+    free(changed);   changed = NULL;
+    free(stamp);     stamp = NULL;
+    free(work);      work = NULL;
+    next_site = 0;
+}
+
+/* start of a source line: forget labels used so far */
+void relax_line()
+{
+    line_nsyms = line_pc = line_over = 0;
+}
+
+/* operand uses label id, -1 for '$' (expr.c) */
+void relax_dep(int id)
+{
+    if (resolving) return;
+    if (id < 0) {
+        line_pc = 1;
+        return;
+    }
+    int i;
+    for (i = 0; i < line_nsyms; i++) {
+        if (line_syms[i] == id) return;
+    }
+    if (line_nsyms == MAXDEPS)
+        line_over = 1;
+    else
+        line_syms[line_nsyms++] = id;
+}
+
+/* return 1 if the current line used a label or '$' */
+int relax_deps()
+{
+    return line_nsyms > 0 || line_pc || line_over;
+}
+
+/* return number of items so far. labels remember it as their position */
+int relax_items()
+{
+    return nitems;
+}
+
+/* 1st path: record the current line's instruction as a short site (encoder.c)
+   ops are its operands, NULL to size it by the longest expansion,
+   src is the site whose value $at holds (-1 if none), reuse the increase then.
+   return the index of the site */
+int relax_site(int opfunc, struct expr* expr, struct operands* ops, int src, int reuse)
+{
+    int i, n = nitems;
+    struct item* it = new_item(SITE, get_address());
+    it->arg = opfunc_to_increase(opfunc);
+    it->opfunc = opfunc;
+    it->expr = expr;
+    it->ops = ops;
+    it->uses_pc = line_pc || is_branch(opfunc);  // a branch counts from its address
+    it->always = line_over;
+    it->src = src;
+    it->reuse = reuse;
+    it->dep_first = ndeps;
+    it->dep_n = line_nsyms;
+    for (i = 0; i < line_nsyms; i++)
+        new_dep(line_syms[i], n);
+    if (src >= 0) {  // the value of src decides if $at is reused
+        struct item* s = &items[src];
+        for (i = 0; i < s->dep_n; i++)
+            new_dep(deps[s->dep_first + i].sym, n);
+        it->uses_pc |= s->uses_pc;
+        it->always |= s->always;
+    }
+    return n;
+}
+
+/* 1st path: record a branch or jump with the constant operand num (encoder.c) */
+void relax_branch(int opfunc, int num)
+{
+    struct item* it = new_item(BRANCH, get_address());
+    it->opfunc = opfunc;
+    it->num = num;
+}
+
+/* 1st path: .org sets an address, absolute unless it is one label (directives.c) */
+void relax_org()
+{
+    new_item(ORG, get_address())->arg = line_nsyms == 1 && !line_pc && !line_over ? line_syms[0] : -1;
+}
+
+/* 1st path: .align at address to aln bytes (directives.c) */
+void relax_align(int address, int aln)
+{
+    new_item(ALIGN, address)->arg = aln;
+}
+
+/* 2nd path: return the address increase chosen for the next site (encoder.c)
+   and set *at to 1 if the site reuses $at */
+int relax_next_grow(int* at)
+{
+    for (; next_site < nitems; next_site++) {
+        if (items[next_site].kind == SITE) {
+            *at = items[next_site].at;
+            return items[next_site++].grow;
+        }
+    }
+    oops("relax_next_grow: more sites than in the 1st path")
+}
+
+/* 2nd path: shift of the address in front of item, after addr_resolution */
+int relax_shift(int item)
+{
+    return shift_at[item];
+}
+
+/* 2nd path: continue with the sites from item on, the first of a chunk (asm.c) */
+void relax_seek(int item)
+{
+    next_site = item;
+}
+
+/* helper to get the expr_weight of the value of site it, a branch to a label is a distance */
+static int weight(struct item* it)
+{
+    int w = expr_weight(it->expr);
+    return is_branch(it->opfunc) && w == 1 ? 0 : w;
+}
+
+/* helper to sort the moving sites */
+static int by_reach(const void* a, const void* b)
+{
+    return reach[*(const int*) a] - reach[*(const int*) b];
+}
+
+/* helper to widen first..last to the label positions of site it */
+static void label_span(struct item* it, int* first, int* last)
+{
+    int j;
+    for (j = it->dep_first; j < it->dep_first + it->dep_n; j++) {
+        struct symbol* s = sym_get(deps[j].sym);
+        if (!s->defined || !s->reloc) continue;
+        if (s->count < *first) *first = s->count;
+        if (s->count > *last) *last = s->count;
+    }
+}
+
+/* helper to add site to segment tree node k, or count it while fill is NULL */
+static void cover_node(int k, int site, int* fill)
+{
+    if (fill)
+        span_site[fill[k]++] = site;
+    else
+        span_start[k + 1]++;
+}
+
+/* helper to add site to the segment tree nodes over positions lo to hi - 1 */
+static void cover(int lo, int hi, int site, int* fill)
+{
+    int l, r;
+    for (l = lo + leaves, r = hi + leaves; l < r; l >>= 1, r >>= 1) {
+        if (l & 1) cover_node(l++, site, fill);
+        if (r & 1) cover_node(--r, site, fill);
+    }
+}
+
+/*
+  name:    build_reach
+  purpose: index the sites by the changes that can move their value
+  flow:
+    a position is an item index, a label is at the count of items before it,
+    and a change at item g moves the positions after g.
+    1) a site whose value is a distance between its labels and '$'
+       (expr_weight 0) moves only with a change inside that span,
+       kept in a segment tree over the positions. a branch to a label counts the words to it, so it is one too
+    2) any other site moves with a change in front of its last label,
+       its reach. moving keeps them sorted by reach
+    3) an expanded branch depends on its target address as well, it
+       joins fars and moves with a change in front of its reach
+ */
+static void build_reach()
+{
+    int i, k;
+    int* lo = emalloc((nitems + 1) * sizeof(int));
+    int* hi = emalloc((nitems + 1) * sizeof(int));
+    for (leaves = 1; leaves <= nitems; leaves *= 2)
+        ;
+    span_start = emalloc((2 * leaves + 1) * sizeof(int));
+    memset(span_start, 0, (2 * leaves + 1) * sizeof(int));
+    nmoving = nbars = nfars = 0;
+    for (i = 0; i < nitems; i++) {
+        struct item* it = &items[i];
+        int first = nitems, last = -1;
+        reach[i] = lo[i] = hi[i] = -1;
+        if (it->kind == ORG || it->kind == ALIGN)
+            bars[nbars++] = i;
+        if (it->kind != SITE) continue;
+        label_span(it, &first, &last);
+        if (it->src >= 0)
+            label_span(&items[it->src], &first, &last);
+        if (it->uses_pc || it->src >= 0) {  // '$', or $at set at src
+            if (i < first) first = i;
+            if (i > last) last = i;
+        }
+        if (it->always)
+            reach[i] = nitems;
+        else if (it->src >= 0 || weight(it) != 0)
+            reach[i] = last;
+        else if (first < last) {
+            lo[i] = first;
+            hi[i] = last;
+            cover(first, last, i, NULL);
+        }
+        if (reach[i] >= 0)
+            moving[nmoving++] = i;
+        else if (is_branch(it->opfunc))
+            reach[i] = last;  // for when it expands
+    }
+    qsort(moving, nmoving, sizeof(int), by_reach);
+
+    for (k = 0; k < 2 * leaves; k++)
+        span_start[k + 1] += span_start[k];
+    span_site = emalloc((span_start[2 * leaves] + 1) * sizeof(int));
+    int* fill = emalloc((2 * leaves + 1) * sizeof(int));
+    memcpy(fill, span_start, (2 * leaves + 1) * sizeof(int));
+    for (i = 0; i < nitems; i++) {
+        if (lo[i] >= 0)
+            cover(lo[i], hi[i], i, fill);
+    }
+    free(fill);
+    free(lo);
+    free(hi);
+}
+
+/* move the .org and .align items after position pmin with the shift in front
+   of them. append those whose shift changed to changed[0..nc), return nc */
+static int shift_bars(int pmin, int nc)
+{
+    int b, lo = 0, hi = nbars;
+    while (lo < hi) {  // first after pmin
+        int mid = (lo + hi) / 2;
+        if (bars[mid] <= pmin) lo = mid + 1;
+        else hi = mid;
+    }
+    for (b = lo; b < nbars; b++) {
+        int i = bars[b], from;
+        struct item* it = &items[i];
+        int shift = shift_before(i), after;
+        if (it->kind == ORG)
+            after = (from = org_from(it, i)) < 0 ? 0 : shift_before(from);
+        else
+            after = round_up(it->base + shift, it->arg) - round_up(it->base, it->arg);
+        if (after - shift != part[i]) {
+            shift_add(i, after - shift - part[i]);
+            changed[nc++] = i;
+        }
+    }
+    return nc;
+}
+
+/* queue the sites a change at the items in changed[0..nc) can move, first
+   at pmin. return the count */
+static int requeue(int nc, int pmin, int round)
+{
+    int i, j, k, n = 0, lo = 0, hi = nmoving;
+    while (lo < hi) {  // first reaching past pmin
+        int mid = (lo + hi) / 2;
+        if (reach[moving[mid]] <= pmin) lo = mid + 1;
+        else hi = mid;
+    }
+    for (i = lo; i < nmoving; i++)
+        queue(&n, moving[i], round);
+    for (i = 0; i < nfars; i++) {
+        if (reach[fars[i]] > pmin)
+            queue(&n, fars[i], round);
+    }
+    for (i = 0; i < nc; i++) {
+        for (k = changed[i] + leaves; k >= 1; k >>= 1) {  // spans over the change
+            for (j = span_start[k]; j < span_start[k + 1]; j++)
+                queue(&n, span_site[j], round);
+        }
+    }
+    return n;
+}
+
+/* place the queued sites, the sites $at came from and the labels they use */
+static void place_queued(int n)
+{
+    int i, all = 0, nsyms = sym_total();
+    for (i = 0; i < n; i++) {
+        struct item* it = &items[work[i]];
+        place(work[i]);
+        if (it->src >= 0)
+            place(it->src);
+        all |= it->always;
+    }
+    for (i = 0; all && i < nsyms; i++)  // labels not tracked
+        place_label(i);
+}
+
+/* grow the sites in rounds until none grows, every site is evaluated in the first */
+static void relax_rounds()
+{
+    int i, j, n, nc, round, pmin;
+
+    sweep();
+    place_labels();
+    memset(fen, 0, (nitems + 1) * sizeof(int));
+    for (i = 0; i < nitems; i++) {  // the Fenwick tree of the sweep, each node adds to its parent
+        part[i] = shift_at[i + 1] - shift_at[i];
+        fen[i + 1] += part[i];
+        if ((j = i + 1 + ((i + 1) & -(i + 1))) <= nitems)
+            fen[j] += fen[i + 1];
+        stamp[i] = -1;
+    }
+    for (i = n = 0; i < nitems; i++)
+        queue(&n, i, 0);
+
+    for (round = 0; n > 0; round++) {
+        if (round == MAXROUNDS) {
+            expand_all();
+            break;
+        }
+        pmin = nitems;
+        for (i = nc = 0; i < n; i++) {
+            struct item* it = &items[work[i]];
+            int need = needs_grow(it);
+            if (need > it->grow) {
+                if (it->grow == 0 && is_branch(it->opfunc))
+                    fars[nfars++] = work[i];
+                shift_add(work[i], need - it->grow);
+                it->grow = need;
+                changed[nc++] = work[i];
+                if (work[i] < pmin) pmin = work[i];
+            }
+        }
+        if (nc == 0) break;
+        nc = shift_bars(pmin, nc);
+        n = requeue(nc, pmin, round + 1);
+        place_queued(n);
+    }
+    sweep();
+    place_labels();
+}
+
+/*
+  name:    addr_resolution
+  purpose: size every site, then move labels to their final addresses
+  flow:
+    1) sweep items to place them with the current sizes
+    2) move relocatable labels by the shift in front of them,
+       queue the sites that use a moved label or '$' at a moved address
+    3) grow the queued sites that no longer fit, repeat while any grew
+    4) a site a branch reaches loads $at again, relax again if there was one
+ */
+void addr_resolution()
+{
+    int i;
+    int n = (nitems + 1) * sizeof(int);
+
+    shift_at = emalloc(n);
+    part = emalloc(n);
+    fen = emalloc(n);
+    reach = emalloc(n);
+    moving = emalloc(n);
+    fars = emalloc(n);
+    bars = emalloc(n);
+    changed = emalloc(n);
+    stamp = emalloc(n);
+    work = emalloc(n);
+    build_reach();
+
+    resolving = 1;
+    relax_rounds();  // labels end at their final addresses
+    while (block_targets() > 0)
+        relax_rounds();
+    resolving = 0;
+
+    for (i = 0; i < nitems; i++) {
+        struct item* it = &items[i];
+        if (it->kind == SITE && it->addr + 2 + it->grow > MEMTOP) {
+            fprintf(stderr, "relax: code at 0x%04x runs past the end of memory after autogen\n", it->base);
+            break;
+        }
+    }
+    mark_reuse();
+    sym_index_addresses();  // symtab.c
+    next_site = 0;
+}
+
+
+/* DEBUG */
+void relax_test()
+{
+    ps(__func__)
+
+    /*
+    TEST for addr_resolution
+        0x00  ADDI $at, tag    # short while tag is 0x1c
+        0x02  J    far         # far is 0x400 > 10 bits, grows by 6 (ORI, SLLI, JR)
+        0x1c  tag:             # moves to 0x22, so ADDI tag grows by 4 (ORI, ADD)
+        0x1c  ADDI $at, near   # near: .equ 0x4 never moves, stays short
+        0x1e  .org 0x400
+        far:                   # after .org, never moves
+        0x400 LW $rb, $r0, var # var: .equ 0xe000, grows by 8 (NORI, SLLI, ADD), no ops
+        0x402 LW $rc, $r0, var # $at holds 0xe000 already, so stays one word
+    After resolution, tag will be 0x26, far 0x400,
+    sites grow: 4 6 0 8 0, reuse $at: 0 0 0 0 1
+    */
+    int i, grow[5], at[5];
+    char* end;
+    symtab_init();
+    relax_init();
+    struct expr* tag = expr_parse("tag", &end);
+    struct expr* far = expr_parse("far", &end);
+    struct expr* near = expr_parse("near", &end);
+    struct expr* var = expr_parse("var", &end);
+
+    relax_line(); relax_dep(tag->num);  update_address(0x0); relax_site(opstr_to_opfunc("ADDI"), tag, NULL, -1, 0);
+    relax_line(); relax_dep(far->num);  update_address(0x2); relax_site(opstr_to_opfunc("J"), far, NULL, -1, 0);
+    sym_define("near", 0x4, 0);
+    update_address(0x1c); sym_define("tag", 0x1c, 1);
+    relax_line(); relax_dep(near->num); update_address(0x1c); relax_site(opstr_to_opfunc("ADDI"), near, NULL, -1, 0);
+    relax_line(); update_address(0x1e); relax_org();
+    sym_define("far", 0x400, 1);
+    sym_define("var", 0xe000, 0);
+    relax_line(); relax_dep(var->num);  update_address(0x400);
+    int lw = relax_site(opstr_to_opfunc("LW"), var, NULL, -1, 0);
+    relax_line(); relax_dep(var->num);  update_address(0x402); relax_site(opstr_to_opfunc("LW"), var, NULL, lw, 0);
+
+    addr_resolution();
+    printf("tag is 0x%x, far is 0x%x\n", sym_addr("tag"), sym_addr("far"));
+    for (i = 0; i < 5; i++)
+        grow[i] = relax_next_grow(&at[i]);
+    printf("sites grow: %d %d %d %d %d, ", grow[0], grow[1], grow[2], grow[3], grow[4]);
+    printf("reuse $at: %d %d %d %d %d\n", at[0], at[1], at[2], at[3], at[4]);
+
+    relax_free();
+    expr_free(tag); expr_free(far); expr_free(near); expr_free(var);
+    symtab_free();
+}
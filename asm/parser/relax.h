@@ -0,0 +1,27 @@
+/*
+ * relax.h -- span-dependent instruction relaxation
+ */
+
+#ifndef RELAX_INCL
+#define RELAX_INCL
+
+struct expr;
+struct operands;  // lexer.h
+
+void  relax_init();
+void  relax_free();
+void  relax_line();
+void  relax_dep(int id);
+int   relax_deps();
+int   relax_items();
+int   relax_site(int opfunc, struct expr* expr, struct operands* ops, int src, int reuse);
+void  relax_branch(int opfunc, int num);
+void  relax_org();
+void  relax_align(int address, int aln);
+int   relax_next_grow(int* at);
+int   relax_shift(int item);
+void  relax_seek(int item);
+void  addr_resolution();
+void  relax_test();    // DEBUG
+
+#endif /* RELAX_INCL */
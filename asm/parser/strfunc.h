@@ -5,7 +5,19 @@
 #ifndef STRFUNC_INCL
 #define STRFUNC_INCL
 
+/*
+    name:       strview
+    purpose:    part of a string, without a copy
+    field:      p   - first char, not 0 terminated
+                len - number of chars
+*/
+struct strview {
+    char* p;
+    int   len;
+};
+
 void  err_msg(char* a, char* b);
+void  oops_lock();
 char* concat(char* a, char* b);
 char* concat2(char* a, char* b);
 char* no_comment_str(char* str);
@@ -17,12 +29,11 @@ int   str_to_int(char* str);
 char* int_to_str(int num);
 char* int_to_hexstr(int num);
 char* int_to_bin(int num);
+struct strview view_until(char* str, char* stop);
+char* view_str(struct strview v);
 char* trimmed(char* str, char c);
 char* getlabel(char* str);
 void  swap_str(char* line, char* str, char* newstr);
 char* search_chr(char* str, char c);
 
-int   strop(char* str);
-void  strfunc_test();  // DEBUG
-
 #endif /* STRFUNC_INCL */
\ No newline at end of file
@@ -0,0 +1,289 @@
+/*
+ * strip.c -- drop code and data no label reaches, parser -s and min16-ld -s
+ *
+ * The statements (ir.c) are cut into regions: one starts at the first
+ * line, at every label and at every .org. A region reaches
+ *
+ *     the labels its lines name: J and JAL targets, branch labels, label
+ *     operands of I and O instructions, .word label and so on
+ *     the next region, unless it ends in J, JR or RET, or holds data only
+ *     every region a branch with a number offset may land in
+ *
+ * The first region, a region after a .org without a label (placed by
+ * address, not reached by name), the labels of .keep and, in parser, the
+ * labels of .global are kept, with everything they reach. JR through a
+ * register other than $ra and JALR jump to an address computed at run
+ * time, so every label whose address the program takes is kept then. A
+ * J or JAL to a number may land anywhere, and nothing is removed.
+ *
+ * The lines of the other regions are removed before the 1st path, except
+ * .org, .global, .keep and an .equ of a number. An .equ of a label goes
+ * when its name is not reached. The bytes removed count an instruction as
+ * one word, before autogen.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strip.h"
+#include "ir.h"
+#include "expr.h"
+#include "symtab.h"
+#include "directives.h"
+#include "common.h"
+
+/* opfunc of the instructions that move the pc (encoder.c) */
+#define OP_J     0b101000
+#define OP_JAL   0b101001
+#define OP_JR    0b101010
+#define OP_JALR  0b101011
+#define OP_BEQ   0b101100
+#define OP_BNE   0b101101
+#define OP_RET   (PSEUDO | 3)
+#define REG_RA   4
+
+/* file scope variables */
+static int*  region;         /* region of every statement */
+static int*  first;          /* first statement of every region, and the end */
+static int   nregions;
+static char* reached;        /* regions kept */
+static int*  stack;          /* regions reached but not walked */
+static int   nstack;
+static int*  label_region;   /* region a label starts, by symbol id, -1 if none */
+static int*  equ_stmt;       /* statement of an .equ, by symbol id, -1 if none */
+static char* seen;           /* symbols reached */
+static int   unknown;        /* a reached jump to an address in a register */
+static int   ran;            /* 1 once strip_unreachable ran */
+static int   labels_removed, bytes_removed, giveup_line;
+
+
+/**
+* Helper Functions
+*/
+
+/* opfunc of an instruction statement, encoded (obj.c) or not. -1 for others */
+static int opfunc_of(struct stmt* st)
+{
+    if (st->kind == ST_INSTR) return st->ops.op->opfunc;
+    if (st->kind == ST_WORD)  return (st->word >> 10) & 0x3f;
+    return -1;
+}
+
+/* return 1 if st writes data */
+static int is_data(struct stmt* st)
+{
+    return st->kind == ST_DIRECTIVE && (st->dir == DIR_WORD || st->dir == DIR_HALF ||
+           st->dir == DIR_BYTE || st->dir == DIR_ASCII || st->dir == DIR_ASCIIZ || st->dir == DIR_SPACE);
+}
+
+/* return 1 if st is never removed */
+static int always_kept(struct stmt* st)
+{
+    if (st->kind != ST_DIRECTIVE) return 0;
+    if (st->dir == DIR_EQU) return expr_const(st->args[0].expr);
+    return st->dir == DIR_ORG || st->dir == DIR_GLOBAL || st->dir == DIR_KEEP;
+}
+
+/* keep region r, walked later */
+static void reach_region(int r)
+{
+    if (r < 0 || r >= nregions || reached[r]) return;
+    reached[r] = 1;
+    stack[nstack++] = r;
+}
+
+static void reach_expr(struct expr* e);
+
+/* the region a label starts, or what an .equ names */
+static void reach_sym(int id)
+{
+    if (seen[id]) return;
+    seen[id] = 1;
+    if (label_region[id] >= 0) reach_region(label_region[id]);
+    if (equ_stmt[id] >= 0) reach_expr(ir_get(equ_stmt[id])->args[0].expr);
+}
+
+/* every label named in e */
+static void reach_expr(struct expr* e)
+{
+    if (e == NULL) return;
+    if (e->kind == E_SYM) reach_sym(e->num);
+    reach_expr(e->l);
+    reach_expr(e->r);
+}
+
+/* every region from statement i to where a branch offset words away may land.
+   an instruction is one word at least, so it is at most offset instructions away */
+static void reach_branch(int i, int offset)
+{
+    int step = offset < 0 ? -1 : 1;
+    int n = abs(offset) + 1;
+    for (; i >= 0 && i < ir_count() && n >= 0; i += step) {
+        reach_region(region[i]);
+        if (opfunc_of(ir_get(i)) >= 0) n--;
+    }
+}
+
+/* labels whose address the program takes: named outside J and JAL */
+static void reach_address_taken()
+{
+    int i, j;
+    for (i = 0; i < ir_count(); i++) {
+        struct stmt* st = ir_get(i);
+        int op = opfunc_of(st);
+        if (st->kind == ST_INSTR && op != OP_J && op != OP_JAL)
+            reach_expr(st->ops.expr);
+        for (j = 0; is_data(st) && j < st->nargs; j++)
+            reach_expr(st->args[j].expr);
+    }
+}
+
+/* what the lines of region r reach */
+static void walk_region(int r)
+{
+    int i, falls = 1;
+    for (i = first[r]; i < first[r + 1]; i++) {
+        struct stmt* st = ir_get(i);
+        int j, op = opfunc_of(st);
+        if (st->kind == ST_DIRECTIVE && st->dir != DIR_EQU) {
+            for (j = 0; j < st->nargs; j++)
+                reach_expr(st->args[j].expr);
+        }
+        if (is_data(st))
+            falls = 0;
+        if (op < 0)
+            continue;
+        struct expr* e = st->kind == ST_INSTR ? st->ops.expr : NULL;
+        int number = st->kind == ST_WORD || (e && expr_const(e));
+        int rd = st->kind == ST_INSTR ? st->ops.rd : (st->word >> 6) & 0xf;
+        reach_expr(e);
+        if ((op == OP_J || op == OP_JAL) && number && giveup_line == 0)
+            giveup_line = st->line;
+        if ((op == OP_BEQ || op == OP_BNE) && number)
+            reach_branch(i, e ? expr_eval(e) : ((st->word & 0xf) ^ 8) - 8);
+        if ((op == OP_JR && rd != REG_RA) || op == OP_JALR)
+            unknown = 1;
+        falls = op != OP_J && op != OP_JR && op != OP_RET;
+    }
+    if (falls) reach_region(r + 1);
+}
+
+/* size of a removed statement, one word for an instruction */
+static int stmt_bytes(struct stmt* st)
+{
+    if (opfunc_of(st) >= 0) return 2;
+    if (!is_data(st) || (st->dir == DIR_SPACE && !expr_const(st->args[0].expr)))
+        return 0;
+    return run_directive(st, 0, NULL);  // directives.c, nothing written
+}
+
+
+/**
+* Shared functions (strip.h)
+*/
+
+/*
+  name:    strip_unreachable
+  purpose: remove the regions no label reaches from the statements (ir.c),
+           before the 1st path. nothing is removed from a source with errors,
+           which are reported as usual
+  field:   exported - 1 if .global labels are kept (parser), 0 when every
+                      module is linked already (min16-ld)
+*/
+void strip_unreachable(int exported)
+{
+    int i, j, n = ir_count(), nsyms = sym_total();
+    ran = 1;
+    labels_removed = bytes_removed = giveup_line = unknown = 0;
+    for (i = 0; i < n; i++) {
+        int kind = ir_get(i)->kind;
+        if (kind == ST_ERROR || kind == ST_UNKNOWN) return;
+    }
+
+    region = calloc(n + 1, sizeof(int));
+    first = calloc(n + 2, sizeof(int));
+    reached = calloc(n + 1, 1);
+    stack = calloc(n + 1, sizeof(int));
+    label_region = malloc((nsyms + 1) * sizeof(int));
+    equ_stmt = malloc((nsyms + 1) * sizeof(int));
+    seen = calloc(nsyms + 1, 1);
+    char* drop = calloc(n + 1, 1);
+    if (!region || !first || !reached || !stack || !label_region || !equ_stmt || !seen || !drop)
+        oops("calloc");
+    for (i = 0; i < nsyms; i++)
+        label_region[i] = equ_stmt[i] = -1;
+
+    // regions
+    nregions = 0;
+    for (i = 0; i < n; i++) {
+        struct stmt* st = ir_get(i);
+        int equ = st->kind == ST_DIRECTIVE && st->dir == DIR_EQU;
+        if (i == 0 || (st->label && !equ) || (st->kind == ST_DIRECTIVE && st->dir == DIR_ORG))
+            first[nregions++] = i;
+        region[i] = nregions - 1;
+        if (st->label && equ)
+            equ_stmt[st->sym] = i;
+        else if (st->label)
+            label_region[st->sym] = region[i];
+    }
+    first[nregions] = n;
+
+    // roots
+    nstack = 0;
+    reach_region(0);
+    for (i = 0; i < n; i++) {
+        struct stmt* st = ir_get(i);
+        if (st->kind == ST_DIRECTIVE && st->dir == DIR_ORG && !st->label)
+            reach_region(region[i]);
+        if (always_kept(st) && st->dir != DIR_EQU && (st->dir != DIR_GLOBAL || exported)) {
+            for (j = 0; j < st->nargs; j++)
+                reach_expr(st->args[j].expr);
+        }
+    }
+
+    // everything they reach
+    int taken = 0;
+    for (;;) {
+        while (nstack > 0)
+            walk_region(stack[--nstack]);
+        if (!unknown || taken) break;
+        reach_address_taken();
+        taken = 1;
+    }
+
+    // remove the rest
+    for (i = 0; giveup_line == 0 && i < n; i++) {
+        struct stmt* st = ir_get(i);
+        if (st->kind == ST_DIRECTIVE && st->dir == DIR_EQU)
+            drop[i] = !always_kept(st) && st->label && !seen[st->sym];
+        else
+            drop[i] = !reached[region[i]] && !always_kept(st);
+        if (!drop[i]) continue;
+        if (st->label) {
+            sym_drop(st->sym);  // symtab.c
+            labels_removed++;
+        }
+        bytes_removed += stmt_bytes(st);
+    }
+    if (giveup_line == 0)
+        ir_remove(drop);  // ir.c
+
+    free(region);
+    free(first);
+    free(reached);
+    free(stack);
+    free(label_region);
+    free(equ_stmt);
+    free(seen);
+    free(drop);
+}
+
+/* print the labels and bytes removed, or the J to a number that kept everything */
+void strip_report()
+{
+    if (!ran) return;
+    if (giveup_line > 0)
+        printf("%-4s\t: nothing removed, J to an address on line %d\n\n", "STRIP", giveup_line);
+    else
+        printf("%-4s\t: %d labels, %d bytes removed\n\n", "STRIP", labels_removed, bytes_removed);
+}
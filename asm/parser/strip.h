@@ -0,0 +1,11 @@
+/*
+ * strip.h -- drop code and data no label reaches
+ */
+
+#ifndef STRIP_INCL
+#define STRIP_INCL
+
+void strip_unreachable(int exported);
+void strip_report();
+
+#endif /* STRIP_INCL */
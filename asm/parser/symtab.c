@@ -0,0 +1,278 @@
+/*
+ * symtab.c -- label symbol table
+ *
+ * Labels live in a growable array indexed by an open-addressing hash
+ * table. Label strings are interned in an arena (arena.c), so every name is
+ * stored once, and relax.c refers to labels by index so address
+ * resolution never hashes a string. After resolution a reverse index
+ * maps addresses back to labels for the mif annotations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "symtab.h"
+#include "relax.h"
+#include "arena.h"
+#include "common.h"
+
+#define SYMSLOTS  256     // initial hash slots, power of 2
+
+/* Helper function declarations */
+void* emalloc(size_t n);                            // defined in linkedlist.c
+
+
+/* file scope variables */
+static struct symbol* syms;         /* labels in order of first appearance */
+static int            nsyms, maxsyms;
+static int*           slots;        /* hash slots: index into syms, -1 if empty */
+static int            nslots;
+static int*           sorted;       /* defined labels in ABC order */
+static int            nsorted;
+static int*           addr_slots;   /* reverse index: address to index into syms */
+static int            naddr_slots;
+static struct arena   pool;         /* interned label strings */
+
+
+/**
+* Helper Functions
+*/
+
+/* FNV-1a hash of a string */
+static unsigned hash_str(char* str)
+{
+    unsigned h = 2166136261u;
+    for (; *str; str++)
+        h = (h ^ (unsigned char) *str) * 16777619u;
+    return h;
+}
+
+/* hash of an address */
+static unsigned hash_addr(int addr)
+{
+    unsigned h = (unsigned) addr * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+/* return the hash slot holding str, or the empty slot where it belongs */
+static int find_slot(char* str)
+{
+    int mask = nslots - 1;
+    int i = hash_str(str) & mask;
+    for (; slots[i] != -1; i = (i + 1) & mask) {
+        if (strcmp(syms[slots[i]].str, str) == 0)
+            break;
+    }
+    return i;
+}
+
+/* double the hash slots and insert every symbol again */
+static void grow_slots()
+{
+    int i;
+    free(slots);
+    nslots = nslots ? nslots * 2 : SYMSLOTS;
+    slots = emalloc(nslots * sizeof(int));
+    for (i = 0; i < nslots; i++)
+        slots[i] = -1;
+    for (i = 0; i < nsyms; i++)
+        slots[find_slot(syms[i].str)] = i;
+}
+
+/* return index of the label str, adding it as undefined when new */
+static int sym_index(char* str)
+{
+    if (2 * (nsyms + 1) > nslots)    // keep load factor under 1/2
+        grow_slots();
+    int slot = find_slot(str);
+    if (slots[slot] != -1)
+        return slots[slot];
+
+    if (nsyms == maxsyms) {
+        maxsyms = maxsyms ? maxsyms * 2 : SYMSLOTS / 2;
+        if ((syms = realloc(syms, maxsyms * sizeof(struct symbol))) == NULL)
+            oops("realloc");
+    }
+    struct symbol* s = &syms[nsyms];
+    s->str = arena_strdup(&pool, str);
+    s->num = s->base = s->count = s->defined = s->reloc = s->dropped = 0;
+    slots[slot] = nsyms;
+    return nsyms++;
+}
+
+/* qsort compare for label order */
+static int cmp_label(const void* a, const void* b)
+{
+    return strcmp(syms[*(int*) a].str, syms[*(int*) b].str);
+}
+
+
+/**
+* Shared functions (symtab.h)
+*/
+
+/* reset the symbol table */
+void symtab_init()
+{
+    symtab_free();
+    grow_slots();
+}
+
+/* free every table and the interned strings */
+void symtab_free()
+{
+    arena_free(&pool);
+    free(syms);       syms = NULL;       nsyms = maxsyms = 0;
+    free(slots);      slots = NULL;      nslots = 0;
+    free(sorted);     sorted = NULL;     nsorted = 0;
+    free(addr_slots); addr_slots = NULL; naddr_slots = 0;
+}
+
+/* return the one stored copy of a label string */
+char* intern(char* str)
+{
+    int i = sym_index(str);  // may move syms
+    return syms[i].str;
+}
+
+/* return index of label str, adding it as undefined when new */
+int sym_id(char* str)
+{
+    return sym_index(str);
+}
+
+/* return label by index. the pointer is valid until the next new label */
+struct symbol* sym_get(int id)
+{
+    return &syms[id];
+}
+
+/* return number of labels, undefined ones included */
+int sym_total()
+{
+    return nsyms;
+}
+
+/* define label str at addr. redefinition overwrites */
+void sym_define(char* str, int addr, int reloc)
+{
+    int i = sym_index(str);  // may move syms
+    struct symbol* s = &syms[i];
+    s->num = addr;
+    s->base = addr;
+    s->count = relax_items();  // relax.c
+    s->defined = 1;
+    s->reloc = reloc;
+}
+
+/* return address of label str, -1 if not defined */
+int sym_addr(char* str)
+{
+    if (nslots == 0) return -1;
+    int slot = find_slot(str);
+    if (slots[slot] == -1 || !syms[slots[slot]].defined)
+        return -1;
+    return syms[slots[slot]].num;
+}
+
+/* return the label at addr, NULL if none. valid after addr_resolution */
+char* sym_at(int addr)
+{
+    if (naddr_slots == 0) return NULL;
+    int mask = naddr_slots - 1;
+    int i = hash_addr(addr) & mask;
+    for (; addr_slots[i] != -1; i = (i + 1) & mask) {
+        if (syms[addr_slots[i]].num == addr)
+            return syms[addr_slots[i]].str;
+    }
+    return NULL;
+}
+
+/* return number of defined labels */
+int sym_count()
+{
+    int i, n = 0;
+    for (i = 0; i < nsyms; i++)
+        n += syms[i].defined;
+    return n;
+}
+
+/* return number of labels used but not defined, the removed ones aside */
+int sym_undefined()
+{
+    int i, n = 0;
+    for (i = 0; i < nsyms; i++)
+        n += !syms[i].defined && !syms[i].dropped;
+    return n;
+}
+
+/* mark label id removed with its line (strip.c) */
+void sym_drop(int id)
+{
+    syms[id].dropped = 1;
+}
+
+
+/* index labels by address once addresses are final (relax.c).
+   ABC first wins on equal addresses */
+void sym_index_addresses()
+{
+    int i;
+    free(sorted);
+    sorted = emalloc((nsyms + 1) * sizeof(int));
+    for (i = nsorted = 0; i < nsyms; i++) {
+        if (syms[i].defined)
+            sorted[nsorted++] = i;
+    }
+    qsort(sorted, nsorted, sizeof(int), cmp_label);
+
+    free(addr_slots);
+    for (naddr_slots = SYMSLOTS; naddr_slots < 2 * nsorted; naddr_slots *= 2) {}
+    addr_slots = emalloc(naddr_slots * sizeof(int));
+    for (i = 0; i < naddr_slots; i++)
+        addr_slots[i] = -1;
+
+    int mask = naddr_slots - 1;
+    for (i = 0; i < nsorted; i++) {
+        int num = syms[sorted[i]].num;
+        int j = hash_addr(num) & mask;
+        for (; addr_slots[j] != -1; j = (j + 1) & mask) {
+            if (syms[addr_slots[j]].num == num)
+                break;
+        }
+        if (addr_slots[j] == -1)
+            addr_slots[j] = sorted[i];
+    }
+}
+
+/* display labels in ABC order with total, like dumplist in linkedlist.c */
+void dump_symtab(char* num_name)
+{
+    int i;
+    for (i = 0; i < nsorted; i++) {
+        struct symbol* s = &syms[sorted[i]];
+        printf("%-16s\t: %s is 0x[%04x] 0x[%04x] (mif)\n", s->str, num_name, s->num, s->num/2);
+    }
+    printf("--\n%-4s\t: %d\n", "TOTAL LINES", nsorted);
+}
+
+/* DEBUG */
+void symtab_test()
+{
+    ps(__func__)
+
+    symtab_init();
+    sym_define("tag2", 4, 1);
+    sym_define("tag",  2, 1);
+    sym_define("two",  2, 0);
+    sym_index_addresses();
+
+    printf("tag is 0x%x, tag2 is 0x%x, undefined is %d\n",
+           sym_addr("tag"), sym_addr("tag2"), sym_addr("tag3"));
+    printf("label at 0x2 is [%s], at 0x6 is [%s]\n", sym_at(2), sym_at(6));
+    printf("interned [%s] once: %d\n", intern("tag"), intern("tag") == intern("tag"));
+    dump_symtab("address");
+
+    symtab_free();
+}
@@ -0,0 +1,45 @@
+/*
+ * symtab.h -- label symbol table
+ */
+
+#ifndef SYMTAB_INCL
+#define SYMTAB_INCL
+
+/*
+    name:       symbol
+    purpose:    one label
+    field:      str     - interned label string
+                num     - address of label (or .equ value). updated by addr_resolution
+                base    - address of label without autogen
+                count   - number of relaxation items recorded before the label
+                defined - 0 while the label is only referenced
+                reloc   - 0 for a constant .equ, which autogen never moves
+                dropped - 1 if its line was removed as unreachable (strip.c)
+*/
+struct symbol {
+        char* str;
+        int   num;
+        int   base;
+        int   count;
+        int   defined;
+        int   reloc;
+        int   dropped;
+};
+
+void  symtab_init();
+void  symtab_free();
+char* intern(char* str);
+int   sym_id(char* str);
+struct symbol* sym_get(int id);
+int   sym_total();
+void  sym_define(char* str, int addr, int reloc);
+int   sym_addr(char* str);
+char* sym_at(int addr);
+int   sym_count();
+int   sym_undefined();
+void  sym_drop(int id);
+void  sym_index_addresses();
+void  dump_symtab(char* num_name);
+void  symtab_test();    // DEBUG
+
+#endif /* SYMTAB_INCL */
@@ -0,0 +1,130 @@
+/*
+ * synth.c -- shortest constant synthesis into a register
+ *
+ * Autogen needs a 16-bit value in a register. The register is cleared with
+ * AND $reg, $r0 and then built up with I-type operations that leave the
+ * flags alone: ORI, NORI, XORI, SLLI, SRLI and SRAI. A breadth-first search
+ * over all 65536 values, run once on first use, finds the shortest such
+ * sequence for every value. Small values take ORI alone, small negatives
+ * NORI, shifted constants ORI+SLLI, and no value needs more than 6
+ * instructions (the clear included).
+ *
+ * ADDI would also load small constants but it sets the flags, and ROTLI is
+ * left out because the cpu does not implement ROTL yet.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "synth.h"
+#include "decoder.h"
+#include "common.h"
+
+#define VALUES  65536
+
+/* operations used to build a value */
+enum synth_op {
+    AND  = 0b001000,
+    ORI  = 0b011001, XORI = 0b011010, NORI = 0b011011,
+    SLLI = 0b011100, SRLI = 0b011101, SRAI = 0b011110,
+};
+
+/* file scope variables */
+static uint8_t  dist[VALUES];      /* sequence length, 0 until searched */
+static uint16_t prev[VALUES];      /* value before the last operation */
+static uint16_t last[VALUES];      /* last operation: opfunc<<6 | imm */
+
+
+/**
+* Helper Functions
+*/
+
+/* visit value v reached from u by opfunc and imm */
+static void visit(uint16_t v, uint16_t u, int opfunc, int imm, uint16_t* queue, int* tail)
+{
+    if (dist[v]) return;
+    dist[v] = dist[u] + 1;
+    prev[v] = u;
+    last[v] = opfunc<<6 | imm;
+    queue[(*tail)++] = v;
+}
+
+/* breadth-first search from 0 (after AND $reg, $r0) over all values */
+static void search()
+{
+    uint16_t* queue = malloc(VALUES * sizeof(uint16_t));
+    if (queue == NULL) oops("malloc");
+    int head = 0, tail = 0, k;
+
+    dist[0] = 1;
+    last[0] = AND<<6;
+    queue[tail++] = 0;
+    while (head < tail) {
+        uint16_t u = queue[head++];
+        for (k = 0; k < 64; k++) {
+            visit(u | k, u, ORI, k, queue, &tail);
+            visit(~(u | k), u, NORI, k, queue, &tail);
+            visit(u ^ k, u, XORI, k, queue, &tail);
+        }
+        for (k = 1; k < 16; k++) {
+            visit(u << k, u, SLLI, k, queue, &tail);
+            visit(u >> k, u, SRLI, k, queue, &tail);
+            visit((int16_t) u >> k, u, SRAI, k, queue, &tail);
+        }
+    }
+    free(queue);
+}
+
+
+/**
+* Shared functions (synth.h)
+*/
+
+/* return number of instructions synth_const needs for value */
+int synth_len(int value)
+{
+    if (!dist[0]) search();
+    return dist[value & 0xffff];
+}
+
+/* write the shortest sequence that sets reg to value. return its length */
+int synth_const(int value, int reg, int* inst)
+{
+    int i, n = synth_len(value);
+    uint16_t v = value & 0xffff;
+    for (i = n - 1; i >= 0; i--, v = prev[v]) {
+        int opfunc = last[v] >> 6;
+        int imm = last[v] & 0x3f;
+        if (opfunc == AND)
+            inst[i] = AND<<10 | reg<<6;  // AND $reg, $r0
+        else
+            inst[i] = opfunc<<10 | reg<<6 | imm;
+    }
+    return n;
+}
+
+
+/* DEBUG */
+void synth_test()
+{
+    ps(__func__)
+
+    int values[] = {0x0000, 0x0020, 0x003f, 0xffff, 0xff9c, 0x0400, 0xe000, 0xff00, 0x1234, 0x8001};
+    int inst[SYNTHMAX];
+    int i, j, n, worst = 0;
+
+    for (i = 0; i < (int) (sizeof values / sizeof values[0]); i++) {
+        n = synth_const(values[i], 1, inst);
+        printf("0x%04x:", values[i]);
+        for (j = 0; j < n; j++)
+            printf("  %s;", decode(inst[j]));
+        printf("\n");
+    }
+    for (i = 0; i < VALUES; i++)
+        if (synth_len(i) > worst) worst = synth_len(i);
+    printf("longest sequence is %d instructions\n", worst);
+    if (worst > SYNTHMAX)
+        printf("SYNTHMAX is %d, raise it to %d\n", SYNTHMAX, worst);
+}
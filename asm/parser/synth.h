@@ -0,0 +1,14 @@
+/*
+ * synth.h -- shortest constant synthesis into a register
+ */
+
+#ifndef SYNTH_INCL
+#define SYNTH_INCL
+
+#define SYNTHMAX 6    // longest sequence synth_const returns, synth_test checks
+
+int   synth_len(int value);
+int   synth_const(int value, int reg, int* inst);
+void  synth_test();    // DEBUG
+
+#endif /* SYNTH_INCL */
@@ -0,0 +1,283 @@
+-- lockstep co-simulation testbench
+--
+-- Runs the cpu entity against a memory model loaded from the assembler's
+-- MIF and writes one record per retired instruction to stdout:
+--
+--   PC   INSTR REG VAL  ST ADDR DATA
+--   0004 66fc  b   003c -  ---- ----
+--   0010 c8a2  -   ---- w  f000 0041
+--
+-- REG/VAL is the register write ('-' when none), ST is 'w' or 'b' for a
+-- word or byte store. emu/cosim reads the stream, steps the emulator once
+-- per record and exits at the first divergence, which closes the pipe and
+-- stops the simulation.
+--
+-- Needs VHDL-2008 (external names reach regWrite/regW_num inside cpu).
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+use std.textio.all;
+
+entity tb_cosim is
+	generic (
+		MIF    : string  := "prog.mif";
+		INPUT  : string  := "";          -- serial input, one line per read
+		CYCLES : natural := 100000000    -- give up after this many clocks
+	);
+end;
+
+architecture sim of tb_cosim is
+	constant DEPTH          : natural := 32768;
+	constant REG_IOCONTOL   : natural := 16#ff00#;
+	constant REG_IOBUFFER_1 : natural := 16#ff04#;
+
+	-- cpu FSM state codes (fsmStateCodeCpu)
+	constant S_INIT     : std_ulogic_vector(3 downto 0) := "0000";
+	constant S_MEMOP    : std_ulogic_vector(3 downto 0) := "0001";
+	constant S_EXECUTE  : std_ulogic_vector(3 downto 0) := "0100";
+	constant S_LSSET    : std_ulogic_vector(3 downto 0) := "0110";
+	constant S_LSOP     : std_ulogic_vector(3 downto 0) := "0111";
+	constant S_LOADWB   : std_ulogic_vector(3 downto 0) := "1000";
+
+	type mem_t is array (0 to DEPTH - 1) of std_ulogic_vector(15 downto 0);
+
+	signal clk       : std_ulogic := '0';
+	signal reset     : std_ulogic := '1';
+	signal done      : boolean := false;
+	signal pc        : std_ulogic_vector(15 downto 0);
+	signal instr     : std_ulogic_vector(15 downto 0);
+	signal ready     : std_logic := '0';
+	signal ready_inv : std_logic;
+	signal addr      : std_logic_vector(20 downto 0);
+	signal data_read : std_logic_vector(31 downto 0) := (others => '0');
+	signal data_write: std_logic_vector(31 downto 0);
+	signal rw        : std_logic;
+	signal sixteen   : std_logic;
+	signal reg_din   : std_ulogic_vector(15 downto 0);
+	signal state     : std_ulogic_vector(3 downto 0);
+
+	-- store seen during LoadStoreMemOP, reported when the instruction retires
+	signal st_kind   : character := '-';
+	signal st_addr   : std_ulogic_vector(15 downto 0);
+	signal st_data   : std_ulogic_vector(15 downto 0);
+
+	-- hex digits of a MIF line starting at pos; pos ends on the first non-digit
+	procedure read_hex(s : in string; pos : inout natural; val : out natural) is
+		variable n : natural := 0;
+		variable d : integer;
+	begin
+		while pos <= s'high and (s(pos) = ' ' or s(pos) = HT) loop
+			pos := pos + 1;
+		end loop;
+		while pos <= s'high loop
+			case s(pos) is
+				when '0' to '9' => d := character'pos(s(pos)) - character'pos('0');
+				when 'a' to 'f' => d := character'pos(s(pos)) - character'pos('a') + 10;
+				when 'A' to 'F' => d := character'pos(s(pos)) - character'pos('A') + 10;
+				when others     => exit;
+			end case;
+			n := n * 16 + d;
+			pos := pos + 1;
+		end loop;
+		val := n;
+	end procedure;
+
+	-- load "addr : data;" lines between BEGIN and END; return last address
+	procedure load_mif(mem : inout mem_t; last : out natural) is
+		file f      : text;
+		variable l  : line;
+		variable st : file_open_status;
+		variable body_ : boolean := false;
+		variable pos, a, d : natural;
+	begin
+		last := 0;
+		file_open(st, f, MIF, read_mode);
+		assert st = open_ok report "cannot open " & MIF severity failure;
+		while not endfile(f) loop
+			readline(f, l);
+			pos := l'low;
+			while pos <= l'high and (l(pos) = ' ' or l(pos) = HT) loop
+				pos := pos + 1;
+			end loop;
+			if pos + 4 <= l'high + 1 and l(pos to pos + 4) = "BEGIN" then
+				body_ := true;
+			elsif pos + 3 <= l'high + 1 and l(pos to pos + 3) = "END;" then
+				body_ := false;
+			elsif body_ and pos <= l'high and l(pos) /= '-' then
+				read_hex(l.all, pos, a);
+				pos := pos + 1;             -- ':'
+				read_hex(l.all, pos, d);
+				mem(a mod DEPTH) := std_ulogic_vector(to_unsigned(d, 16));
+				last := a;
+			end if;
+			deallocate(l);
+		end loop;
+		file_close(f);
+	end procedure;
+
+begin
+	ready_inv <= not ready;
+
+	dut: entity work.cpu port map (
+		sysclk1              => clk,
+		pc                   => pc,
+		instr                => instr,
+		reset                => reset,
+		mem_addressready     => ready,
+		mem_addressready_inv => ready_inv,
+		mem_addr             => addr,
+		mem_data_read        => data_read,
+		mem_data_write       => data_write,
+		mem_rw               => rw,
+		mem_sixteenbit       => sixteen,
+		reg1_number          => open,
+		reg2_number          => open,
+		reg1_value           => open,
+		reg2_value           => open,
+		ALU_a                => open,
+		ALU_b                => open,
+		ALU_res              => open,
+		aluflags             => open,
+		reg_din              => reg_din,
+		br_pc                => open,
+		j_pc                 => open,
+		sq_pc                => open,
+		nw_pc                => open,
+		fsmStateCodeCpu      => state
+	);
+
+	clock: process
+		variable n : natural := 0;
+	begin
+		while not done and n < CYCLES loop
+			clk <= '0'; wait for 5 ns;
+			clk <= '1'; wait for 5 ns;
+			n := n + 1;
+		end loop;
+		done <= true;
+		wait;
+	end process;
+
+	reset <= '1', '0' after 12 ns;
+
+	-- Memory model: raise mem_addressready while the cpu waits in Init or
+	-- LoadStoreMemSet, do the access and drop it in MemOP/LoadStoreMemOP.
+	memory: process(clk)
+		file serial      : text;
+		variable mem     : mem_t := (others => (others => '0'));
+		variable loaded  : boolean := false;
+		variable last    : natural;
+		variable inl     : line;
+		variable inpos   : natural := 0;   -- 0: read a new line on next access
+		variable in_open : boolean := false;
+		variable st      : file_open_status;
+		variable a       : natural;
+		variable w       : std_ulogic_vector(15 downto 0);
+		variable c       : natural;
+	begin
+		if not loaded then
+			load_mif(mem, last);
+			if INPUT /= "" then
+				file_open(st, serial, INPUT, read_mode);
+				in_open := st = open_ok;
+			end if;
+			loaded := true;
+		end if;
+
+		if rising_edge(clk) and reset = '0' then
+			if (state = S_INIT or state = S_LSSET) and ready = '0' then
+				ready <= '1';
+			elsif (state = S_MEMOP or state = S_LSOP) and ready = '1' then
+				ready <= '0';
+				a := to_integer(unsigned(addr(15 downto 0)));
+				if state = S_MEMOP and a / 2 > last then
+					done <= true;               -- ran past the image, like the emulator
+				end if;
+				if rw = '1' then            -- SW, SB
+					w := std_ulogic_vector(data_write(15 downto 0));
+					st_addr <= std_ulogic_vector(to_unsigned(a, 16));
+					if sixteen = '1' then
+						st_kind <= 'w';
+						st_data <= w;
+						mem(a / 2) := w;
+					else
+						st_kind <= 'b';
+						st_data <= x"00" & w(7 downto 0);
+						if a = REG_IOCONTOL then
+							inpos := 0;             -- flush serial input
+						end if;
+						if a mod 2 = 0 then
+							mem(a / 2)(7 downto 0) := w(7 downto 0);
+						else
+							mem(a / 2)(15 downto 8) := w(7 downto 0);
+						end if;
+					end if;
+				elsif a = REG_IOCONTOL then
+					data_read <= x"00000003";   -- input and output ready
+				elsif a = REG_IOBUFFER_1 then
+					-- one character per read, the line's '\n' included, then 0
+					c := 0;
+					if in_open and inpos = 0 and not endfile(serial) then
+						readline(serial, inl);
+						inpos := 1;
+					end if;
+					if inpos > 0 and inl /= null then
+						if inpos <= inl'length then
+							c := character'pos(inl(inpos));
+							inpos := inpos + 1;
+						elsif inpos = inl'length + 1 then
+							c := 10;
+							inpos := inpos + 1;
+						end if;
+					end if;
+					data_read <= x"000000" & std_logic_vector(to_unsigned(c, 8));
+				else
+					w := mem(a / 2);
+					if sixteen = '1' then
+						data_read <= x"0000" & std_logic_vector(w);
+					elsif a mod 2 = 0 then
+						data_read <= x"000000" & std_logic_vector(w(7 downto 0));
+					else
+						data_read <= x"000000" & std_logic_vector(w(15 downto 8));
+					end if;
+				end if;
+			end if;
+		end if;
+	end process;
+
+	-- Retirement: an instruction is complete on the rising edge that leaves
+	-- Execute, LoadWriteBack, or a store's LoadStoreMemOP. The register file
+	-- was written on the falling edge before, from regW_num and reg_din.
+	monitor: process(clk)
+		alias regWrite is <<signal .tb_cosim.dut.regWrite : std_ulogic>>;
+		alias regW_num is <<signal .tb_cosim.dut.regW_num : std_ulogic_vector(3 downto 0)>>;
+		variable l      : line;
+		variable retire : boolean;
+	begin
+		if rising_edge(clk) and reset = '0' then
+			retire := state = S_EXECUTE or state = S_LOADWB or
+			          (state = S_LSOP and ready = '0' and instr(15 downto 11) = "11001");
+			if retire then
+				write(l, to_hstring(pc) & " " & to_hstring(instr) & " ");
+				if regWrite = '1' and state /= S_LSOP then
+					write(l, to_hstring(regW_num) & " " & to_hstring(reg_din) & " ");
+				else
+					write(l, string'("- ---- "));
+				end if;
+				if state = S_LSOP then
+					write(l, st_kind & " " & to_hstring(st_addr) & " " & to_hstring(st_data));
+				else
+					write(l, string'("- ---- ----"));
+				end if;
+				writeline(output, l);
+			end if;
+		end if;
+	end process;
+
+	finish: process
+	begin
+		wait until done;
+		std.env.finish;
+	end process;
+
+end architecture sim;
@@ -151,7 +151,7 @@ begin
   -- ALU, Multiplier, BarrelShifter
   alu0:  alu     port map (alucode=>ALUFunctionCode, rd=>ALU_a_in, rs=>ALU_b_in, result=>ALU_out,  flags=>ALUStatus);
   mul0:  mul     port map (alucode=>ALUFunctionCode, rd=>ALU_a_in, rs=>ALU_b_in, result=>MUL_out,  flags=>open);
-  shft0: shifter port map (alucode=>ALUFunctionCode, rd=>ALU_a_in, rs=>ALU_b_in, result=>SHFT_out, flags=>open);
+  shft0: shft    port map (alucode=>ALUFunctionCode, rd=>ALU_a_in, rs=>ALU_b_in, result=>SHFT_out, flags=>open);
 
   -- Sequencer
   seq0: entity work.seq port map ( 
@@ -90,5 +90,23 @@ package util is
          );
   end component alu;
 
+  component mul is
+    port (alucode: in     std_ulogic_vector(3 downto 0);
+          rd:      in     std_ulogic_vector(15 downto 0);
+          rs:      in     std_ulogic_vector(15 downto 0);
+          result:  buffer std_ulogic_vector(15 downto 0);
+          flags:   out    std_ulogic_vector(4 downto 0)
+         );
+  end component mul;
+
+  component shft is
+    port (alucode: in     std_ulogic_vector(3 downto 0);
+          rd:      in     std_ulogic_vector(15 downto 0);
+          rs:      in     std_ulogic_vector(15 downto 0);
+          result:  buffer std_ulogic_vector(15 downto 0);
+          flags:   out    std_ulogic_vector(4 downto 0)
+         );
+  end component shft;
+
 
 end util;
\ No newline at end of file
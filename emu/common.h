@@ -5,19 +5,32 @@
 #ifndef COMMON_INCL
 #define COMMON_INCL
 
+#include <stdint.h>
+
 /* Emulator constants definition */
-#define SIMU    0            // 0: simple, 1: display register, 2: line-by-line exec
 #define STRLEN  256          // decode string length
 
-/* Debug tools */
+#ifdef MIN16_LIB
+/* Library build (libmin16emu): no terminal output, and errors unwind to the
+   API call through emu_fail instead of exiting the host process. */
+#define SIMU    0
+#define DEBUG   0
+void emu_fail(const char* msg, const char* detail) __attribute__((noreturn));
+#define oops(x)    { emu_fail(x, NULL); }
+#define oops2(x,y) { emu_fail(x, y); }
+#else
+#define SIMU    0            // 0: simple, 1: display register, 2: line-by-line exec
 #define DEBUG   1    // change to 1 prints mif strings to stdout
+#define oops(x) { perror(x); exit(1); }                  // perror and exit
+#define oops2(x,y) { fprintf(stderr, "%s: [%s]\n",x,y); exit(1); } // two strings
+#endif
+
+/* Debug tools */
 #define pc(x)   { if (DEBUG) printf("[%c]\n",  x); }  // print character
 #define pd(x)   { if (DEBUG) printf("[%d]\n",  x); }  // print decimal
 #define px(x)   { if (DEBUG) printf("[%04x]\n",x); }  // print hex
 #define ps(x)   { if (DEBUG) printf("[%s]\n",  x); }  // print string
 #define ps2(x,y){ if (DEBUG) printf("[%s: %s]\n",x,y); } // two strings
-#define oops(x) { perror(x); exit(1); }                  // perror and exit
-#define oops2(x,y) { fprintf(stderr, "%s: [%s]\n",x,y); exit(1); } // two strings
 
 /* Font color */
 #define RED0   "\x1B[7;31m"  // Reverse,      Red
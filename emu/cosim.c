@@ -0,0 +1,197 @@
+/*
+ * cosim.c -- lockstep co-simulation against the VHDL cpu
+ *
+ * Reads retired-instruction records written by cpu/cosim/tb_cosim.vhd,
+ *
+ *   PC   INSTR REG VAL  ST ADDR DATA
+ *   0004 66fc  b   003c -  ---- ----
+ *
+ * steps the emulator once per record and stops at the first divergence
+ * with the recent history, the disassembly and both register views.
+ * Exiting closes the pipe, which stops the RTL simulation as well.
+ *
+ *   ghdl -r --std=08 tb_cosim -gMIF=prog.mif | ./cosim prog.mif
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "min16emu.h"
+
+#define HISTORY 8
+
+/* defined in decoder.c */
+extern char* decode(int);
+
+/* one retired instruction as seen by the RTL */
+typedef struct {
+	uint16_t pc, instr;
+	int      reg;          // -1 when no register was written
+	uint16_t val;
+	char     store;        // 'w', 'b' or '-'
+	uint16_t addr, data;
+} record_t;
+
+/* Static variable */
+static record_t history[HISTORY];
+static uint64_t retired;
+static FILE*    serial;     // program input shared with the testbench
+
+static char* regname[] = {
+	"$r0", "$at", "$sp", "$fp", "$ra", "$rb", "$rc", "$rd",
+	"$s0", "$s1", "$t0", "$t1", "$hi", "$lo", "$pc", "$fl",
+};
+
+static int serial_read(void* user, char* buf, int size)
+{
+	if (serial == NULL || fgets(buf, size, serial) == NULL)
+		return -1;
+	return strlen(buf);
+}
+
+/* parse "pc instr reg val st addr data"; fields of '-' mean none */
+static int parse(char* line, record_t* r)
+{
+	char reg[8], val[8], st[8], addr[8], data[8];
+	unsigned pc, instr;
+	if (sscanf(line, "%x %x %7s %7s %7s %7s %7s", &pc, &instr, reg, val, st, addr, data) != 7)
+		return -1;
+	r->pc = pc;
+	r->instr = instr;
+	r->reg = reg[0] == '-' ? -1 : (int) strtol(reg, NULL, 16);
+	r->val = strtol(val, NULL, 16);
+	r->store = st[0];
+	r->addr = strtol(addr, NULL, 16);
+	r->data = strtol(data, NULL, 16);
+	if (r->reg == 0 || r->reg >= 14)  // $r0, $pc, $fl are not in the register file
+		r->reg = -1;
+	return 0;
+}
+
+static void show(const char* who, record_t* r)
+{
+	fprintf(stderr, "  %-4s %04x: %04x %-28s", who, r->pc, r->instr, decode(r->instr));
+	if (r->reg >= 0)
+		fprintf(stderr, "  %s <- %04x", regname[r->reg], r->val);
+	if (r->store != '-')
+		fprintf(stderr, "  S%c [%04x] <- %04x", r->store == 'w' ? 'W' : 'B', r->addr, r->data);
+	fprintf(stderr, "\n");
+}
+
+/* print the first divergence with context and stop */
+static void diverge(const char* what, record_t* rtl, uint16_t* before)
+{
+	int i, n = retired < HISTORY ? retired : HISTORY;
+
+	fprintf(stderr, RED1 "cosim: divergence after %llu instructions: %s" RESET "\n",
+	        (unsigned long long) retired, what);
+	fprintf(stderr, "last %d matched:\n", n);
+	for (i = n; i > 0; i--)
+		show("", &history[(retired - i) % HISTORY]);
+	fprintf(stderr, "diverging:\n");
+	show("rtl", rtl);
+	fprintf(stderr, "registers (before -> emulator after):\n");
+	for (i = 1; i < 14; i++)
+		fprintf(stderr, "  %s %04x -> %04x%s", regname[i], before[i], min16_get_reg(i),
+		        i % 4 == 0 ? "\n" : "");
+	fprintf(stderr, "\n  $pc %04x\n", min16_get_pc());
+	exit(1);
+}
+
+static int check(record_t* r)
+{
+	uint16_t before[16];
+	min16_stats_t s0, s1;
+	char what[STRLEN];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		before[i] = min16_get_reg(i);
+	if (min16_get_pc() != r->pc) {
+		snprintf(what, sizeof what, "PC emulator %04x, rtl %04x", min16_get_pc(), r->pc);
+		diverge(what, r, before);
+	}
+	if (min16_peek_word(r->pc) != r->instr) {
+		snprintf(what, sizeof what, "instruction emulator %04x, rtl %04x", min16_peek_word(r->pc), r->instr);
+		diverge(what, r, before);
+	}
+
+	min16_get_stats(&s0);
+	if (min16_step() == MIN16_ERROR)
+		diverge(min16_error(), r, before);
+	min16_get_stats(&s1);
+
+	for (i = 1; i < 14; i++) {
+		uint16_t expect = i == r->reg ? r->val : before[i];
+		if (min16_get_reg(i) != expect) {
+			snprintf(what, sizeof what, "%s emulator %04x, rtl %04x", regname[i], min16_get_reg(i), expect);
+			diverge(what, r, before);
+		}
+	}
+	if (r->store != '-') {
+		uint16_t got = r->store == 'w' ? min16_peek_word(r->addr) : min16_peek(r->addr);
+		if (s1.stores == s0.stores || got != r->data) {
+			snprintf(what, sizeof what, "store [%04x] emulator %04x, rtl %04x", r->addr, got, r->data);
+			diverge(what, r, before);
+		}
+	}
+	else if (s1.stores != s0.stores)
+		diverge("emulator stored, rtl did not", r, before);
+
+	history[retired++ % HISTORY] = *r;
+	return 0;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: cosim [-i input] [-p pc] program.mif [records]\n");
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	FILE* in = stdin;
+	FILE* fp;
+	char* text;
+	long len;
+	int opt, start = -1;
+	char line[STRLEN];
+	record_t r;
+
+	while ((opt = getopt(argc, argv, "i:p:")) != -1) {
+		switch (opt) {
+			case 'i': serial = fopen(optarg, "r"); break;
+			case 'p': start = strtol(optarg, NULL, 16); break;
+			default:  usage();
+		}
+	}
+	if (optind >= argc) usage();
+	if ((fp = fopen(argv[optind], "r")) == NULL) usage();
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	rewind(fp);
+	text = malloc(len);
+	if (fread(text, 1, len, fp) != (size_t) len) usage();
+	fclose(fp);
+	if (optind + 1 < argc && (in = fopen(argv[optind + 1], "r")) == NULL) usage();
+
+	min16_reset();
+	if (min16_load_mif(text, len) != MIN16_OK) {
+		fprintf(stderr, "cosim: %s\n", min16_error());
+		return 1;
+	}
+	free(text);
+	min16_set_io(serial_read, NULL, NULL);
+	if (start >= 0)
+		min16_set_pc(start);
+
+	while (fgets(line, sizeof line, in))
+		if (parse(line, &r) == 0)
+			check(&r);
+
+	fprintf(stderr, GRN1 "cosim: %llu instructions matched%s" RESET "\n",
+	        (unsigned long long) retired, min16_run(0) == MIN16_HALTED ? ", emulator halted" : "");
+	return 0;
+}
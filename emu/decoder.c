@@ -15,7 +15,7 @@ enum addr_mode {
 };
 
 /* addr_mode list of list */
-static int addr_mode_list[14][4] = {
+static int addr_mode_list[16][4] = {
     {R2_TYPE, R2_TYPE, R2_TYPE, R2_TYPE},
     {R2_TYPE, R2_TYPE, R2_TYPE, R2_TYPE},
     {R2_TYPE, R2_TYPE, R2_TYPE, R2_TYPE},
@@ -24,16 +24,18 @@ static int addr_mode_list[14][4] = {
     {I_TYPE , I_TYPE , I_TYPE , I_TYPE },
     {I_TYPE , I_TYPE , I_TYPE , I_TYPE },
     {I_TYPE , I_TYPE , I_TYPE , I_TYPE },
-    {RSVD   , RSVD   , RSVD   , RSVD   },
+    {I_TYPE , RSVD   , RSVD   , RSVD   },  // SYS is a software-only service trap
     {RSVD   , RSVD   , RSVD   , RSVD   },
     {J_TYPE , J_TYPE , R1_TYPE, R2_TYPE},
     {O_TYPE , O_TYPE , RSVD   , RSVD   },
     {O_TYPE , O_TYPE , O_TYPE , O_TYPE },
     {R1_TYPE, R1_TYPE, R1_TYPE, R1_TYPE},
+    {RSVD   , RSVD   , RSVD   , RSVD   },
+    {RSVD   , RSVD   , RSVD   , RSVD   },
 };
 
 /* command name list of list */
-static char* command_list[14][4] = {
+static char* command_list[16][4] = {
     {"ADD"  , "SUB"  , "MUL"  , "SLT"  },
     {"ADDU" , "SUBU" , "MULU" , "SLTU" },
     {"AND"  , "OR"   , "XOR"  , "NOR"  }, 
@@ -42,17 +44,19 @@ static char* command_list[14][4] = {
     {"ADDIU", "SUBIU", "MULIU", "SLTIU"},
     {"ANDI" , "ORI"  , "XORI" , "NORI" },
     {"SLLI" , "SRLI" , "SRAI" , "ROTLI"},
-    {"RSVD" , "RSVD" , "RSVD" , "RSVD" },
+    {"SYS"  , "RSVD" , "RSVD" , "RSVD" },
     {"RSVD" , "RSVD" , "RSVD" , "RSVD" },
     {"J"    , "JAL"  , "JR"   , "JALR" },
     {"BEQ"  , "BNE"  , "RSVD" , "RSVD" },
     {"LW"   , "LB"   , "SW"   , "SB"   },
     {"MFHI" , "MFLO" , "MTHI" , "MTLO" },
+    {"RSVD" , "RSVD" , "RSVD" , "RSVD" },
+    {"RSVD" , "RSVD" , "RSVD" , "RSVD" },
 };
 
 
 /* opcode + func list of list */
-static int opfunc_list[14][4] = {
+static int opfunc_list[16][4] = {
     {0b000000, 0b000001, 0b000010, 0b000011},
     {0b000100, 0b000101, 0b000110, 0b000111},
     {0b001000, 0b001001, 0b001010, 0b001011}, 
@@ -61,12 +65,14 @@ static int opfunc_list[14][4] = {
     {0b010100, 0b010101, 0b010110, 0b010111},
     {0b011000, 0b011001, 0b011010, 0b011011},
     {0b011100, 0b011101, 0b011110, 0b011111},
-    {      -1,       -1,       -1,       -1},
+    {0b100000,       -1,       -1,       -1},
     {      -1,       -1,       -1,       -1},
     {0b101000, 0b101001, 0b101010, 0b101011},
     {0b101100, 0b101101,       -1,       -1},
     {0b110000, 0b110001, 0b110010, 0b110011},
     {0b110100, 0b110101, 0b110110, 0b110111}, 
+    {      -1,       -1,       -1,       -1},
+    {      -1,       -1,       -1,       -1},
 };
 
 
@@ -1,10 +1,16 @@
 /*
  * emulator.c
  * 
- * Usage: ./emulator filename
+ * Usage: ./emulator [-m prefix] [-w window] [-g 1|16] filename
  *    
  * `make run` to run this program
  *
+ * -m prefix  record read/write/execute counts for the 64 KB address space and
+ *            write heatmaps to prefix.csv, prefix.ppm, prefix.txt and the
+ *            working-set series to prefix.ws.csv (see tracker.c)
+ * -w window  working-set window in retired instructions (default 1000)
+ * -g 1|16    heatmap csv granularity in bytes (default 16)
+ *
  * set SIMU to 0 in common.h to turn off simulation mode, to run simple mode
  * set SIMU to 1 in common.h to turn on display register mode
  * set SIMU to 2 in common.h to turn on line-by-line execution mode
@@ -18,10 +24,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include "common.h"
 #include "decoder.h"
 #include "strfunc.h"
 #include "executor.h"
+#include "tracker.h"
+#include "min16emu.h"
 
 #define DEPTH 32768
 #define WIDTH 16
@@ -36,6 +45,16 @@
 #define BIT_SERIAL_INPUTFLUSH  0b01
 #define BIT_SERIAL_OUTPUTFLUSH 0b10
 
+/* SYS service numbers */
+#define SVC_EXIT 0   // halt, exit status is $rd
+#define SVC_PUTS 1   // print zero-terminated string at $rd (packed bytes)
+#define SVC_PUTD 2   // print $rd as signed decimal
+#define SVC_GETS 3   // read line into buffer at $rd, $t1 bytes max, $t1 = length
+
+/* Dirty page tracking for snapshot/restore (fuzzing) */
+#define PAGESIZE  256
+#define PAGES     (MEMSIZE / PAGESIZE)
+
 #define INT(x) hexchar_to_num(x)
 
 /* Static variable */
@@ -44,12 +63,51 @@ static char*    strptr = strbuf;
 static uint8_t  mem[MEMSIZE];    // Memory
 static uint16_t instruction_reg; // Instruction Register
 static uint16_t last_mif_addr;   // last mif word address
+static int      halted;          // set by SVC_EXIT
+static int      exit_status;     // $rd of SVC_EXIT
+static int      mif_begin;       // FSM for process_line
+static min16_stats_t stats;      // counters for libmin16emu
+
+/* snapshot state restored by emu_restore */
+static uint8_t  snap_mem[MEMSIZE];
+static uint16_t snap_regs[16];
+static uint16_t snap_last_addr;
+static uint64_t dirty[PAGES / 64];   // pages written since snapshot
+
+/* PC-edge coverage for jumps and branches, NULL when off */
+static uint8_t* cov_map;
+static uint32_t cov_mask;
+
+/* I/O callbacks. the command-line emulator uses the terminal */
+static int  stdio_read(void* user, char* buf, int size);
+static void stdio_write(void* user, const char* data, int len);
+static min16_read_fn  io_read  = stdio_read;
+static min16_write_fn io_write = stdio_write;
+static void*          io_user  = NULL;
 
 uint8_t* get_mem() {return mem;}
+int      get_exit_status() {return exit_status;}
+min16_stats_t* get_stats() {return &stats;}
+
+/* API for I/O callbacks, NULL restores the terminal */
+void set_io(min16_read_fn read, min16_write_fn write, void* user)
+{
+	io_read  = read  ? read  : stdio_read;
+	io_write = write ? write : stdio_write;
+	io_user  = user;
+}
 
 /**
 * Helper Functions
 */
+/* mark the page holding byte_addr as written since the snapshot */
+static inline void mark_dirty(uint16_t byte_addr)
+{
+	int page = byte_addr / PAGESIZE;
+	dirty[page / 64] |= 1ULL << (page % 64);
+}
+void emu_mark_dirty(uint16_t byte_addr) { mark_dirty(byte_addr); }
+
 /* convert hexchar to num */
 int hexchar_to_num(char c)
 {
@@ -75,18 +133,38 @@ int hexstr_to_num(char* hexstr)
 	return num;
 }
 
+/* read one line from the terminal */
+static int stdio_read(void* user, char* buf, int size)
+{
+	if (SIMU)
+		printf("Input number (signed 16bit): ");
+	if (fgets(buf, size, stdin) == NULL)
+		return -1;
+	return strlen(buf);
+}
+
+/* write characters to the terminal in green */
+static void stdio_write(void* user, const char* data, int len)
+{
+	printf("%s%.*s%s", GRN1, len, data, RESET);
+}
+
 /**
 * Memory Manipulate API to be used by executor.c
 */
 /* get memory contents at byte address */
 uint8_t load_byte(uint16_t byte_addr)
 {
+	if (track_on) track_access(byte_addr, TRACK_READ);
+	stats.loads++;
 	if (byte_addr == REG_IOBUFFER_1) {
 		if (strptr == strbuf) {
-			if (SIMU)
-				printf("Input number (signed 16bit): ");
-			fgets(strbuf, STRLEN, stdin);
+			if (io_read(io_user, strbuf, STRLEN) < 0)
+				strbuf[0] = '\0';
 		}
+		stats.io_in++;
+		if (*strptr == '\0')
+			return 0;   // stay on the terminator until IOCONTOL resets
 		return (uint8_t) *strptr++;
 	}
 	return mem[byte_addr];
@@ -94,19 +172,29 @@ uint8_t load_byte(uint16_t byte_addr)
 /* get memory contents at word address in big endian */
 uint16_t load_word(uint16_t byte_addr)
 {
-	return mem[byte_addr + 1] * WORDSIZE | mem[byte_addr];
+	if (track_on) {
+		track_access(byte_addr, TRACK_READ);
+		track_access(byte_addr + 1, TRACK_READ);
+	}
+	stats.loads++;
+	return mem[(uint16_t) (byte_addr + 1)] * WORDSIZE | mem[byte_addr];
 }
 
 /* set memory contents at designated byte address */
 void store_byte(uint16_t byte_addr, uint16_t word)
 {	
+	if (track_on) track_access(byte_addr, TRACK_WRITE);
+	stats.stores++;
+	mark_dirty(byte_addr);
 	if (byte_addr == REG_IOBUFFER_1) {
+		char c = word & 0x00ff;
+		stats.io_out++;
 		if (SIMU) {
-			printf("[stdout] word [%04x] at address [%04x] is char [%s%c%s]\n", word, byte_addr, GRN1, word & 0x00ff, RESET);
+			printf("[stdout] word [%04x] at address [%04x] is char [%s%c%s]\n", word, byte_addr, GRN1, c, RESET);
 			getchar();
 		}
 		else
-			printf("%s%c%s", GRN1, word & 0x00ff, RESET);
+			io_write(io_user, &c, 1);
 	}
 	else if (byte_addr == REG_IOCONTOL) {
 		memset(strbuf, 0, STRLEN);
@@ -118,8 +206,66 @@ void store_byte(uint16_t byte_addr, uint16_t word)
 /* set memory contents at designated byte address */
 void store_word(uint16_t byte_addr, uint16_t word)
 {	
+	if (track_on) {
+		track_access(byte_addr, TRACK_WRITE);
+		track_access(byte_addr + 1, TRACK_WRITE);
+	}
+	stats.stores++;
+	mark_dirty(byte_addr);
+	mark_dirty(byte_addr + 1);
 	mem[byte_addr] = word & 0x00ff;
-	mem[byte_addr+1] = word >> 8;
+	mem[(uint16_t) (byte_addr + 1)] = word >> 8;
+}
+
+/**
+* Service Call API to be used by executor.c
+*/
+/* host-side bulk I/O for the SYS trap. returns new $t1 value */
+uint16_t service_call(int service, uint16_t arg, uint16_t t1)
+{
+	char buf[STRLEN];
+	int n = 0, count;
+	uint16_t addr = arg;
+
+	stats.services++;
+	switch (service) {
+		case SVC_EXIT:
+			exit_status = arg & 0xff;
+			halted = 1;
+			return t1;
+		case SVC_PUTS:
+			for (count = 0; mem[addr] != 0 && count < MEMSIZE; addr++, count++) {
+				if (track_on) track_access(addr, TRACK_READ);
+				buf[n++] = mem[addr];
+				if (n == STRLEN) {
+					io_write(io_user, buf, n);
+					stats.io_out += n;
+					n = 0;
+				}
+			}
+			io_write(io_user, buf, n);
+			stats.io_out += n;
+			return t1;
+		case SVC_PUTD:
+			n = snprintf(buf, sizeof buf, "%d", (int16_t) arg);
+			io_write(io_user, buf, n);
+			stats.io_out += n;
+			return t1;
+		case SVC_GETS:
+			if (t1 == 0 || t1 > STRLEN) t1 = STRLEN;
+			if (io_read(io_user, buf, t1) < 0) buf[0] = '\0';
+			buf[strcspn(buf, "\n")] = '\0';
+			for (n = 0; ; n++, addr++) {
+				if (track_on) track_access(addr, TRACK_WRITE);
+				mark_dirty(addr);
+				mem[addr] = buf[n];
+				if (buf[n] == '\0') break;
+			}
+			stats.io_in += n;
+			return n;
+		default:
+			oops2("service_call: unknown service", int_to_str(service))
+	}
 }
 
 /**
@@ -128,6 +274,7 @@ void store_word(uint16_t byte_addr, uint16_t word)
 /* store bytes from mif string in little endian */
 void mif_to_memory(char* str, int byte_addr)
 {
+	if (strlen(str) < 4) oops2("mif_to_memory: malformed data", str)
 	uint8_t byte0 = INT(str[2]) * 16 + INT(str[3]);
 	uint8_t byte1 = INT(str[0]) * 16 + INT(str[1]);
 	mem[byte_addr] = byte0;
@@ -139,8 +286,9 @@ void process_memory(char* line)
 {
 	const char* delim = ":;";
 	char* sp = strsep(&line, delim);
-	uint16_t word_addr = hexstr_to_num(remove_space(sp));
+	int word_addr = hexstr_to_num(remove_space(sp));
 	sp = strsep(&line, delim);
+	if (sp == NULL || word_addr >= DEPTH) oops2("process_memory: malformed mif line", line ? line : "")
 	mif_to_memory(remove_space(sp), word_addr * 2);  // byte_addr = word_addr * 2
 }
 
@@ -149,31 +297,128 @@ void process_line(char* line)
 {
 	line = remove_space(line);
 
-	static int is_begin = 0; // FSM
-	if (is_begin == 0 && strstr(line, "BEGIN"))
-		is_begin = 1;
-	else if (is_begin == 1 && strstr(line, "END;"))
-		is_begin = 0;
-	else if (is_begin == 1 && strlen(line) == 0)
+	if (mif_begin == 0 && strstr(line, "BEGIN"))
+		mif_begin = 1;
+	else if (mif_begin == 1 && strstr(line, "END;"))
+		mif_begin = 0;
+	else if (mif_begin == 1 && strlen(line) == 0)
 		return;
-	else if (is_begin == 1 && strstr(line, "--") == line)
+	else if (mif_begin == 1 && strstr(line, "--") == line)
 		return;
-	else if (is_begin == 1) {
+	else if (mif_begin == 1) {
 		process_memory(line);
 		last_mif_addr = hexstr_to_num(strsep(&line, ":"));
 	}
 }
 
+/* fetch instruction word, counted as execute instead of read */
+uint16_t fetch_word(uint16_t pc)
+{
+	if (track_on) {
+		track_access(pc, TRACK_EXEC);
+		track_access(pc + 1, TRACK_EXEC);
+	}
+	return mem[(uint16_t) (pc + 1)] * WORDSIZE | mem[pc];
+}
+
+/* check if the machine stopped: SYS exit or pc past the loaded image */
+int emu_halted()
+{
+	return halted || get_pc() >= last_mif_addr * 2 + 1;
+}
+
+/* execute one instruction. return 1 if halted, nothing executed */
+int emu_step()
+{
+	if (emu_halted()) return 1;
+	uint16_t from = get_pc();
+	instruction_reg = fetch_word(from);
+	execute(instruction_reg);
+	if (cov_map && (instruction_reg >> 13) == 0b101)  // J, JAL, JR, JALR, BEQ, BNE
+		cov_map[(from * 40503u ^ get_pc()) & cov_mask]++;
+	stats.instructions++;
+	if (track_on) track_retire();
+	return 0;
+}
+
 /* emulate */
 void emulate()
 {
-	uint16_t pc;
-	for(;;) {  // increment by word
-		pc = get_pc();
-		instruction_reg = load_word(pc);
-		if (pc >= last_mif_addr * 2 + 1) break;
-		execute(instruction_reg);
+	while (emu_step() == 0) {}  // increment by word
+}
+
+/* clear memory, I/O buffer and halt state for a new program */
+void emu_reset()
+{
+	memset(mem, 0, sizeof mem);
+	memset(strbuf, 0, sizeof strbuf);
+	memset(&stats, 0, sizeof stats);
+	strptr = strbuf;
+	last_mif_addr = 0;
+	mif_begin = 0;
+	halted = 0;
+	exit_status = 0;
+	reset_cpu();
+}
+
+/* set coverage map, size must be a power of two. NULL turns it off */
+void emu_cov_map(uint8_t* map, uint32_t size)
+{
+	cov_map  = size ? map : NULL;
+	cov_mask = size - 1;
+}
+
+/* keep memory and registers as the state emu_restore returns to */
+void emu_snapshot()
+{
+	int i;
+	memcpy(snap_mem, mem, sizeof mem);
+	for (i = 0; i < 16; i++)
+		snap_regs[i] = get_reg(i);
+	snap_last_addr = last_mif_addr;
+	memset(dirty, 0, sizeof dirty);
+}
+
+/* return to the snapshot, copying back only pages written since */
+void emu_restore()
+{
+	int w, b, i;
+	for (w = 0; w < PAGES / 64; w++) {
+		for (; dirty[w]; dirty[w] &= dirty[w] - 1) {
+			b = __builtin_ctzll(dirty[w]);
+			int offs = (w * 64 + b) * PAGESIZE;
+			memcpy(mem + offs, snap_mem + offs, PAGESIZE);
+		}
 	}
+	for (i = 0; i < 16; i++)
+		set_reg(i, snap_regs[i]);
+	last_mif_addr = snap_last_addr;
+	memset(strbuf, 0, sizeof strbuf);
+	memset(&stats, 0, sizeof stats);
+	strptr = strbuf;
+	halted = 0;
+	exit_status = 0;
+}
+
+/* set last image word address used to detect program end */
+void set_last_addr(uint16_t word_addr)
+{
+	last_mif_addr = word_addr;
+}
+
+/* set I/O memory input/output ready state after loading */
+void finish_load()
+{
+	mem[REG_IOCONTOL] = BIT_SERIAL_INPUTREADY | BIT_SERIAL_OUTPUTREADY;
+}
+
+/* build memory from mif text held in a buffer. text is modified */
+void build_memory_text(char* text)
+{
+	char* line;
+	while ((line = strsep(&text, "\n")) != NULL)
+		process_line(line);
+	finish_load();
 }
 
 /* build memory */
@@ -193,13 +438,15 @@ void build_memory(char* filename)
     	lines++;
     }
 
-    // set I/O memory input/output ready state
-    mem[REG_IOCONTOL] = BIT_SERIAL_INPUTREADY | BIT_SERIAL_OUTPUTREADY;
+    free(line);
+    fclose(fp);
+    finish_load();
 
     if (SIMU)
 	    printf("LINES READ : %d\n", lines);
 }
 
+#ifndef MIN16_LIB
 /* TEST */
 void test_show_memory()
 {
@@ -211,18 +458,43 @@ void test_show_memory()
 	    printf("mem[%04x] is [%04x]\n", i, mem[i]);	
 }
 
+/* dump heatmap when stopped with Ctrl-C */
+void on_interrupt(int sig)
+{
+	track_dump();
+	exit(0);
+}
+
 /**
 * Start Core Function
 */
 void emulator(int ac, char* av[])
 {
     ps("-- emulator.c --")
-    if (ac < 2) oops("Usage: ./emulator filename.mif\t")
+
+    char* heatmap = NULL;
+    int   window = 0;
+    int   opt;
+    while ((opt = getopt(ac, av, "m:w:g:")) != -1) {
+        switch (opt) {
+            case 'm': heatmap = optarg; break;
+            case 'w': window = atoi(optarg); break;
+            case 'g': track_granularity(atoi(optarg)); break;
+            default:  oops2("Usage", "./emulator [-m prefix] [-w window] [-g 1|16] filename.mif")
+        }
+    }
+    if (optind >= ac) oops2("Usage", "./emulator [-m prefix] [-w window] [-g 1|16] filename.mif")
 
     system("clear");
 
-    build_memory(av[1]);
+    build_memory(av[optind]);
+    if (heatmap) {
+        track_init(heatmap, window);
+        signal(SIGINT, on_interrupt);  // interactive programs rarely halt
+    }
 	emulate();
+	track_dump();
+	fflush(stdout);
 }
 
 /* main controler */
@@ -234,5 +506,6 @@ int main(int ac, char* av[])
     /* test function here */
     // test_show_memory();
 
-    return 0;
+    return exit_status;
 }
+#endif /* MIN16_LIB */
@@ -26,11 +26,12 @@ static uint16_t regs[REGSIZE];   // Register Array
 static uint16_t program_counter; // corresponds to memory address
 
 /* Defined in emulator.c */
-extern uint8_t  load_byte(int);
-extern uint16_t load_word(int);
-extern void     store_byte(int, uint16_t);
-extern void     store_word(int, uint16_t);
+extern uint8_t  load_byte(uint16_t);
+extern uint16_t load_word(uint16_t);
+extern void     store_byte(uint16_t, uint16_t);
+extern void     store_word(uint16_t, uint16_t);
 extern uint8_t* get_mem();
+extern uint16_t service_call(int, uint16_t, uint16_t);
 
 /* Registers */
 enum reg {
@@ -57,13 +58,14 @@ void ADDI () ; void SUBI () ; void MULI () ; void SLTI () ;
 void ADDIU() ; void SUBIU() ; void MULIU() ; void SLTIU() ;
 void ANDI () ; void ORI  () ; void XORI () ; void NORI () ;
 void SLLI () ; void SRLI () ; void SRAI () ; void ROTLI() ;
+void SYS  () ;
 void J    () ; void JAL  () ; void JR   () ; void JALR () ;
 void BEQ  () ; void BNE  () ; void RSVD () ;
 void LW   () ; void LB   () ; void SW   () ; void SB   () ;
 void MFHI () ; void MFLO () ; void MTHI () ; void MTLO () ; 
 
 /* Execute Function Pointer Array */
-static void (*func_list[14][4])() = {
+static void (*func_list[16][4])() = {
     {ADD  , SUB  , MUL  , SLT  },
     {ADDU , SUBU , MULU , SLTU },
     {AND  , OR   , XOR  , NOR  }, 
@@ -72,12 +74,14 @@ static void (*func_list[14][4])() = {
     {ADDIU, SUBIU, MULIU, SLTIU},
     {ANDI , ORI  , XORI , NORI },
     {SLLI , SRLI , SRAI , ROTLI},
-    {RSVD , RSVD , RSVD , RSVD },
+    {SYS  , RSVD , RSVD , RSVD },
     {RSVD , RSVD , RSVD , RSVD },
     {J    , JAL  , JR   , JALR },
     {BEQ  , BNE  , RSVD , RSVD },
     {LW   , LB   , SW   , SB   },
     {MFHI , MFLO , MTHI , MTLO },
+    {RSVD , RSVD , RSVD , RSVD },
+    {RSVD , RSVD , RSVD , RSVD },
 };
 
 
@@ -110,6 +114,27 @@ int get_args_from_instr(uint16_t instr)
 
 /* API for Program Counter used in emulator.c */
 uint16_t get_pc()  {return program_counter;}
+void     set_pc(uint16_t addr) {program_counter = addr;}
+
+/* API for Registers used by libmin16emu. PC maps to the program counter */
+uint16_t get_reg(int i)
+{
+	return i == PC ? program_counter : regs[i & (REGSIZE - 1)];
+}
+void set_reg(int i, uint16_t value)
+{
+	if (i == PC)
+		program_counter = value;
+	else if (i != R0)
+		regs[i & (REGSIZE - 1)] = value;
+}
+
+/* clear registers and program counter */
+void reset_cpu()
+{
+	memset(regs, 0, sizeof regs);
+	program_counter = 0;
+}
 
 
 /* Execute instruction */
@@ -486,6 +511,12 @@ void ROTLI(int num)
 	regs[R_rd(num)] = left | right;
 }
 
+/* software-only service trap: SYS $rd, service. $rd is the argument,
+   $t1 carries the buffer size in and the result out (see emulator.c) */
+void SYS  (int num)
+{	regs[T1] = service_call(unsigned_R_imm(num), unsigned_R_rd(num), regs[T1]);
+}
+
 void J    (int num) 
 {	// program_counter = ((program_counter + 2) & 0xfc00) | ((uint16_t) num & 0x03ff);
 	program_counter = unsigned_J_target(num);
@@ -6,6 +6,10 @@
 #define EXECUTOR_INCL
 
 uint16_t get_pc();
+void     set_pc(uint16_t);
+uint16_t get_reg(int);
+void     set_reg(int, uint16_t);
+void     reset_cpu();
 void execute(uint16_t);
 void executor_test(int);
 void display_info_with_execution(int);
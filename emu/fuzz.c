@@ -0,0 +1,51 @@
+/*
+ * fuzz.c -- fuzz entry points for libmin16emu
+ *
+ * Each iteration restores the snapshot taken after the program was loaded
+ * (only dirty pages are copied back), hands the fuzz input to the machine
+ * and runs it under an instruction budget. Drivers live in fuzzer.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "min16emu.h"
+
+/* Static variable */
+static const uint8_t* input;     // serial input of the current iteration
+static size_t         input_len;
+static size_t         input_pos;
+
+/* hand out the next input line, '\n' included */
+static int serial_read(void* user, char* buf, int size)
+{
+	int n = 0;
+	if (input_pos >= input_len)
+		return -1;
+	while (n < size - 1 && input_pos < input_len) {
+		char c = input[input_pos++];
+		buf[n++] = c;
+		if (c == '\n') break;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+int min16_fuzz_serial(const uint8_t* data, size_t len, uint64_t budget)
+{
+	min16_restore();
+	input = data;
+	input_len = len;
+	input_pos = 0;
+	min16_set_io(serial_read, NULL, NULL);
+	return min16_run(budget);
+}
+
+int min16_fuzz_image(const uint8_t* data, size_t len, uint64_t budget)
+{
+	min16_restore();
+	min16_set_io(NULL, NULL, NULL);
+	min16_load_image(data, len);
+	return min16_run(budget);
+}
@@ -0,0 +1,184 @@
+/*
+ * fuzzer.c -- fuzzing drivers for MIN16 programs and the emulator core
+ *
+ * Built with -DMIN16_FUZZ_LIBFUZZER: libFuzzer target. The PC-edge map is
+ * registered as extra 8-bit counters so libFuzzer steers on guest coverage.
+ *   MIN16_FUZZ_MIF     program loaded before the snapshot (optional for image)
+ *   MIN16_FUZZ_MODE    serial (default) or image
+ *   MIN16_FUZZ_BUDGET  instructions per input (default 100000)
+ *
+ * Built otherwise: standalone driver, also used as the AFL target.
+ *   fuzzer [-i] [-n budget] [-r repeat] program.mif|- [input ...]
+ * Inputs come from files or stdin. When __AFL_SHM_ID is set the coverage
+ * map is AFL's shared memory; afl-clang-fast builds run in persistent mode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/shm.h>
+#include "common.h"
+#include "min16emu.h"
+
+#define BUDGET 100000
+
+/* Static variable */
+static uint8_t  cov[MIN16_COV_MAPSIZE];   // used when not under AFL
+static int      image_mode;
+static uint64_t budget = BUDGET;
+
+/* setup errors end the run, oops() would longjmp in library builds */
+static void die(const char* msg, const char* detail)
+{
+	fprintf(stderr, "fuzzer: %s: %s\n", msg, detail);
+	exit(1);
+}
+
+/* read a whole file, NULL on failure */
+static uint8_t* slurp(FILE* fp, size_t* len)
+{
+	size_t cap = 4096, n = 0, r;
+	uint8_t* buf = malloc(cap);
+	while (buf && (r = fread(buf + n, 1, cap - n, fp)) > 0)
+		if ((n += r) == cap)
+			buf = realloc(buf, cap *= 2);
+	*len = n;
+	return buf;
+}
+
+/* load the program under test and snapshot it */
+static void setup(const char* path)
+{
+	min16_reset();
+	if (path && strcmp(path, "-") != 0) {
+		FILE* fp = fopen(path, "r");
+		size_t len;
+		uint8_t* text;
+		if (fp == NULL) die("cannot open", path);
+		text = slurp(fp, &len);
+		fclose(fp);
+		if (min16_load_mif((char*) text, len) != MIN16_OK)
+			die("bad program", min16_error());
+		free(text);
+	}
+	min16_snapshot();
+}
+
+static int run_one(const uint8_t* data, size_t len)
+{
+	return image_mode ? min16_fuzz_image(data, len, budget)
+	                  : min16_fuzz_serial(data, len, budget);
+}
+
+
+#ifdef MIN16_FUZZ_LIBFUZZER
+/**
+* libFuzzer
+*/
+void __sanitizer_cov_8bit_counters_init(uint8_t*, uint8_t*) __attribute__((weak));
+
+int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+	char* mode = getenv("MIN16_FUZZ_MODE");
+	char* n = getenv("MIN16_FUZZ_BUDGET");
+	image_mode = mode && strcmp(mode, "image") == 0;
+	if (n) budget = strtoull(n, NULL, 0);
+	setup(getenv("MIN16_FUZZ_MIF"));
+	min16_cov_map(cov, sizeof cov);
+	if (__sanitizer_cov_8bit_counters_init)
+		__sanitizer_cov_8bit_counters_init(cov, cov + sizeof cov);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t len)
+{
+	run_one(data, len);
+	return 0;
+}
+
+#else
+/**
+* Standalone / AFL driver
+*/
+#ifndef __AFL_LOOP
+#define __AFL_LOOP(n) (iter++ == 0)
+#endif
+
+/* use AFL's shared map when running under afl-fuzz */
+static void attach_map()
+{
+	char* id = getenv("__AFL_SHM_ID");
+	uint8_t* map;
+	if (id && (map = shmat(atoi(id), NULL, 0)) != (void*) -1)
+		min16_cov_map(map, MIN16_COV_MAPSIZE);
+	else
+		min16_cov_map(cov, sizeof cov);
+}
+
+static int edges()
+{
+	int i, n = 0;
+	for (i = 0; i < MIN16_COV_MAPSIZE; i++)
+		n += cov[i] != 0;
+	return n;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: fuzzer [-i] [-n budget] [-r repeat] program.mif|- [input ...]\n");
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	int opt, i, status = MIN16_OK, repeat = 1, iter = 0;
+	size_t len;
+	uint8_t* data;
+
+	while ((opt = getopt(argc, argv, "in:r:")) != -1) {
+		switch (opt) {
+			case 'i': image_mode = 1; break;
+			case 'n': budget = strtoull(optarg, NULL, 0); break;
+			case 'r': repeat = atoi(optarg); break;
+			default:  usage();
+		}
+	}
+	if (optind >= argc) usage();
+	setup(argv[optind++]);
+	attach_map();
+
+	if (optind == argc) {
+		data = slurp(stdin, &len);
+		while (__AFL_LOOP(1000)) {
+			status = run_one(data, len);
+			if (status == MIN16_ERROR)
+				abort();   // report emulator faults as crashes
+		}
+		free(data);
+		return 0;
+	}
+
+	for (; optind < argc; optind++) {
+		FILE* fp = fopen(argv[optind], "rb");
+		struct timespec t0, t1;
+		if (fp == NULL) die("cannot open", argv[optind]);
+		data = slurp(fp, &len);
+		fclose(fp);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (i = 0; i < repeat; i++)
+			status = run_one(data, len);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		printf("%s: %s, %d edges", argv[optind],
+		       status == MIN16_ERROR ? min16_error() :
+		       status == MIN16_HALTED ? "halted" : "budget", edges());
+		if (repeat > 1)
+			printf(", %.0f execs/s", repeat / secs);
+		printf("\n");
+		free(data);
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,184 @@
+/*
+ * min16emu.c -- embeddable emulator API (libmin16emu)
+ *
+ * Thin layer over emulator.c and executor.c compiled with MIN16_LIB.
+ * Each entry point that can reach an oops() arms a jmp_buf first, so a
+ * malformed image or an unknown service returns MIN16_ERROR instead of
+ * exiting the host process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "common.h"
+#include "executor.h"
+#include "min16emu.h"
+
+#define MEMSIZE 65536
+
+/* Defined in emulator.c */
+extern uint8_t*       get_mem();
+extern int            get_exit_status();
+extern min16_stats_t* get_stats();
+extern void           set_io(min16_read_fn, min16_write_fn, void*);
+extern int            emu_step();
+extern int            emu_halted();
+extern void           emu_reset();
+extern void           set_last_addr(uint16_t);
+extern void           finish_load();
+extern void           build_memory_text(char*);
+extern void           emu_mark_dirty(uint16_t);
+extern void           emu_snapshot();
+extern void           emu_restore();
+extern void           emu_cov_map(uint8_t*, uint32_t);
+
+/* Static variable */
+static jmp_buf trap;             // armed by every failing entry point
+static char    errmsg[STRLEN];   // last error message
+static int     io_installed;     // caller set I/O callbacks
+
+/* called through oops() in library builds */
+void emu_fail(const char* msg, const char* detail)
+{
+	if (detail)
+		snprintf(errmsg, sizeof errmsg, "%s: [%s]", msg, detail);
+	else
+		snprintf(errmsg, sizeof errmsg, "%s", msg);
+	longjmp(trap, 1);
+}
+
+/* output sink used until the caller installs one */
+static void discard_write(void* user, const char* data, int len) {}
+
+/* input source used until the caller installs one */
+static int empty_read(void* user, char* buf, int size) { return -1; }
+
+
+/**
+* Machine Setup
+*/
+/* clear memory, registers, counters and I/O state */
+void min16_reset(void)
+{
+	emu_reset();
+	errmsg[0] = '\0';
+}
+
+/* load mif text (as written by the assembler) */
+int min16_load_mif(const char* text, size_t len)
+{
+	char* copy = malloc(len + 1);
+	if (copy == NULL) {
+		snprintf(errmsg, sizeof errmsg, "min16_load_mif: out of memory");
+		return MIN16_ERROR;
+	}
+	memcpy(copy, text, len);
+	copy[len] = '\0';
+	if (setjmp(trap)) {
+		free(copy);
+		return MIN16_ERROR;
+	}
+	build_memory_text(copy);
+	free(copy);
+	return MIN16_OK;
+}
+
+/* load raw little-endian memory image starting at address 0 */
+int min16_load_image(const uint8_t* image, size_t len)
+{
+	size_t offs;
+	if (len > MEMSIZE) len = MEMSIZE;
+	memcpy(get_mem(), image, len);
+	for (offs = 0; offs < len; offs += 256)
+		emu_mark_dirty(offs);
+	set_last_addr(len < 2 ? 0 : (len - 1) / 2);
+	finish_load();
+	return MIN16_OK;
+}
+
+/* install I/O callbacks. NULL keeps the silent defaults */
+void min16_set_io(min16_read_fn read, min16_write_fn write, void* user)
+{
+	set_io(read ? read : empty_read, write ? write : discard_write, user);
+	io_installed = 1;
+}
+
+
+/**
+* Execution
+*/
+/* run up to max_instructions */
+int min16_run(uint64_t max_instructions)
+{
+	if (!io_installed)
+		min16_set_io(NULL, NULL, NULL);   // never touch the terminal
+	if (setjmp(trap))
+		return MIN16_ERROR;
+
+	uint64_t i;
+	for (i = 0; i < max_instructions; i++)
+		if (emu_step())
+			return MIN16_HALTED;
+	return emu_halted() ? MIN16_HALTED : MIN16_OK;
+}
+
+/* execute one instruction */
+int min16_step(void)
+{
+	return min16_run(1);
+}
+
+int         min16_exit_status(void) { return get_exit_status(); }
+const char* min16_error(void)       { return errmsg; }
+
+void min16_get_stats(min16_stats_t* stats)
+{
+	*stats = *get_stats();
+}
+
+
+/**
+* Inspection
+*/
+uint16_t min16_get_reg(int reg)               { return get_reg(reg); }
+void     min16_set_reg(int reg, uint16_t v)   { set_reg(reg, v); }
+uint16_t min16_get_pc(void)                   { return get_pc(); }
+void     min16_set_pc(uint16_t byte_addr)     { set_pc(byte_addr); }
+uint8_t  min16_peek(uint16_t byte_addr)       { return get_mem()[byte_addr]; }
+
+void min16_poke(uint16_t byte_addr, uint8_t v)
+{
+	emu_mark_dirty(byte_addr);
+	get_mem()[byte_addr] = v;
+}
+
+uint16_t min16_peek_word(uint16_t byte_addr)
+{
+	uint8_t* mem = get_mem();
+	return mem[(uint16_t) (byte_addr + 1)] << 8 | mem[byte_addr];
+}
+
+void min16_poke_word(uint16_t byte_addr, uint16_t v)
+{
+	uint8_t* mem = get_mem();
+	emu_mark_dirty(byte_addr);
+	emu_mark_dirty(byte_addr + 1);
+	mem[byte_addr] = v & 0xff;
+	mem[(uint16_t) (byte_addr + 1)] = v >> 8;
+}
+
+
+/**
+* Snapshots and Coverage
+*/
+void min16_snapshot(void) { emu_snapshot(); }
+void min16_restore(void)  { emu_restore(); }
+
+void min16_cov_map(uint8_t* map, size_t size)
+{
+	if (map == NULL || size == 0 || (size & (size - 1)))
+		emu_cov_map(NULL, 0);
+	else
+		emu_cov_map(map, size);
+}
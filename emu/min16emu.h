@@ -0,0 +1,98 @@
+/*
+ * min16emu.h -- embeddable MIN16 emulator API (libmin16emu)
+ *
+ * Build with `make lib` to get libmin16emu.a and libmin16emu.so.
+ *
+ * The emulator keeps one machine per process. Every call is free of
+ * terminal side effects; errors that make the command-line emulator exit
+ * are returned as MIN16_ERROR with the message in min16_error().
+ *
+ * Typical use:
+ *     min16_reset();
+ *     min16_load_mif(text, len);
+ *     min16_set_io(my_read, my_write, ctx);
+ *     while (min16_run(100000) == MIN16_OK) { ... }
+ */
+
+#ifndef MIN16EMU_INCL
+#define MIN16EMU_INCL
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* run status */
+#define MIN16_OK      0    // instruction budget used, machine still running
+#define MIN16_HALTED  1    // ran past the loaded image or executed SYS exit
+#define MIN16_ERROR  -1    // see min16_error()
+
+/* register numbers, same order as the register file */
+enum min16_reg {
+    MIN16_R0, MIN16_AT, MIN16_SP, MIN16_FP, MIN16_RA, MIN16_RB, MIN16_RC, MIN16_RD,
+    MIN16_S0, MIN16_S1, MIN16_T0, MIN16_T1, MIN16_HI, MIN16_LO, MIN16_PC, MIN16_FL,
+};
+
+/* counters since the last min16_reset */
+typedef struct {
+    uint64_t instructions;   // retired instructions
+    uint64_t loads;          // LW/LB
+    uint64_t stores;         // SW/SB
+    uint64_t io_in;          // characters delivered to the program
+    uint64_t io_out;         // characters written by the program
+    uint64_t services;       // SYS traps
+} min16_stats_t;
+
+/* fill buf with one input line (at most size-1 chars plus '\0'),
+   return its length or -1 at end of input */
+typedef int  (*min16_read_fn)(void* user, char* buf, int size);
+/* receive len characters written by the program */
+typedef void (*min16_write_fn)(void* user, const char* data, int len);
+
+/* machine setup */
+void        min16_reset(void);
+int         min16_load_mif(const char* text, size_t len);
+int         min16_load_image(const uint8_t* image, size_t len);
+void        min16_set_io(min16_read_fn read, min16_write_fn write, void* user);
+
+/* execution */
+int         min16_run(uint64_t max_instructions);
+int         min16_step(void);
+int         min16_exit_status(void);
+const char* min16_error(void);
+void        min16_get_stats(min16_stats_t* stats);
+
+/* inspection */
+uint16_t    min16_get_reg(int reg);
+void        min16_set_reg(int reg, uint16_t value);
+uint16_t    min16_get_pc(void);
+void        min16_set_pc(uint16_t byte_addr);
+uint8_t     min16_peek(uint16_t byte_addr);
+void        min16_poke(uint16_t byte_addr, uint8_t value);
+uint16_t    min16_peek_word(uint16_t byte_addr);
+void        min16_poke_word(uint16_t byte_addr, uint16_t value);
+
+/* snapshots and coverage.
+   min16_restore returns to the last min16_snapshot, copying back only the
+   256-byte pages written since, so a fuzz iteration costs what it touched.
+   The coverage map counts PC edges (from, to) of every jump and branch;
+   size must be a power of two, NULL turns counting off. */
+#define MIN16_COV_MAPSIZE 65536
+void        min16_snapshot(void);
+void        min16_restore(void);
+void        min16_cov_map(uint8_t* map, size_t size);
+
+/* fuzz entry points (fuzz.c). Both restore the snapshot, feed data and run
+   at most budget instructions; return the min16_run status.
+   serial: data is the program's serial input, one line per '\n'.
+   image:  data is a raw little-endian memory image loaded at address 0. */
+int         min16_fuzz_serial(const uint8_t* data, size_t len, uint64_t budget);
+int         min16_fuzz_image(const uint8_t* data, size_t len, uint64_t budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MIN16EMU_INCL */
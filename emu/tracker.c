@@ -0,0 +1,200 @@
+/*
+ * tracker.c -- memory access heatmap and working-set tracker
+ *
+ * Counts read/write/execute accesses for every byte of the 64 KB address
+ * space and the number of distinct 16-byte lines touched per window of
+ * retired instructions. All storage is static and sized to the address
+ * space, so a tracked access is two array updates and no allocation.
+ *
+ * Output files (prefix given by -m):
+ *   prefix.csv     - address,reads,writes,execs per line (or per byte, -g 1)
+ *   prefix.ws.csv  - window,instructions,lines,bytes working-set series
+ *   prefix.ppm     - 256x256 image, one pixel per byte (R write, G read, B exec)
+ *   prefix.txt     - ASCII heatmap, one character per 16-byte line
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "tracker.h"
+
+#define ADDRSPACE  65536              // byte addresses
+#define LINESIZE   16                 // bytes per cache line
+#define LINES      (ADDRSPACE / LINESIZE)
+#define MAPWORDS   (LINES / 64)       // 64 lines per bitmap word
+#define ASCIICOLS  64                 // lines per row in ASCII heatmap
+#define KINDS      3
+
+/* Static variable */
+int track_on = 0;
+
+static uint32_t counts[KINDS][ADDRSPACE];   // access counters per byte
+static uint64_t window_map[MAPWORDS];       // lines touched in current window
+static uint64_t total_map[MAPWORDS];        // lines touched since start
+static long     instructions;               // retired instructions
+static long     windows;                    // completed windows
+static int      window_size;                // instructions per window
+static int      peak_lines;                 // largest working set seen
+static int      granularity = LINESIZE;     // csv granularity in bytes
+static FILE*    fp_ws;                      // working-set series
+static char     out_prefix[STRLEN];
+
+/* characters from cold to hot */
+static const char* ramp = " .:-=+*#%@";
+
+/**
+* Helper Functions
+*/
+/* open prefix.ext for writing */
+static FILE* open_output(char* ext, char* mode)
+{
+	char name[STRLEN + 8];
+	snprintf(name, sizeof name, "%s.%s", out_prefix, ext);
+	FILE* fp = fopen(name, mode);
+	if (!fp) oops(name)
+	return fp;
+}
+
+/* number of set bits in bitmap */
+static int map_count(uint64_t* map)
+{
+	int i, n = 0;
+	for (i = 0; i < MAPWORDS; i++)
+		n += __builtin_popcountll(map[i]);
+	return n;
+}
+
+/* bit length of a counter, used as a log2 scale */
+static int bitlen(uint64_t x)
+{
+	return x == 0 ? 0 : 64 - __builtin_clzll(x);
+}
+
+/* scale count into [0, levels) on a log scale relative to max */
+static int scale(uint64_t count, uint64_t max, int levels)
+{
+	if (count == 0 || max == 0) return 0;
+	int level = bitlen(count) * (levels - 1) / bitlen(max);
+	return level < 1 ? 1 : level;
+}
+
+/* sum of counter over [addr, addr + size) */
+static uint64_t sum_range(int kind, int addr, int size)
+{
+	uint64_t n = 0;
+	int i;
+	for (i = addr; i < addr + size; i++)
+		n += counts[kind][i];
+	return n;
+}
+
+/* close current working-set window */
+static void flush_window()
+{
+	int lines = map_count(window_map);
+	if (lines > peak_lines)
+		peak_lines = lines;
+	fprintf(fp_ws, "%ld,%ld,%d,%d\n", windows, instructions, lines, lines * LINESIZE);
+	memset(window_map, 0, sizeof window_map);
+	windows++;
+}
+
+
+/**
+* Tracking API used by emulator.c
+*/
+/* enable tracking, output goes to prefix.* */
+void track_init(char* prefix, int window)
+{
+	snprintf(out_prefix, sizeof out_prefix, "%s", prefix);
+	window_size = window > 0 ? window : 1000;
+	if (granularity <= 0) granularity = LINESIZE;
+	fp_ws = open_output("ws.csv", "w");
+	fprintf(fp_ws, "window,instructions,lines,bytes\n");
+	track_on = 1;
+}
+
+/* set csv granularity, 1 (byte) or 16 (line) */
+void track_granularity(int bytes)
+{
+	granularity = bytes == 1 ? 1 : LINESIZE;
+}
+
+/* count one byte access */
+void track_access(uint16_t byte_addr, int kind)
+{
+	int line = byte_addr / LINESIZE;
+	uint64_t bit = 1ULL << (line % 64);
+	counts[kind][byte_addr]++;
+	window_map[line / 64] |= bit;
+	total_map[line / 64]  |= bit;
+}
+
+/* count one retired instruction, closing the window when full */
+void track_retire()
+{
+	if (++instructions % window_size == 0)
+		flush_window();
+}
+
+/* write csv, ppm, ascii heatmaps and summary */
+void track_dump()
+{
+	int i, k;
+	if (!track_on) return;
+	if (instructions % window_size != 0)
+		flush_window();         // partial last window
+	fclose(fp_ws);
+
+	// csv: nonzero rows only
+	FILE* fp = open_output("csv", "w");
+	fprintf(fp, "address,reads,writes,execs\n");
+	for (i = 0; i < ADDRSPACE; i += granularity) {
+		uint64_t n[KINDS];
+		for (k = 0; k < KINDS; k++)
+			n[k] = sum_range(k, i, granularity);
+		if (n[TRACK_READ] || n[TRACK_WRITE] || n[TRACK_EXEC])
+			fprintf(fp, "0x%04x,%llu,%llu,%llu\n", i, (unsigned long long) n[TRACK_READ],
+				(unsigned long long) n[TRACK_WRITE], (unsigned long long) n[TRACK_EXEC]);
+	}
+	fclose(fp);
+
+	// ppm: one pixel per byte, channel per access kind
+	uint64_t max[KINDS] = {0,};
+	for (k = 0; k < KINDS; k++)
+		for (i = 0; i < ADDRSPACE; i++)
+			if (counts[k][i] > max[k]) max[k] = counts[k][i];
+	fp = open_output("ppm", "wb");
+	fprintf(fp, "P6\n256 256\n255\n");
+	for (i = 0; i < ADDRSPACE; i++) {
+		fputc(scale(counts[TRACK_WRITE][i], max[TRACK_WRITE], 256), fp);
+		fputc(scale(counts[TRACK_READ][i],  max[TRACK_READ],  256), fp);
+		fputc(scale(counts[TRACK_EXEC][i],  max[TRACK_EXEC],  256), fp);
+	}
+	fclose(fp);
+
+	// ascii: one char per line, all kinds summed
+	static uint64_t line_total[LINES];
+	uint64_t line_max = 0;
+	for (i = 0; i < LINES; i++) {
+		line_total[i] = 0;
+		for (k = 0; k < KINDS; k++)
+			line_total[i] += sum_range(k, i * LINESIZE, LINESIZE);
+		if (line_total[i] > line_max) line_max = line_total[i];
+	}
+	int levels = strlen(ramp);
+	fp = open_output("txt", "w");
+	fprintf(fp, "# one column per %d-byte line, '%s' cold to hot\n", LINESIZE, ramp);
+	for (i = 0; i < LINES; i += ASCIICOLS) {
+		fprintf(fp, "%04x |", i * LINESIZE);
+		for (k = i; k < i + ASCIICOLS; k++)
+			fputc(ramp[scale(line_total[k], line_max, levels)], fp);
+		fprintf(fp, "|\n");
+	}
+	fclose(fp);
+
+	fprintf(stderr, "\n[heatmap] %ld instructions, %d lines touched, peak working set %d lines (%d bytes) per %d instructions\n",
+		instructions, map_count(total_map), peak_lines, peak_lines * LINESIZE, window_size);
+}
@@ -0,0 +1,21 @@
+/*
+ * tracker.h -- memory access heatmap and working-set tracker
+ */
+
+#ifndef TRACKER_INCL
+#define TRACKER_INCL
+
+/* Access kinds counted per byte address */
+#define TRACK_READ   0
+#define TRACK_WRITE  1
+#define TRACK_EXEC   2
+
+extern int track_on;  // set by track_init, checked before every hook
+
+void track_init(char* prefix, int window);
+void track_granularity(int bytes);
+void track_access(uint16_t byte_addr, int kind);
+void track_retire();
+void track_dump();
+
+#endif /* TRACKER_INCL */